@@ -11,7 +11,7 @@ TEMP_TIMESTAMP_FILE="/tmp/shader_timestamps_current.txt"
 
 pushd "$SHADER_DIR" > /dev/null || exit
 
-for f in *.vert *.frag *.geom *.comp *.tesc *.tese *.mesh *.task *.rgen *.rint *.rahit *.rchit *.rmiss; do
+for f in *.glsl *.vert *.frag *.geom *.comp *.tesc *.tese *.mesh *.task *.rgen *.rint *.rahit *.rchit *.rmiss; do
     if [ -f "$f" ]; then
         shader_time=$(stat -c %y "$f")
         echo "$f $shader_time" >> "$TEMP_TIMESTAMP_FILE"
@@ -29,13 +29,19 @@ if ! diff "$TEMP_TIMESTAMP_FILE" "$TIMESTAMP_FILE" > /dev/null; then
 
             if [ ! -f "$output_file" ]; then
                 echo "Compiling new shader: $f"
-                glslc -I"$SHADER_DIR" "$f" -o "$output_file"
+                glslc --target-env=vulkan1.1 -I"$SHADER_DIR" "$f" -o "$output_file"
             else
-                shader_time=$(stat -c %y "$f")
-                output_time=$(stat -c %y "$output_file")
-                if [ "$shader_time" -ne "$output_time" ]; then
+                # Shared *.glsl includes can change without the shader itself changing
+                stale=false
+                for dep in "$f" *.glsl; do
+                    if [ -f "$dep" ] && [ "$dep" -nt "$output_file" ]; then
+                        stale=true
+                    fi
+                done
+
+                if [ "$stale" = true ]; then
                     echo "Recompiling changed shader: $f"
-                    glslc -I"$SHADER_DIR" "$f" -o "$output_file"
+                    glslc --target-env=vulkan1.1 -I"$SHADER_DIR" "$f" -o "$output_file"
                 fi
             fi
         fi
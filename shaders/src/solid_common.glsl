@@ -0,0 +1,17 @@
+#ifndef SOLID_COMMON_GLSL
+#define SOLID_COMMON_GLSL
+
+// Interior voxels found by parity along +x, same packing as the occupancy grid
+layout (r32ui, set = 0, binding = 5) uniform uimage3D solid;
+
+// Bit 0 holds the parity of all crossings of the row through voxel centers (y, z),
+// including those outside the grid. An odd count means the mesh leaks along that row.
+layout(std430, set = 0, binding = 6) buffer RowParity {
+    uint row_parity[];
+};
+
+uint row_index(int y, int z) {
+    return uint(z) * grid_height + uint(y);
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef VOXEL_COMMON_GLSL
+#define VOXEL_COMMON_GLSL
+
+// One bit per voxel, 32 consecutive voxels along x packed into each texel
+layout (r32ui, set = 0, binding = 0) uniform uimage3D occupancy;
+
+// Extent of the tile in the images, see VoxelTile. Specialized per pipeline variant, so
+// bounds checks and row strides fold into constants; ids 0-2 are the workgroup size
+layout (constant_id = 3) const uint grid_width = 1;
+layout (constant_id = 4) const uint grid_height = 1;
+layout (constant_id = 5) const uint grid_depth = 1;
+
+layout(set = 0, binding = 3) uniform Params {
+    uint index_count;
+    float voxel_scale;  // object space -> voxel units of the whole grid, see VoxelGrid
+    float voxel_offset;
+    uint tile_origin_z; // layer of the whole grid stored at z = 0
+};
+
+// Everything the overlap test needs, computed once per triangle by triangle_setup.comp.
+// All positions are in voxel units, so voxel p covers the box [p, p + 1].
+// The fields are ordered so that the cheap early-outs read the first bytes only.
+struct TriangleSetup {
+    vec4 bounds_min;  // w = plane offset d1 for the critical point
+    vec4 bounds_max;  // w = plane offset d2 for the opposite corner
+    vec4 normal;
+    vec4 edges_xy[3]; // xy = edge normal, z = edge offset
+    vec4 edges_yz[3];
+    vec4 edges_zx[3];
+    vec4 v0;
+    vec4 v1;
+    vec4 v2;
+};
+
+layout(std430, set = 0, binding = 4) buffer TriangleSetups {
+    TriangleSetup triangle_setups[];
+};
+
+ivec3 grid_size() {
+    return ivec3(grid_width, grid_height, grid_depth);
+}
+
+// Position in the whole grid of a voxel of the current tile. Triangle setups stay in
+// whole-grid units, so every tile tests exactly the coordinates an untiled run would.
+vec3 grid_voxel(ivec3 voxel) {
+    return vec3(voxel + ivec3(0, 0, tile_origin_z));
+}
+
+void mark_voxel(ivec3 voxel) {
+    imageAtomicOr(occupancy, ivec3(voxel.x >> 5, voxel.yz), 1u << (voxel.x & 31));
+}
+
+// Products are spelled out and marked precise, so no multiply-add gets fused and the
+// CPU backend can reproduce the exact same decisions.
+float edge_function(vec4 edge, vec2 p) {
+    precise float value = edge.x * p.x + edge.y * p.y + edge.z;
+    return value;
+}
+
+// Conservative triangle/voxel overlap (Schwarz & Seidel 2010): the box axes, the
+// triangle normal and the nine edge/axis cross products, i.e. the full 13-axis SAT.
+bool triangle_overlaps_voxel(uint triangle, vec3 p) {
+    vec4 bounds_min = triangle_setups[triangle].bounds_min;
+    vec4 bounds_max = triangle_setups[triangle].bounds_max;
+    if (any(greaterThan(bounds_min.xyz, p + 1.0)) || any(lessThan(bounds_max.xyz, p))) {
+        return false;
+    }
+
+    vec3 n = triangle_setups[triangle].normal.xyz;
+    precise float np = n.x * p.x + n.y * p.y + n.z * p.z;
+    precise float plane = (np + bounds_min.w) * (np + bounds_max.w);
+    if (plane > 0.0) {
+        return false;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        if (edge_function(triangle_setups[triangle].edges_xy[i], p.xy) < 0.0 ||
+            edge_function(triangle_setups[triangle].edges_yz[i], p.yz) < 0.0 ||
+            edge_function(triangle_setups[triangle].edges_zx[i], p.zx) < 0.0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef VOXELIZE_VOXELS_GLSL
+#define VOXELIZE_VOXELS_GLSL
+
+// One invocation per voxel, testing the candidate triangles picked by candidate_source.
+// The source is a specialization constant, so each pipeline variant keeps only its own
+// loop and the driver compiles it like a dedicated shader.
+//
+// Included by voxelize_voxels.comp, which sums the traversal stats per subgroup, and by
+// voxelize_voxels_atomic.comp for devices without subgroup arithmetic in compute shaders.
+
+layout (local_size_x_id = 0, local_size_y_id = 1, local_size_z_id = 2) in;
+
+#include "voxel_common.glsl"
+
+// 0: every triangle, 1: the triangles TriangleBinner put into the voxel's brick,
+// 2: the leaves of the BvhBuilder hierarchy the voxel overlaps
+layout (constant_id = 6) const uint candidate_source = 0;
+
+layout(std430, set = 0, binding = 5) readonly buffer BrickOffsets {
+    uint brick_offsets[];
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer BrickTriangles {
+    uint brick_triangles[];
+};
+
+// 64-bit totals kept as lo/hi pairs, so large grids do not wrap the counters
+layout(std430, set = 0, binding = 7) buffer TraversalStats {
+    uint nodes_visited[2];
+    uint triangle_tests[2];
+};
+
+// See Bvh.hpp for the node layout
+struct BvhNode {
+    vec4 min;
+    vec4 max;
+};
+
+layout(std430, set = 0, binding = 8) readonly buffer BvhNodes {
+    BvhNode bvh_nodes[];
+};
+
+layout(std430, set = 0, binding = 9) readonly buffer BvhTriangles {
+    uint bvh_triangles[];
+};
+
+const uint max_stack_depth = 64; // BvhBuilder::max_depth
+
+bool intersects_any(vec3 voxel) {
+    for (uint triangle = 0; triangle < index_count / 3; ++triangle) {
+        if (triangle_overlaps_voxel(triangle, voxel)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The workgroup has to match TriangleBinner::brick_size for this to find the brick
+bool intersects_binned(vec3 voxel) {
+    // Tiles start on a brick boundary, see App::tile_depth
+    uvec3 brick = gl_WorkGroupID + uvec3(0, 0, tile_origin_z / gl_WorkGroupSize.z);
+    uint brick_index = (brick.z * gl_NumWorkGroups.y + brick.y) * gl_NumWorkGroups.x + brick.x;
+
+    for (uint i = brick_offsets[brick_index]; i < brick_offsets[brick_index + 1]; ++i) {
+        if (triangle_overlaps_voxel(brick_triangles[i], voxel)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void add_counter_nodes(uint value) {
+    uint previous = atomicAdd(nodes_visited[0], value);
+    if (previous + value < previous) {
+        atomicAdd(nodes_visited[1], 1);
+    }
+}
+
+void add_counter_tests(uint value) {
+    uint previous = atomicAdd(triangle_tests[0], value);
+    if (previous + value < previous) {
+        atomicAdd(triangle_tests[1], 1);
+    }
+}
+
+bool overlaps(BvhNode node, vec3 box_min, vec3 box_max) {
+    return all(lessThanEqual(node.min.xyz, box_max)) && all(greaterThanEqual(node.max.xyz, box_min));
+}
+
+// Walks the hierarchy with the voxel bounds as the query box. Voxels outside the grid
+// still take part with an empty walk, so the subgroup totals see every invocation.
+bool intersects_bvh(vec3 voxel_min, bool inside) {
+    vec3 voxel_max = voxel_min + 1.0;
+
+    uint stack[max_stack_depth];
+    uint stack_size = 0;
+    uint node_index = 0;
+
+    uint visited = 0;
+    uint tests = 0;
+    bool intersects = false;
+
+    while (inside) {
+        BvhNode node = bvh_nodes[node_index];
+        ++visited;
+
+        if (overlaps(node, voxel_min, voxel_max)) {
+            uint count = floatBitsToUint(node.max.w);
+            uint offset = floatBitsToUint(node.min.w);
+
+            if (count == 0) {
+                stack[stack_size++] = offset;
+                node_index = node_index + 1;
+                continue;
+            }
+
+            for (uint i = offset; i < offset + count; ++i) {
+                ++tests;
+                if (triangle_overlaps_voxel(bvh_triangles[i], voxel_min)) {
+                    intersects = true;
+                    break;
+                }
+            }
+
+            if (intersects) {
+                break;
+            }
+        }
+
+        if (stack_size == 0) {
+            break;
+        }
+        node_index = stack[--stack_size];
+    }
+
+#ifdef SUBGROUP_TOTALS
+    uint subgroup_visited = subgroupAdd(visited);
+    uint subgroup_tests = subgroupAdd(tests);
+    if (subgroupElect()) {
+        add_counter_nodes(subgroup_visited);
+        add_counter_tests(subgroup_tests);
+    }
+#else
+    if (visited != 0) {
+        add_counter_nodes(visited);
+        add_counter_tests(tests);
+    }
+#endif
+
+    return intersects;
+}
+
+void main() {
+    ivec3 pixel_coords = ivec3(gl_GlobalInvocationID.xyz);
+    bool inside = all(lessThan(pixel_coords, grid_size()));
+    vec3 voxel = grid_voxel(pixel_coords);
+
+    bool intersects;
+    if (candidate_source == 2) {
+        intersects = intersects_bvh(voxel, inside);
+    } else if (!inside) {
+        return;
+    } else if (candidate_source == 1) {
+        intersects = intersects_binned(voxel);
+    } else {
+        intersects = intersects_any(voxel);
+    }
+
+    if (inside && intersects) {
+        mark_voxel(pixel_coords);
+    }
+}
+
+#endif
@@ -1,210 +1,1216 @@
 #include "App.hpp"
 
+#include "CpuProfiler.hpp"
 #include "Logger.hpp"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#include "PngWriter.hpp"
+#include "TraceWriter.hpp"
+#include "ThreadPool.hpp"
+#include "VolumeWriter.hpp"
 
 namespace boza
 {
-    App::App(const std::string_view& name) : name{ name }, ok{ true }
+    App::App(const std::string_view& name, const Settings& settings)
+        : settings{ settings }, name{ name }, ok{ true }
     {
         Logger::trace("Starting...");
-        if (!initialize_vulkan_objects()) return;
-        if (!create_compute_shader("compute.comp")) return;
-        if (!create_image3d()) return;
 
-        const MeshData mesh_data = TriangleLoader::load_from_obj("model.obj");
-        if (!mesh_data)
+        if (settings.backend == Backend::Cpu)
         {
-            Logger::error("Failed to load image data from model.obj");
-            ok = false;
+            if (settings.verify) Logger::warn("--verify compares against the Vulkan backend and is ignored with --cpu");
             return;
         }
 
+        use_gpu = initialize_vulkan_objects() && create_gpu_resources();
+        if (use_gpu) load_tuning();
+        if (use_gpu || settings.backend == Backend::Vulkan) return;
+
+        Logger::warn("Vulkan is unavailable, falling back to the CPU voxelizer ({})", CpuVoxelizer::instruction_set());
+        ok = true;
+    }
+
+    App::~App()
+    {
+        // Whatever the driver compiled this run is there for the next one
+        if (use_gpu)
+        {
+            report_pipelines();
+            device.get_allocator().report();
+            pipeline_cache.save();
+        }
+        PROFILE_FLUSH("cpu_profile");
+        if (ok) Logger::trace("Exiting...");
+    }
+
+
+    bool App::run(const VoxelizationMode mode)
+    {
+        const Job job
+        {
+            "model.obj",
+            settings.output_format == OutputFormat::Rgba8 ? "output.png" : "output.vox",
+            settings.extent,
+            settings.scale
+        };
+
+        return run_batch({ &job, 1 }, mode);
+    }
+
+    bool App::run_batch(const std::span<const Job> jobs, const VoxelizationMode mode)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        // Parsing is independent of the device, so a few meshes ahead are loaded while the
+        // current one is voxelized. The window is bounded to keep at most that many in memory
+        std::queue<std::future<MeshData>> loads;
+        ThreadPool                        loader{ std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u) };
+
+        // On the GPU, meshes are parsed straight into the memory they are uploaded from
+        const MeshSink sink = use_gpu ? staging_sink() : nullptr;
+
+        size_t     next_load = 0;
+        const auto prefetch  = [&]
+        {
+            for (; next_load < jobs.size() && loads.size() <= loader.get_thread_count(); ++next_load)
+            {
+                const std::string& input = jobs[next_load].input;
+                const bool         cache = settings.mesh_cache;
+                loads.push(loader.submit([&input, cache, sink]
+                {
+                    return TriangleLoader::load(input, cache, sink);
+                }));
+            }
+        };
+
+        size_t failed = 0;
+        prefetch();
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            const Job& job = jobs[i];
+            if (jobs.size() > 1) Logger::info("Job {} of {}: {} -> {}", i + 1, jobs.size(), job.input, job.output);
+
+            {
+                PROFILE_ZONE("mesh wait");
+                mesh_data = loads.front().get();
+            }
+            loads.pop();
+            prefetch();
+
+            if (!mesh_data)
+            {
+                Logger::error("Failed to load mesh data from {}", job.input);
+                ++failed;
+                continue;
+            }
+
+            if (!configure(job) || !voxelize(job, mode)) ++failed;
+        }
+
+        if (jobs.size() > 1)
+        {
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            Logger::info("Finished {} of {} jobs in {:.2f} s", jobs.size() - failed, jobs.size(), seconds);
+        }
+
+        return failed == 0;
+    }
+
+    bool App::autotune()
+    {
+        if (!use_gpu)
+        {
+            Logger::error("Autotuning needs a Vulkan device");
+            return false;
+        }
+
+        Autotuner autotuner{ device, command_pool, autotune_repetitions };
+        if (!autotuner) return false;
+
+        // 65k triangles in a 128^3 grid, so the dispatch shape and not the
+        // launch overhead decides
+        mesh_data = Autotuner::make_benchmark_mesh(256);
+        const Job job{ "the benchmark sphere", {}, glm::uvec3{ 128 }, 0.9f };
+        if (!configure(job)) return false;
+        if (!create_job_resources())
+        {
+            ok = true;
+            return false;
+        }
+
+        const vk::PhysicalDeviceProperties properties = device.get_physical_device().getProperties();
+        const DispatchTuning               defaults;
+        const DispatchTuning               previous = tuning;
+        const VoxelTile                    tile{ 0, tile_depth };
+
+        // Setups and the cleared grid are recorded before every run, outside of the timestamps
+        if (!write_tile_inputs(0, tile)) return false;
+        const Autotuner::Recorder prepare = [&](const vk::CommandBuffer& cmd)
+        {
+            return record_tile_setup(cmd, tile, lanes.front(), 0);
+        };
+
+        // Every run has finished before the next one, so the dispatch counts can be rewritten
+        const auto time_surface = [&](const VoxelizationMode mode, const DispatchTuning& candidate, double& ms)
+        {
+            tuning = candidate;
+            return write_mesh_dispatches() &&
+                   autotuner.time(prepare, [&](const vk::CommandBuffer& cmd) { return record_surface(cmd, mode, tile); },
+                                  ms);
+        };
+
+        DispatchTuning best;
+        double         default_ms = 0.0;
+        double         best_ms    = std::numeric_limits<double>::max();
+        for (const uint32_t workgroup_size : Autotuner::triangle_workgroup_sizes(properties.limits))
+        {
+            for (const uint32_t count : Autotuner::triangles_per_invocation_counts())
+            {
+                DispatchTuning candidate           = defaults;
+                candidate.triangle_workgroup_size  = workgroup_size;
+                candidate.triangles_per_invocation = count;
+
+                double ms = 0.0;
+                if (!time_surface(VoxelizationMode::PerTriangle, candidate, ms))
+                {
+                    tuning = previous;
+                    return false;
+                }
+
+                Logger::trace("Per triangle, workgroups of {} with {} triangles each: {:.3f} ms", workgroup_size, count, ms);
+                if (workgroup_size == defaults.triangle_workgroup_size && count == defaults.triangles_per_invocation)
+                    default_ms = ms;
+
+                if (ms < best_ms)
+                {
+                    best_ms                       = ms;
+                    best.triangle_workgroup_size  = workgroup_size;
+                    best.triangles_per_invocation = count;
+                }
+            }
+        }
+
+        Logger::info("Per triangle: workgroups of {} with {} triangles each, {:.3f} ms against {:.3f} ms by default",
+                     best.triangle_workgroup_size, best.triangles_per_invocation, best_ms, default_ms);
+
+        // The BVH is the per-voxel mode worth using, and binned candidates are fixed to a brick
+        default_ms = 0.0;
+        best_ms    = std::numeric_limits<double>::max();
+        for (const glm::uvec3& workgroup_size : Autotuner::voxel_workgroup_sizes(properties.limits))
+        {
+            DispatchTuning candidate       = defaults;
+            candidate.voxel_workgroup_size = workgroup_size;
+
+            double ms = 0.0;
+            if (!time_surface(VoxelizationMode::Bvh, candidate, ms))
+            {
+                tuning = previous;
+                return false;
+            }
+
+            Logger::trace("Per voxel, workgroups of {}x{}x{}: {:.3f} ms", workgroup_size.x, workgroup_size.y,
+                          workgroup_size.z, ms);
+            if (workgroup_size == defaults.voxel_workgroup_size) default_ms = ms;
+
+            if (ms < best_ms)
+            {
+                best_ms                   = ms;
+                best.voxel_workgroup_size = workgroup_size;
+            }
+        }
+
+        Logger::info("Per voxel: workgroups of {}x{}x{}, {:.3f} ms against {:.3f} ms by default",
+                     best.voxel_workgroup_size.x, best.voxel_workgroup_size.y, best.voxel_workgroup_size.z,
+                     best_ms, default_ms);
+
+        tuning = best;
+        if (!TuningDatabase::store(std::string{ tuning_filename }, properties, tuning)) return false;
+
+        Logger::info("Stored dispatch tuning for {} in {}", properties.deviceName.data(), tuning_filename);
+        return true;
+    }
+
+    bool App::configure(const Job& job)
+    {
+        width  = job.extent.x;
+        height = job.extent.y;
+        depth  = job.extent.z;
+        scale  = job.scale;
+
+        if (width == 0 || height == 0 || depth == 0)
+        {
+            Logger::error("Grid extent {}x{}x{} is empty", width, height, depth);
+            return false;
+        }
+
+        // Tiles start on a brick boundary, so voxelize_voxels.comp can find its brick
+        tile_depth = settings.tile_depth == 0 ? depth : std::min(settings.tile_depth, depth);
+        if (tile_depth < depth && tile_depth % TriangleBinner::brick_size != 0)
+        {
+            tile_depth = (tile_depth + TriangleBinner::brick_size - 1) / TriangleBinner::brick_size * TriangleBinner::brick_size;
+            Logger::warn("Tile depth rounded up to {} layers, a multiple of the brick size", tile_depth);
+        }
+
+        if (tile_depth < depth && settings.output_format == OutputFormat::Rgba8)
+        {
+            Logger::error("The PNG atlas needs the whole grid at once; use --occupancy or --raw to voxelize in tiles");
+            return false;
+        }
+
         index_count = static_cast<uint32_t>(mesh_data.indices.size());
 
-        if (!create_vertex_buffer(mesh_data)) return;
-        if (!create_index_buffer(mesh_data)) return;
-        if (!create_uniform_buffer()) return;
+        if (settings.solid && !mesh_data.is_watertight())
+            Logger::warn("{} is not watertight; rows that cross it an odd number of times keep only the surface", job.input);
+
+        return true;
+    }
+
+    bool App::voxelize(const Job& job, const VoxelizationMode mode)
+    {
+        PROFILE_ZONE("job");
+        const int64_t start_ns = CpuProfiler::now_ns();
+
+        const glm::uvec3 extent{ width, height, depth };
+        const uint32_t   tile_count = (depth + tile_depth - 1) / tile_depth;
+        if (tile_count > 1)
+            Logger::info("Voxelizing {}x{}x{} in {} tiles of {} layers", width, height, depth, tile_count, tile_depth);
+
+        bool on_gpu = use_gpu;
+        if (on_gpu && !create_job_resources())
+        {
+            // The device and pipelines are still fine, only this grid or mesh did not fit
+            ok = true;
+            if (settings.backend == Backend::Vulkan) return false;
+
+            Logger::warn("Voxelizing {} on the CPU instead", job.input);
+            on_gpu = false;
+        }
+
+        // Tiles go from the readback slots straight to the file
+        VolumeStreamWriter output{ nullptr };
+        if (settings.output_format != OutputFormat::Rgba8)
+        {
+            output = VolumeStreamWriter(job.output, extent,
+                                        settings.output_format == OutputFormat::Occupancy ? VolumeFormat::Occupancy
+                                                                                          : VolumeFormat::Rgba8);
+            if (!output) return false;
+        }
+
+        uint64_t mismatches = 0;
+        uint64_t filled     = 0;
+
+        const TileConsumer consume = [&](const VoxelTile& tile, const std::span<const uint32_t> words,
+                                         const std::span<const uint8_t> rgba)
+        {
+            if (on_gpu && settings.verify) mismatches += count_mismatches(tile, words, filled);
+
+            switch (settings.output_format)
+            {
+            case OutputFormat::Rgba8:
+                // Always a single tile, see configure
+                return save_image(rgba, job.output);
+
+            case OutputFormat::Occupancy:
+                return output.write_layers({ reinterpret_cast<const uint8_t*>(words.data()), words.size_bytes() });
+
+            case OutputFormat::RawRgba8:
+                return output.write_layers(rgba);
+            }
+
+            return false;
+        };
+
+        if (on_gpu)
+        {
+            // Matches the GPU clock to the host one again while the queue is idle
+            profiler.clear();
+            if (!profiler.calibrate()) Logger::warn("Failed to calibrate the GPU profiler");
+
+            if (!voxelize_pipelined(mode, consume)) return false;
+        }
+        else
+        {
+            for (uint32_t first = 0; first < depth; first += tile_depth)
+            {
+                const VoxelTile tile{ first, std::min(tile_depth, depth - first) };
+                const std::vector<uint32_t> words = CpuVoxelizer::voxelize(mesh_data, { extent, scale }, tile,
+                                                                           settings.solid);
+                // The words cover the tile's layers only
+                const glm::uvec3           tile_extent{ extent.x, extent.y, tile.depth };
+                const std::vector<uint8_t> rgba = has_rgba_output()
+                                                      ? CpuVoxelizer::expand_to_rgba8(words, tile_extent)
+                                                      : std::vector<uint8_t>{};
+                if (!consume(tile, words, rgba)) return false;
+            }
+        }
+
+        if (settings.output_format != OutputFormat::Rgba8 && !output.finish())
+        {
+            Logger::error("Failed to save {}", job.output);
+            return false;
+        }
+
+        if (on_gpu && mode == VoxelizationMode::Bvh) report_bvh_traversal();
+        if (settings.profile) write_profile(job, start_ns);
+
+        if (on_gpu && settings.verify)
+        {
+            if (mismatches == 0) Logger::info("Vulkan and CPU voxelizations match ({} voxels set)", filled);
+            else Logger::error("Vulkan and CPU voxelizations differ in {} of {} voxels", mismatches, filled);
+        }
+
+        return true;
+    }
+
+    bool App::voxelize_pipelined(const VoxelizationMode mode, const TileConsumer& consume)
+    {
+        const uint32_t tile_count = (depth + tile_depth - 1) / tile_depth;
+        const uint32_t slot_count = readback_ring.get_slot_count();
+        const uint32_t lane_count = static_cast<uint32_t>(lanes.size());
+        uint32_t       resubmitted{ 0 };
+
+        // The buffers of the job were uploaded on compute queue 0
+        const QueueTicket uploaded = device.get_scheduler().get_last_ticket(0);
+
+        // Traversal stats add up over all tiles; nothing is in flight before the first one
+        if (mode == VoxelizationMode::Bvh)
+        {
+            const std::array<uint32_t, 4> zero_stats{};
+            if (!bvh_stats_buffer.copy_data(zero_stats.data(), sizeof(zero_stats)))
+                Logger::warn("Failed to reset BVH traversal stats");
+        }
+
+        const auto tile_of = [&](const uint64_t index)
+        {
+            const uint32_t first = static_cast<uint32_t>(index) * tile_depth;
+            return VoxelTile{ first, std::min(tile_depth, depth - first) };
+        };
+
+        // Hands a finished tile to the consumer while the tiles after it are still on the GPU
+        const auto drain = [&](const uint64_t index)
+        {
+            const VoxelTile                tile = tile_of(index);
+            const std::span<const uint8_t> data = readback_ring.wait(index);
+            profiler.resolve(index);
+
+            // The last tile can be thinner than the images, only its layers are copied
+            const size_t tile_words = static_cast<size_t>((width + 31) / 32) * height * tile.depth;
+            if (data.size() < tile_words * sizeof(uint32_t))
+            {
+                Logger::error("Failed to read back layers {} to {}", tile.first, tile.first + tile.depth - 1);
+                return false;
+            }
+
+            const bool consumed = consume(tile,
+                                          { reinterpret_cast<const uint32_t*>(data.data()), tile_words },
+                                          data.subspan(tile_words * sizeof(uint32_t)));
+            readback_ring.release(index);
+            return consumed;
+        };
+
+        // Nothing of a failed run may be reused, and its slots must not stay claimed for the next job
+        const auto abandon = [&]
+        {
+            readback_ring.abandon();
+            std::ranges::fill(recordings, std::nullopt);
+            return false;
+        };
+
+        for (uint64_t index = 0; index < tile_count; ++index)
+        {
+            if (index >= slot_count && !drain(index - slot_count)) return abandon();
+
+            // Lanes on other queues wait for the uploads and for the triangle setups of the first
+            // tile, not its copies; a lane waits for the previous tile of its own to be copied out
+            // of its images
+            const uint32_t                    lane_index = static_cast<uint32_t>(index % lane_count);
+            const Lane&                       lane       = lanes[lane_index];
+            std::vector<QueueScheduler::Wait> waits{ { uploaded, vk::PipelineStageFlagBits::eAllCommands } };
+            if (index > 0 && index < lane_count)
+                waits.push_back({ readback_ring.get_compute_ticket(0), vk::PipelineStageFlagBits::eComputeShader });
+            if (index >= lane_count)
+                waits.push_back({ readback_ring.get_ticket(index - lane_count), vk::PipelineStageFlagBits::eAllCommands });
+
+            // The slot's previous tile has been drained, so its inputs can be overwritten
+            const VoxelTile tile = tile_of(index);
+            const auto      slot = static_cast<uint32_t>(index % slot_count);
+            if (!write_tile_inputs(slot, tile))
+            {
+                Logger::error("Failed to write the inputs of layers {} to {}", tile.first, tile.first + tile.depth - 1);
+                return abandon();
+            }
+
+            // Only the inputs set this tile apart from the one the slot recorded last
+            const TileRecording recording{ mode, lane_index, tile.depth };
+            if (recordings[slot] == recording)
+            {
+                profiler.reuse_frame(index);
+                if (!readback_ring.resubmit(index, lane.queue, waits))
+                {
+                    Logger::error("Failed to submit layers {} to {}", tile.first, tile.first + tile.depth - 1);
+                    return abandon();
+                }
+
+                ++resubmitted;
+                continue;
+            }
+
+            recordings[slot].reset();
+            vk::CommandBuffer command_buffer;
+            if (!readback_ring.begin(index, command_buffer)) return abandon();
+            profiler.begin_frame(command_buffer, index, lane.queue);
+
+            select_lane(lane_index);
+            if (!record_tile(command_buffer, mode, tile, lane, slot))
+            {
+                readback_ring.cancel(index);
+                return abandon();
+            }
+
+            // On the transfer queue the copies are in a command buffer of their own, outside the zones
+            const bool copy_zone = !transfer_command_pool;
+            if (copy_zone) profiler.begin_zone(command_buffer, "copy");
+            if (!readback_ring.copy_image(lane.occupancy.get_image(), lane.occupancy.get_extent(), tile.depth,
+                                          sizeof(uint32_t)) ||
+                (has_rgba_output() &&
+                 !readback_ring.copy_image(lane.image.get_image(), lane.image.get_extent(), tile.depth, 4)))
+            {
+                readback_ring.cancel(index);
+                return abandon();
+            }
+            if (copy_zone) profiler.end_zone(command_buffer);
+
+            if (!readback_ring.submit(index, lane.queue, waits))
+            {
+                Logger::error("Failed to submit layers {} to {}", tile.first, tile.first + tile.depth - 1);
+                return abandon();
+            }
+
+            recordings[slot] = recording;
+        }
+
+        for (uint64_t index = tile_count > slot_count ? tile_count - slot_count : 0; index < tile_count; ++index)
+            if (!drain(index)) return abandon();
+
+        readback_ring.report(tile_count);
+        if (resubmitted > 0)
+            Logger::trace("Submitted {} of {} tiles again as recorded", resubmitted, tile_count);
+        return true;
+    }
+
+    uint64_t App::count_mismatches(const VoxelTile& tile, const std::span<const uint32_t> words, uint64_t& filled) const
+    {
+        PROFILE_ZONE("verify");
+        const std::vector<uint32_t> reference = CpuVoxelizer::voxelize(mesh_data, { { width, height, depth }, scale },
+                                                                       tile, settings.solid);
+
+        uint64_t mismatches = 0;
+        for (size_t i = 0; i < reference.size(); ++i)
+        {
+            mismatches += static_cast<uint64_t>(std::popcount(words[i] ^ reference[i]));
+            filled += static_cast<uint64_t>(std::popcount(reference[i]));
+        }
+
+        return mismatches;
+    }
 
-        compute_shader.update_storage_image(0, image.get_image_view(), vk::ImageLayout::eGeneral);
-        compute_shader.update_storage_buffer(1, vertex_buffer.get_buffer());
-        compute_shader.update_storage_buffer(2, index_buffer.get_buffer());
-        compute_shader.update_uniform_buffer(3, uniform_buffer.get_buffer());
 
-        const Params params{ index_count, 0.3f };
-        if (!uniform_buffer.update_uniform(&params, sizeof(Params)))
+    bool App::initialize_vulkan_objects()
+    {
+        instance = Instance(name);
+        if (!instance)
         {
-            Logger::error("Failed to update uniform buffer");
             ok = false;
-            return;
+            return false;
+        }
+
+        device = Device(instance);
+        if (!device)
+        {
+            ok = false;
+            return false;
         }
+
+        // Next to the shaders' working directory, like shaders/spv
+        pipeline_cache = PipelineCache(device, "pipeline_cache.bin");
+        if (!pipeline_cache)
+        {
+            ok = false;
+            return false;
+        }
+
+        command_pool = CommandPool(device);
+        if (!command_pool)
+        {
+            ok = false;
+            return false;
+        }
+
+        if (device.has_transfer_queue())
+        {
+            transfer_command_pool = CommandPool(device, device.get_transfer_queue_family_index());
+            if (!transfer_command_pool) ok = false;
+        }
+
+        return ok;
     }
 
-    App::~App()
+    bool App::create_gpu_resources()
     {
-        if (ok) Logger::trace("Exiting...");
+        // Every lane binds its own images and buffers, so the shaders have a descriptor set per lane
+        const QueueScheduler& scheduler = device.get_scheduler();
+        max_lanes = std::min(readback_slots, scheduler.get_compute_queue_count() + (scheduler.has_transfer_queue() ? 1 : 0));
+
+        if (!create_compute_shader(setup_shader, "triangle_setup.comp")) return false;
+        if (!create_compute_shader(triangle_shader, "voxelize_triangles.comp")) return false;
+
+        // Brick offsets and triangles, BVH traversal stats, BVH nodes and triangles
+        const std::array<ComputeShader::DescriptorBindingInfo, 5> voxel_bindings
+        {{
+            { 5, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute },
+            { 6, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute },
+            { 7, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute },
+            { 8, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute },
+            { 9, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute }
+        }};
+        if (!create_compute_shader(voxel_shader, voxel_shader_name(), voxel_bindings)) return false;
+        if (!create_expand_shader()) return false;
+        if (!create_solid_shaders()) return false;
+        return create_indirect_buffers();
+    }
+
+    bool App::create_job_resources()
+    {
+        // Grid-sized resources are kept while consecutive jobs share a grid
+        const glm::uvec3 extent{ width, height, depth };
+        if (extent != resource_extent || tile_depth != resource_tile_depth)
+        {
+            resource_extent = glm::uvec3{ 0 };
+
+            // Freed before the new ones are allocated, so two grids never coexist
+            readback_ring = ReadbackRing{ nullptr };
+            profiler      = GpuProfiler{ nullptr };
+            lanes.clear();
+
+            const uint32_t tile_count = (depth + tile_depth - 1) / tile_depth;
+            if (!create_lanes(std::min(max_lanes, tile_count))) return false;
+            if (!create_readback_ring()) return false;
+            if (!create_profiler()) return false;
+
+            for (uint32_t i = 0; i < lanes.size(); ++i) bind_lane_resources(i);
+            recordings.assign(readback_ring.get_slot_count(), std::nullopt);
+
+            resource_extent     = extent;
+            resource_tile_depth = tile_depth;
+        }
+
+        // The previous job's meshes are freed first, which lets the transient arena start over
+        vertex_buffer         = Buffer{ nullptr };
+        index_buffer          = Buffer{ nullptr };
+        triangle_setup_buffer = Buffer{ nullptr };
+        brick_offset_buffer   = Buffer{ nullptr };
+        brick_triangle_buffer = Buffer{ nullptr };
+        bvh_node_buffer       = Buffer{ nullptr };
+        bvh_triangle_buffer   = Buffer{ nullptr };
+
+        if (!create_vertex_buffer(mesh_data)) return false;
+        if (!create_index_buffer(mesh_data)) return false;
+        if (!create_triangle_setup_buffer()) return false;
+        if (!create_bin_buffers(mesh_data)) return false;
+        if (!create_bvh_buffers(mesh_data)) return false;
+
+        // The descriptor sets outlive the job, only what they point at changes. Where the mesh
+        // buffers are bound update-after-bind, the recorded tiles keep working with the new ones
+        for (uint32_t i = 0; i < lanes.size(); ++i) bind_mesh_resources(i);
+        if (!device.has_storage_buffer_update_after_bind()) recordings.assign(recordings.size(), std::nullopt);
+
+        select_lane(0);
+        if (!write_mesh_dispatches())
+        {
+            Logger::error("Failed to write the dispatch counts of the mesh");
+            ok = false;
+        }
+
+        return ok;
+    }
+
+    std::string_view App::voxel_shader_name() const
+    {
+        return device.has_subgroup_arithmetic() ? "voxelize_voxels.comp" : "voxelize_voxels_atomic.comp";
+    }
+
+    bool App::create_compute_shader(
+        ComputeShader&                                              shader,
+        const std::string_view&                                     filename,
+        const std::span<const ComputeShader::DescriptorBindingInfo> extra_bindings)
+    {
+        std::vector<ComputeShader::DescriptorBindingInfo> bindings
+        {
+            { 0, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute },
+            { 1, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute },
+            { 2, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute },
+            { 3, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eCompute },
+            { 4, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute }
+        };
+        bindings.insert(bindings.end(), extra_bindings.begin(), extra_bindings.end());
+
+        shader = ComputeShader(device, filename, bindings, {}, pipeline_cache.get(), max_lanes);
+        if (!shader) ok = false;
+        return ok;
     }
 
+    bool App::create_expand_shader()
+    {
+        if (!has_rgba_output()) return true;
+
+        const std::vector<ComputeShader::DescriptorBindingInfo> bindings
+        {
+            { 0, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute },
+            { 1, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute }
+        };
+
+        expand_shader = ComputeShader(device, "expand_occupancy.comp", bindings, {}, pipeline_cache.get(), max_lanes);
+        if (!expand_shader) ok = false;
+        return ok;
+    }
+
+    bool App::create_solid_shaders()
+    {
+        if (!settings.solid) return true;
+
+        const std::array<ComputeShader::DescriptorBindingInfo, 2> solid_bindings
+        {{
+            { 5, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute },
+            { 6, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute }
+        }};
+
+        if (!create_compute_shader(solid_flip_shader, "solid_flip.comp", solid_bindings)) return false;
+        return create_compute_shader(solid_resolve_shader, "solid_resolve.comp", solid_bindings);
+    }
+
+    bool App::create_lanes(const uint32_t lane_count)
+    {
+        const uint32_t queue_count = device.get_scheduler().get_compute_queue_count();
+
+        lanes.resize(lane_count);
+        for (uint32_t i = 0; i < lane_count; ++i)
+        {
+            Lane& lane = lanes[i];
+            lane.queue = i % queue_count;
+
+            if (!create_images(lane)) return false;
+            if (!create_row_parity_buffer(lane)) return false;
+            if (!create_uniform_buffer(lane)) return false;
+        }
+
+        const uint32_t used_queues = std::min(lane_count, queue_count);
+        if (lane_count > 1)
+            Logger::info("Tiles run on {} lanes over {} compute queue{}{}", lane_count, used_queues,
+                         used_queues > 1 ? "s" : "", transfer_command_pool ? ", copied out on the transfer queue" : "");
+        return true;
+    }
+
+    bool App::create_images(Lane& lane)
+    {
+        // 32 voxels along x share one texel of the occupancy grid, and the images hold a single tile
+        Image3D& occupancy = lane.occupancy;
+        occupancy = Image3D(device, vk::Format::eR32Uint, vk::Extent3D((width + 31) / 32, height, tile_depth),
+                            vk::ImageUsageFlagBits::eStorage |
+                            vk::ImageUsageFlagBits::eTransferSrc |
+                            vk::ImageUsageFlagBits::eTransferDst);
+        if (!occupancy)
+        {
+            ok = false;
+            return false;
+        }
+
+        if (settings.solid)
+        {
+            lane.solid = Image3D(device, vk::Format::eR32Uint, occupancy.get_extent(),
+                                 vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst);
+            if (!lane.solid)
+            {
+                ok = false;
+                return false;
+            }
+        }
+
+        if (!has_rgba_output()) return true;
+
+        lane.image = Image3D(device, vk::Format::eR8G8B8A8Unorm, vk::Extent3D(width, height, tile_depth));
+        if (!lane.image) ok = false;
+        return ok;
+    }
+
+    MeshSink App::staging_sink() const
+    {
+        // The BVH and the bins are built from the same memory, so it is read back by the host too
+        const vk::MemoryPropertyFlags cached = vk::MemoryPropertyFlagBits::eHostVisible |
+                                               vk::MemoryPropertyFlagBits::eHostCached;
+        const vk::MemoryPropertyFlags properties =
+            device.get_allocator().find_memory_type(UINT32_MAX, cached) != UINT32_MAX
+                ? cached
+                : vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+
+        return [&device = device, properties](const size_t vertex_count, const size_t index_count) -> MeshStorage
+        {
+            if (vertex_count == 0 || index_count == 0) return {};
+
+            const vk::DeviceSize vertex_size = sizeof(glm::vec4) * vertex_count;
+            const vk::DeviceSize index_size  = sizeof(uint32_t) * index_count;
+
+            auto staging = std::make_shared<Buffer>(device, vertex_size + index_size,
+                                                    vk::BufferUsageFlagBits::eTransferSrc, properties);
+            if (!*staging || !staging->bind())
+            {
+                Logger::error("Failed to create mesh staging buffer");
+                return {};
+            }
+
+            uint8_t* mapped = staging->get_mapped();
+            return {
+                { reinterpret_cast<glm::vec4*>(mapped), vertex_count },
+                { reinterpret_cast<uint32_t*>(mapped + vertex_size), index_count },
+                std::move(staging)
+            };
+        };
+    }
+
+    const Buffer* App::staging_of(const MeshData& mesh_data)
+    {
+        const auto* staging = std::any_cast<std::shared_ptr<Buffer>>(&mesh_data.get_owner());
+        return staging != nullptr ? staging->get() : nullptr;
+    }
+
+    bool App::create_vertex_buffer(const MeshData& mesh_data)
+    {
+        // Already padded to vec4; in the staging buffer when the parser wrote it there
+        if (const Buffer* staging = staging_of(mesh_data))
+            return create_storage_buffer(vertex_buffer, *staging, 0, mesh_data.vertices.size_bytes(), "vertex");
+
+        return create_storage_buffer(vertex_buffer, mesh_data.vertices.data(), mesh_data.vertices.size_bytes(), "vertex");
+    }
+
+    bool App::create_index_buffer(const MeshData& mesh_data)
+    {
+        if (const Buffer* staging = staging_of(mesh_data))
+            return create_storage_buffer(index_buffer, *staging, mesh_data.vertices.size_bytes(),
+                                         mesh_data.indices.size_bytes(), "index");
+
+        return create_storage_buffer(index_buffer, mesh_data.indices.data(), mesh_data.indices.size_bytes(), "index");
+    }
+
+    bool App::create_triangle_setup_buffer()
+    {
+        // Written and read on the GPU only
+        const vk::DeviceSize size = sizeof(TriangleSetup) * std::max(index_count / 3, 1u);
+        triangle_setup_buffer = Buffer{
+            device,
+            size,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            MemoryLifetime::Transient
+        };
+
+        if (!triangle_setup_buffer)
+        {
+            Logger::error("Failed to create triangle setup buffer");
+            ok = false;
+            return false;
+        }
+
+        if (!triangle_setup_buffer.bind())
+        {
+            Logger::error("Failed to bind triangle setup buffer");
+            ok = false;
+        }
+
+        return ok;
+    }
+
+    bool App::create_bin_buffers(const MeshData& mesh_data)
+    {
+        const TriangleBins bins = TriangleBinner::bin_triangles(mesh_data, { { width, height, depth }, scale });
+        if (!bins)
+        {
+            Logger::error("Failed to bin triangles");
+            ok = false;
+            return false;
+        }
+
+        if (!create_storage_buffer(brick_offset_buffer, bins.offsets.data(),
+                                   sizeof(uint32_t) * bins.offsets.size(), "brick offset"))
+            return false;
+
+        // A grid with no triangle inside still needs a valid buffer to bind
+        const uint32_t empty = 0;
+        return bins.triangles.empty()
+                   ? create_storage_buffer(brick_triangle_buffer, &empty, sizeof(uint32_t), "brick triangle")
+                   : create_storage_buffer(brick_triangle_buffer, bins.triangles.data(),
+                                           sizeof(uint32_t) * bins.triangles.size(), "brick triangle");
+    }
 
-    void App::run()
+    bool App::create_bvh_buffers(const MeshData& mesh_data)
     {
-        if (!dispatch())
+        const Bvh bvh = BvhBuilder::build(mesh_data, { { width, height, depth }, scale });
+        if (!bvh)
         {
-            Logger::error("Failed to dispatch compute shader");
-            return;
+            Logger::error("Failed to build BVH");
+            ok = false;
+            return false;
         }
 
-        std::vector<uint8_t> image_data = image.get_data();
-        save_image(image_data, "output.png");
-    }
+        if (!create_storage_buffer(bvh_node_buffer, bvh.nodes.data(), sizeof(BvhNode) * bvh.nodes.size(), "BVH node"))
+            return false;
+
+        const uint32_t empty = 0;
+        if (!(bvh.triangles.empty()
+                  ? create_storage_buffer(bvh_triangle_buffer, &empty, sizeof(uint32_t), "BVH triangle")
+                  : create_storage_buffer(bvh_triangle_buffer, bvh.triangles.data(),
+                                          sizeof(uint32_t) * bvh.triangles.size(), "BVH triangle")))
+            return false;
 
+        const std::array<uint32_t, 4> zero_stats{};
+        return create_storage_buffer(bvh_stats_buffer, zero_stats.data(), sizeof(zero_stats), "BVH stats", true);
+    }
 
-    bool App::initialize_vulkan_objects()
+    bool App::create_row_parity_buffer(Lane& lane)
     {
-        instance = Instance(name);
-        if (!instance)
+        if (!settings.solid) return true;
+
+        Buffer& row_parity_buffer = lane.row_parity_buffer;
+        row_parity_buffer = Buffer{
+            device,
+            sizeof(uint32_t) * height * tile_depth,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
+        };
+
+        if (!row_parity_buffer)
         {
+            Logger::error("Failed to create row parity buffer");
             ok = false;
             return false;
         }
 
-        device = Device(instance);
-        if (!device)
+        if (!row_parity_buffer.bind())
         {
+            Logger::error("Failed to bind row parity buffer");
             ok = false;
-            return false;
         }
 
-        command_pool = CommandPool(device);
-        if (!command_pool) ok = false;
         return ok;
     }
 
-    bool App::create_compute_shader(const std::string_view& filename)
+    bool App::create_storage_buffer(
+        Buffer&                 buffer,
+        const void*             data,
+        const vk::DeviceSize    size,
+        const std::string_view& buffer_name,
+        const bool              host_access)
     {
-        const std::vector<ComputeShader::DescriptorBindingInfo> bindings
+        if (!host_access)
         {
-            { 0, vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute },
-            { 1, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute },
-            { 2, vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute },
-            { 3, vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eCompute }
-        };
-
-        compute_shader = ComputeShader(device, filename, bindings);
-        if (!compute_shader) ok = false;
-        return ok;
-    }
+            // Every voxel or triangle invocation reads these again, so on a discrete GPU they must
+            // not stay behind the bus
+            buffer = Buffer::device_local(device, command_pool, vk::BufferUsageFlagBits::eStorageBuffer, data, size,
+                                          MemoryLifetime::Transient);
+            if (!buffer)
+            {
+                Logger::error("Failed to upload {} buffer", buffer_name);
+                ok = false;
+            }
 
-    bool App::create_image3d()
-    {
-        image = Image3D(device, command_pool, vk::Format::eR8G8B8A8Unorm, vk::Extent3D(width, height, depth));
-        if (!image) ok = false;
-        return ok;
-    }
+            return ok;
+        }
 
-    bool App::create_vertex_buffer(const MeshData& mesh_data)
-    {
-        const size_t vertex_buffer_size = sizeof(glm::vec4) * mesh_data.vertices.size();
-        vertex_buffer = Buffer{
+        buffer = Buffer{
             device,
-            vertex_buffer_size,
+            size,
             vk::BufferUsageFlagBits::eStorageBuffer,
             vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
         };
 
-        if (!vertex_buffer)
+        if (!buffer)
         {
-            Logger::error("Failed to create vertex buffer");
+            Logger::error("Failed to create {} buffer", buffer_name);
             ok = false;
             return false;
         }
 
-        if (!vertex_buffer.bind())
+        if (!buffer.bind())
         {
-            Logger::error("Failed to bind vertex buffer");
+            Logger::error("Failed to bind {} buffer", buffer_name);
             ok = false;
             return false;
         }
 
-        std::vector<glm::vec4> padded_vertices;
-        padded_vertices.reserve(mesh_data.vertices.size());
-        for (const auto& v : mesh_data.vertices)
-            padded_vertices.emplace_back(v, 0.0f);
+        if (!buffer.copy_data(data, size))
+        {
+            Logger::error("Failed to copy data to {} buffer", buffer_name);
+            ok = false;
+        }
+
+        return ok;
+    }
 
-        if (!vertex_buffer.copy_data(padded_vertices.data(), vertex_buffer_size))
+    bool App::create_storage_buffer(
+        Buffer&                 buffer,
+        const Buffer&           staging,
+        const vk::DeviceSize    offset,
+        const vk::DeviceSize    size,
+        const std::string_view& buffer_name)
+    {
+        buffer = Buffer::device_local(device, command_pool, vk::BufferUsageFlagBits::eStorageBuffer, staging, offset,
+                                      size, MemoryLifetime::Transient);
+        if (!buffer)
         {
-            Logger::error("Failed to copy data to vertex buffer");
+            Logger::error("Failed to upload {} buffer", buffer_name);
             ok = false;
         }
 
         return ok;
     }
 
-    bool App::create_index_buffer(const MeshData& mesh_data)
+    bool App::create_uniform_buffer(Lane& lane)
     {
-        const vk::DeviceSize index_buffer_size = sizeof(uint32_t) * mesh_data.indices.size();
-        index_buffer = Buffer{
+        // Each tile copies its params in from tile_input_buffer, see record_tile_setup
+        Buffer& uniform_buffer = lane.uniform_buffer;
+        uniform_buffer = Buffer{
             device,
-            index_buffer_size,
-            vk::BufferUsageFlagBits::eStorageBuffer,
-            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+            sizeof(Params),
+            vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal
         };
 
-        if (!index_buffer)
+        if (!uniform_buffer)
         {
-            Logger::error("Failed to create index buffer");
+            Logger::error("Failed to create uniform buffer");
             ok = false;
             return false;
         }
 
-        if (!index_buffer.bind())
+        if (!uniform_buffer.bind())
         {
-            Logger::error("Failed to bind index buffer");
+            Logger::error("Failed to bind uniform buffer");
             ok = false;
-            return false;
         }
 
-        if (!index_buffer.copy_data(mesh_data.indices.data(), index_buffer_size))
+        return ok;
+    }
+
+    bool App::create_indirect_buffers()
+    {
+        // Written by the host between submissions and read by the tiles' commands
+        tile_input_buffer = Buffer{
+            device,
+            sizeof(TileInputs) * max_readback_slots,
+            vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eIndirectBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+        };
+
+        dispatch_buffer = Buffer{
+            device,
+            sizeof(MeshDispatches),
+            vk::BufferUsageFlagBits::eIndirectBuffer,
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+        };
+
+        if (!tile_input_buffer || !tile_input_buffer.bind() || !dispatch_buffer || !dispatch_buffer.bind())
         {
-            Logger::error("Failed to copy data to index buffer");
+            Logger::error("Failed to create the tile input and dispatch buffers");
             ok = false;
         }
 
         return ok;
     }
 
-    bool App::create_uniform_buffer()
+    bool App::create_readback_ring()
     {
-        uniform_buffer = Buffer::uniform_buffer(device, sizeof(Params));
-        if (!uniform_buffer)
+        // A slot holds a whole tile of occupancy, followed by the RGBA8 voxels when there are any
+        const vk::Extent3D& occupancy_extent = lanes.front().occupancy.get_extent();
+        vk::DeviceSize      slot_size = static_cast<vk::DeviceSize>(occupancy_extent.width) * height * tile_depth *
+                                        sizeof(uint32_t);
+        if (has_rgba_output())
+            slot_size += static_cast<vk::DeviceSize>(width) * height * tile_depth * 4;
+
+        // A multiple of the lanes, so a slot always holds tiles of the same lane and its recording
+        // can be submitted again, see voxelize_pipelined
+        const uint32_t tile_count = (depth + tile_depth - 1) / tile_depth;
+        const auto     lane_count = static_cast<uint32_t>(lanes.size());
+        const uint32_t slot_count = (std::min(readback_slots, tile_count) + lane_count - 1) / lane_count * lane_count;
+        readback_ring = ReadbackRing(device, command_pool, transfer_command_pool, slot_size, slot_count);
+        if (!readback_ring) ok = false;
+        return ok;
+    }
+
+
+    bool App::create_profiler()
+    {
+        if (!settings.profile) return true;
+
+        profiler = GpuProfiler(device, command_pool, readback_ring.get_slot_count());
+        if (!profiler) ok = false;
+        return ok;
+    }
+
+
+    void App::load_tuning()
+    {
+        const vk::PhysicalDeviceProperties properties = device.get_physical_device().getProperties();
+
+        DispatchTuning loaded;
+        if (!TuningDatabase::load(std::string{ tuning_filename }, properties, loaded))
         {
-            Logger::error("Failed to create uniform buffer");
-            ok = false;
-            return false;
+            Logger::trace("No dispatch tuning for {} in {}, using the defaults", properties.deviceName.data(),
+                          tuning_filename);
+            return;
         }
 
-        if (!uniform_buffer.bind())
+        if (!loaded.fits(properties.limits))
         {
-            Logger::error("Failed to bind uniform buffer");
-            ok = false;
+            Logger::warn("Dispatch tuning for {} exceeds its workgroup limits, using the defaults",
+                         properties.deviceName.data());
+            return;
         }
 
-        return ok;
+        tuning = loaded;
+        Logger::info("Loaded dispatch tuning for {}: {} triangles per invocation in workgroups of {}, voxel workgroups of {}x{}x{}",
+                     properties.deviceName.data(), tuning.triangles_per_invocation, tuning.triangle_workgroup_size,
+                     tuning.voxel_workgroup_size.x, tuning.voxel_workgroup_size.y, tuning.voxel_workgroup_size.z);
     }
 
 
-    bool App::dispatch()
+    void App::select_lane(const uint32_t index)
+    {
+        for (ComputeShader* shader : { &setup_shader, &triangle_shader, &voxel_shader, &expand_shader,
+                                       &solid_flip_shader, &solid_resolve_shader })
+            shader->select_descriptor_set(index);
+    }
+
+    bool App::write_tile_inputs(const uint32_t slot, const VoxelTile& tile)
     {
-        if (command_pool.get_command_buffer().begin(vk::CommandBufferBeginInfo{}) != vk::Result::eSuccess)
+        // Setups are in whole-grid units, so later tiles dispatch no workgroups for them
+        const VoxelGrid  grid{ { width, height, depth }, scale };
+        const uint32_t   triangle_count = index_count / 3;
+        const TileInputs inputs
         {
-            Logger::error("Failed to begin command buffer");
-            ok = false;
-            return false;
+            { index_count, grid.voxel_scale(), grid.voxel_offset(), tile.first },
+            { tile.first == 0 ? (triangle_count + linear_workgroup_size - 1) / linear_workgroup_size : 0u, 1, 1 }
+        };
+
+        return tile_input_buffer.copy_data(&inputs, sizeof(TileInputs), slot * sizeof(TileInputs));
+    }
+
+    bool App::write_mesh_dispatches()
+    {
+        // The same counts ComputeShader::dispatch would derive from the invocations
+        const uint32_t triangle_count = index_count / 3;
+        const uint32_t invocations    = (triangle_count + tuning.triangles_per_invocation - 1) /
+                                        tuning.triangles_per_invocation;
+
+        const MeshDispatches dispatches
+        {
+            { (triangle_count + linear_workgroup_size - 1) / linear_workgroup_size, 1, 1 },
+            { (invocations + tuning.triangle_workgroup_size - 1) / tuning.triangle_workgroup_size, 1, 1 }
+        };
+
+        return dispatch_buffer.copy_data(&dispatches, sizeof(dispatches));
+    }
+
+    void App::bind_lane_resources(const uint32_t index)
+    {
+        const Lane& lane = lanes[index];
+        select_lane(index);
+
+        for (const ComputeShader* shader : { &setup_shader, &triangle_shader, &voxel_shader })
+        {
+            shader->update_storage_image(0, lane.occupancy.get_image_view(), vk::ImageLayout::eGeneral);
+            shader->update_uniform_buffer(3, lane.uniform_buffer.get_buffer());
+        }
+
+        if (settings.solid)
+        {
+            for (const ComputeShader* shader : { &solid_flip_shader, &solid_resolve_shader })
+            {
+                shader->update_storage_image(0, lane.occupancy.get_image_view(), vk::ImageLayout::eGeneral);
+                shader->update_uniform_buffer(3, lane.uniform_buffer.get_buffer());
+                shader->update_storage_image(5, lane.solid.get_image_view(), vk::ImageLayout::eGeneral);
+                shader->update_storage_buffer(6, lane.row_parity_buffer.get_buffer());
+            }
+        }
+
+        if (has_rgba_output())
+        {
+            expand_shader.update_storage_image(0, lane.occupancy.get_image_view(), vk::ImageLayout::eGeneral);
+            expand_shader.update_storage_image(1, lane.image.get_image_view(), vk::ImageLayout::eGeneral);
+        }
+    }
+
+    void App::bind_mesh_resources(const uint32_t index)
+    {
+        select_lane(index);
+
+        // Storage buffers only, see ComputeShader::has_update_after_bind
+        for (const ComputeShader* shader : { &setup_shader, &triangle_shader, &voxel_shader, &solid_flip_shader,
+                                             &solid_resolve_shader })
+        {
+            if (!*shader) continue;
+
+            shader->update_storage_buffer(1, vertex_buffer.get_buffer());
+            shader->update_storage_buffer(2, index_buffer.get_buffer());
+            shader->update_storage_buffer(4, triangle_setup_buffer.get_buffer());
+        }
+
+        voxel_shader.update_storage_buffer(5, brick_offset_buffer.get_buffer());
+        voxel_shader.update_storage_buffer(6, brick_triangle_buffer.get_buffer());
+        voxel_shader.update_storage_buffer(7, bvh_stats_buffer.get_buffer());
+        voxel_shader.update_storage_buffer(8, bvh_node_buffer.get_buffer());
+        voxel_shader.update_storage_buffer(9, bvh_triangle_buffer.get_buffer());
+    }
+
+
+    ComputeShader::Variant App::make_variant(const glm::uvec3& workgroup_size, const VoxelTile& tile,
+                                             const VoxelizationMode mode) const
+    {
+        // Candidate source of voxelize_voxels.comp, ignored by the other shaders
+        const uint32_t candidates = mode == VoxelizationMode::Binned ? 1u
+                                  : mode == VoxelizationMode::Bvh    ? 2u
+                                                                     : 0u;
+
+        return { workgroup_size, { width, height, tile.depth, candidates } };
+    }
+
+    bool App::record_tile(const vk::CommandBuffer& command_buffer, const VoxelizationMode mode, const VoxelTile& tile,
+                          const Lane& lane, const uint32_t slot)
+    {
+        profiler.begin_zone(command_buffer, "setup");
+        if (!record_tile_setup(command_buffer, tile, lane, slot)) return false;
+        profiler.end_zone(command_buffer);
+
+        profiler.begin_zone(command_buffer, "voxelize");
+        if (!record_surface(command_buffer, mode, tile)) return false;
+        profiler.end_zone(command_buffer);
+
+        if (settings.solid)
+        {
+            profiler.begin_zone(command_buffer, "solid fill");
+            if (!record_solid_fill(command_buffer, tile, lane)) return false;
+            profiler.end_zone(command_buffer);
         }
 
+        // Occupancy is read by the expansion to the atlas and then copied out
         vk::ImageMemoryBarrier barrier
+        {
+            vk::AccessFlagBits::eShaderWrite,
+            {},
+            vk::ImageLayout::eGeneral,
+            vk::ImageLayout::eGeneral,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            lane.occupancy.get_image(),
+            { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }
+        };
+
+        vk::ImageMemoryBarrier image_barrier
         {
             {},
             vk::AccessFlagBits::eShaderWrite,
@@ -212,31 +1218,74 @@ namespace boza
             vk::ImageLayout::eGeneral,
             VK_QUEUE_FAMILY_IGNORED,
             VK_QUEUE_FAMILY_IGNORED,
-            image.get_image(),
+            lane.image.get_image(),
             { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }
         };
 
-        command_pool.get_command_buffer().pipelineBarrier(
-            vk::PipelineStageFlagBits::eTopOfPipe,
+        if (has_rgba_output())
+        {
+            profiler.begin_zone(command_buffer, "expand");
+            barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+
+            const std::array barriers{ barrier, image_barrier };
+            command_buffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eComputeShader,
+                vk::PipelineStageFlagBits::eComputeShader,
+                {},
+                0, nullptr,
+                0, nullptr,
+                static_cast<uint32_t>(barriers.size()), barriers.data()
+            );
+
+            const ComputeShader::Variant expand_variant = make_variant(glm::uvec3{ TriangleBinner::brick_size }, tile);
+            if (!expand_shader.dispatch(command_buffer, expand_variant, { width, height, tile.depth })) return false;
+            profiler.end_zone(command_buffer);
+        }
+
+        // The occupancy grid is always made readable, --verify reads it back next to the atlas
+        for (vk::ImageMemoryBarrier* readback : { &barrier, &image_barrier })
+        {
+            readback->oldLayout     = vk::ImageLayout::eGeneral;
+            readback->newLayout     = vk::ImageLayout::eTransferSrcOptimal;
+            readback->srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            readback->dstAccessMask = vk::AccessFlagBits::eTransferRead;
+        }
+
+        profiler.begin_zone(command_buffer, "layout transition");
+        const std::array readback_barriers{ barrier, image_barrier };
+        command_buffer.pipelineBarrier(
             vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eTransfer,
             {},
             0, nullptr,
             0, nullptr,
-            1, &barrier
+            has_rgba_output() ? 2u : 1u, readback_barriers.data()
         );
+        profiler.end_zone(command_buffer);
 
-        compute_shader.dispatch(command_pool.get_command_buffer(),
-                                static_cast<uint32_t>(std::ceil(width / 8.0)),
-                                static_cast<uint32_t>(std::ceil(height / 8.0)),
-                                static_cast<uint32_t>(std::ceil(depth / 8.0)));
+        return true;
+    }
 
-        barrier.oldLayout     = vk::ImageLayout::eGeneral;
-        barrier.newLayout     = vk::ImageLayout::eTransferSrcOptimal;
-        barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
-        barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
 
-        command_pool.get_command_buffer().pipelineBarrier(
-            vk::PipelineStageFlagBits::eComputeShader,
+    bool App::record_tile_setup(const vk::CommandBuffer& command_buffer, const VoxelTile& tile, const Lane& lane,
+                                const uint32_t slot)
+    {
+        // Voxels are only ever or-ed into the occupancy grid, so it starts out empty. The previous
+        // tile may still be voxelizing into it or copying it out
+        vk::ImageMemoryBarrier barrier
+        {
+            {},
+            vk::AccessFlagBits::eTransferWrite,
+            vk::ImageLayout::eUndefined,
+            vk::ImageLayout::eGeneral,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            lane.occupancy.get_image(),
+            { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }
+        };
+
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
             vk::PipelineStageFlagBits::eTransfer,
             {},
             0, nullptr,
@@ -244,71 +1293,245 @@ namespace boza
             1, &barrier
         );
 
-        if (command_pool.get_command_buffer().end() != vk::Result::eSuccess)
+        command_buffer.clearColorImage(lane.occupancy.get_image(), vk::ImageLayout::eGeneral,
+                                       vk::ClearColorValue{ std::array<uint32_t, 4>{} },
+                                       barrier.subresourceRange);
+
+        // Copied from the slot's inputs when the commands run, so they can be submitted again for
+        // another tile; the lane's previous tile may still be reading its uniform buffer
+        const vk::DeviceSize inputs_offset = slot * sizeof(TileInputs);
+        const vk::BufferCopy params_copy{ inputs_offset + offsetof(TileInputs, params), 0, sizeof(Params) };
+        command_buffer.copyBuffer(tile_input_buffer.get_buffer(), lane.uniform_buffer.get_buffer(), 1, &params_copy);
+
+        barrier.oldLayout     = vk::ImageLayout::eGeneral;
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+
+        const vk::MemoryBarrier params_barrier
         {
-            Logger::error("Failed to end command buffer");
-            ok = false;
+            vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eUniformRead
+        };
+
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eComputeShader,
+            {},
+            1, &params_barrier,
+            0, nullptr,
+            1, &barrier
+        );
+
+        // Setups are in whole-grid units and stay valid for every tile, only the first computes them
+        if (!setup_shader.dispatch_indirect(command_buffer, make_variant({ linear_workgroup_size, 1, 1 }, tile),
+                                            tile_input_buffer.get_buffer(), inputs_offset + offsetof(TileInputs, setup)))
             return false;
-        }
 
-        const vk::SubmitInfo submit_info
+        const vk::MemoryBarrier setup_barrier
         {
+            vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eShaderRead
+        };
+
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eComputeShader,
             {},
+            1, &setup_barrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        return true;
+    }
+
+    bool App::record_surface(const vk::CommandBuffer& command_buffer, const VoxelizationMode mode,
+                             const VoxelTile& tile)
+    {
+        if (mode == VoxelizationMode::PerTriangle)
+        {
+            ComputeShader::Variant variant = make_variant({ tuning.triangle_workgroup_size, 1, 1 }, tile);
+            variant.constants.push_back(tuning.triangles_per_invocation);
+
+            return triangle_shader.dispatch_indirect(command_buffer, variant, dispatch_buffer.get_buffer(),
+                                                     offsetof(MeshDispatches, triangles));
+        }
+
+        // With binned candidates a workgroup has to cover exactly one brick of TriangleBinner
+        const glm::uvec3 workgroup_size = mode == VoxelizationMode::Binned ? glm::uvec3{ TriangleBinner::brick_size }
+                                                                          : tuning.voxel_workgroup_size;
+        return voxel_shader.dispatch(command_buffer, make_variant(workgroup_size, tile, mode),
+                                     { width, height, tile.depth });
+    }
+
+    bool App::record_solid_fill(const vk::CommandBuffer& command_buffer, const VoxelTile& tile, const Lane& lane)
+    {
+        vk::ImageMemoryBarrier solid_barrier
+        {
             {},
-            {},
-            1, &command_pool.get_command_buffer()
+            vk::AccessFlagBits::eTransferWrite,
+            vk::ImageLayout::eUndefined,
+            vk::ImageLayout::eGeneral,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            lane.solid.get_image(),
+            { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 }
         };
 
-        if (device.get_compute_queue().submit(submit_info, {}) != vk::Result::eSuccess)
+        // The previous tile's resolve may still be reading both
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eTransfer,
+            {},
+            0, nullptr,
+            0, nullptr,
+            1, &solid_barrier
+        );
+
+        command_buffer.clearColorImage(lane.solid.get_image(), vk::ImageLayout::eGeneral,
+                                       vk::ClearColorValue{ std::array<uint32_t, 4>{} },
+                                       solid_barrier.subresourceRange);
+        command_buffer.fillBuffer(lane.row_parity_buffer.get_buffer(), 0, VK_WHOLE_SIZE, 0);
+
+        // The clears have to land before the flips, and the surface pass before the resolve
+        // reads and extends the occupancy grid
+        const vk::MemoryBarrier flip_barrier
         {
-            Logger::error("Failed to submit command buffer");
-            ok = false;
+            vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+        };
+
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eComputeShader,
+            {},
+            1, &flip_barrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        if (!solid_flip_shader.dispatch_indirect(command_buffer, make_variant({ linear_workgroup_size, 1, 1 }, tile),
+                                                 dispatch_buffer.get_buffer(), offsetof(MeshDispatches, flip)))
             return false;
-        }
 
-        if (device.get_compute_queue().waitIdle() != vk::Result::eSuccess)
+        const vk::MemoryBarrier resolve_barrier
         {
-            Logger::error("Failed to wait for compute queue to become idle");
-            ok = false;
+            vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+        };
+
+        command_buffer.pipelineBarrier(
+            vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eComputeShader,
+            {},
+            1, &resolve_barrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        const uint32_t word_count = (width + 31) / 32 * height * tile.depth;
+        return solid_resolve_shader.dispatch(command_buffer, make_variant({ linear_workgroup_size, 1, 1 }, tile),
+                                             { word_count, 1, 1 });
+    }
+
+    void App::report_pipelines()
+    {
+        // Variants are compiled as the jobs ask for them, so this is only known at the end
+        const std::array<std::pair<std::string_view, const ComputeShader*>, 6> shaders
+        {{
+            { "triangle_setup.comp", &setup_shader },
+            { "voxelize_triangles.comp", &triangle_shader },
+            { voxel_shader_name(), &voxel_shader },
+            { "expand_occupancy.comp", &expand_shader },
+            { "solid_flip.comp", &solid_flip_shader },
+            { "solid_resolve.comp", &solid_resolve_shader }
+        }};
+
+        for (const auto& [shader_name, shader] : shaders)
+            pipeline_cache.record(shader_name, *shader);
+
+        pipeline_cache.report();
+    }
+
+    void App::report_bvh_traversal() const
+    {
+        std::array<uint32_t, 4> stats{};
+        if (!bvh_stats_buffer.read_data(stats.data(), sizeof(stats)))
+        {
+            Logger::warn("Failed to read BVH traversal stats");
+            return;
         }
 
-        return ok;
+        const uint64_t nodes_visited  = static_cast<uint64_t>(stats[1]) << 32 | stats[0];
+        const uint64_t triangle_tests = static_cast<uint64_t>(stats[3]) << 32 | stats[2];
+        const double   voxels         = static_cast<double>(width) * height * depth;
+
+        Logger::info("BVH traversal: {:.2f} nodes and {:.2f} triangle tests per voxel ({} triangles without the BVH)",
+                     static_cast<double>(nodes_visited) / voxels,
+                     static_cast<double>(triangle_tests) / voxels,
+                     index_count / 3);
     }
 
 
-    void App::save_image(const std::span<uint8_t>& data, const std::string_view& filename) const
+    void App::write_profile(const Job& job, const int64_t start_ns)
+    {
+        // Both are on the steady clock, so the CPU zones of the job line up with the GPU phases
+        std::vector<TraceEvent> events = CpuProfiler::collect(start_ns);
+        events.insert(events.end(), profiler.get_events().begin(), profiler.get_events().end());
+        if (events.empty()) return;
+
+        if (TraceWriter::write_chrome_trace(job.output + ".trace.json", events) &&
+            TraceWriter::write_summary(job.output + ".profile.json", job.input, events))
+            Logger::info("Wrote the profile of {} to {}.trace.json and {}.profile.json", job.input, job.output,
+                         job.output);
+
+        profiler.clear();
+    }
+
+    bool App::save_image(const std::span<const uint8_t> data, const std::string& filename) const
     {
-        uint32_t grid_side     = static_cast<uint32_t>(std::ceil(std::sqrt(height)));
-        uint32_t output_size_x = width * grid_side;
-        uint32_t output_size_y = depth * grid_side;
+        PROFILE_ZONE("save image");
 
-        std::vector<uint8_t> image_data_reordered(output_size_x * output_size_y * 4, 0);
+        const uint32_t grid_side     = static_cast<uint32_t>(std::ceil(std::sqrt(height)));
+        const uint32_t output_size_x = width * grid_side;
+        const uint32_t output_size_y = depth * grid_side;
 
-        for (uint32_t slice = 0; slice < height; ++slice)
+        const size_t row_size       = static_cast<size_t>(width) * 4;
+        const size_t atlas_row_size = static_cast<size_t>(output_size_x) * 4;
+
+        std::vector<uint8_t> atlas(atlas_row_size * output_size_y, 0);
+
+        // Slice y is the cell at (y % grid_side, y / grid_side) with z going down, stored bottom row
+        // first as it always has been. A row of a slice is a row of its cell, so whole rows are
+        // copied, and the slices are spread over the threads
+        const uint32_t thread_count = std::clamp(std::thread::hardware_concurrency(), 1u, height);
         {
-            uint32_t grid_x = (slice % grid_side) * width;
-            uint32_t grid_y = (slice / grid_side) * depth;
+            PROFILE_ZONE("atlas reorder");
+            PROFILE_BYTES(data.size());
 
-            for (uint32_t z = 0; z < depth; ++z)
+            std::vector<std::jthread> workers;
+            workers.reserve(thread_count);
+            for (uint32_t thread = 0; thread < thread_count; ++thread)
             {
-                for (uint32_t x = 0; x < width; ++x)
+                workers.emplace_back([&, thread]
                 {
-                    for (uint32_t c = 0; c < 4; ++c)
+                    for (uint32_t slice = thread; slice < height; slice += thread_count)
                     {
-                        const uint32_t src_idx = ((z * height + slice) * width + x) * 4 + c;
-                        const uint32_t dst_idx = ((grid_y + z) * output_size_x + (grid_x + x)) * 4 + c;
-                        image_data_reordered[dst_idx] = data[src_idx];
+                        const uint32_t grid_x = (slice % grid_side) * width;
+                        const uint32_t grid_y = (slice / grid_side) * depth;
+
+                        for (uint32_t z = 0; z < depth; ++z)
+                        {
+                            const size_t src = (static_cast<size_t>(z) * height + slice) * row_size;
+                            const size_t dst = (output_size_y - 1 - (grid_y + z)) * atlas_row_size + grid_x * 4;
+                            std::memcpy(atlas.data() + dst, data.data() + src, row_size);
+                        }
                     }
-                }
+                });
             }
         }
 
-        stbi_flip_vertically_on_write(true);
-        stbi_write_png(filename.data(),
-                       static_cast<int>(output_size_x),
-                       static_cast<int>(output_size_y),
-                       4,
-                       image_data_reordered.data(),
-                       static_cast<int>(output_size_x) * 4);
+        return PngWriter::write_rgba8(filename, output_size_x, output_size_y, atlas,
+                                      settings.png_store ? PngCompression::Store : PngCompression::Deflate);
     }
 }
@@ -1,24 +1,81 @@
 #pragma once
 #include "Buffer.hpp"
+#include "Autotuner.hpp"
+#include "Bvh.hpp"
 #include "CommandPool.hpp"
 #include "ComputeShader.hpp"
+#include "CpuVoxelizer.hpp"
 #include "Instance.hpp"
 #include "Device.hpp"
+#include "GpuProfiler.hpp"
 #include "Image3D.hpp"
+#include "PipelineCache.hpp"
+#include "ReadbackRing.hpp"
+#include "TriangleBinner.hpp"
 #include "TriangleLoader.hpp"
+#include "TriangleSetup.hpp"
+#include "TuningDatabase.hpp"
 
 namespace boza
 {
     class App
     {
     public:
+        // Grid and tile extent are specialization constants, see make_variant
         struct Params
         {
             uint32_t index_count;
-            float    scale;
+            float    voxel_scale;
+            float    voxel_offset;
+            uint32_t tile_origin_z;
         };
 
-        explicit App(const std::string_view& name);
+        enum class VoxelizationMode
+        {
+            PerVoxel,
+            PerTriangle,
+            Binned,
+            Bvh
+        };
+
+        enum class OutputFormat
+        {
+            Rgba8,     // PNG slice atlas, expanded from the occupancy grid on the GPU
+            Occupancy, // bit-packed .vox volume, one bit per voxel
+            RawRgba8   // raw .vox volume, expanded like the atlas but streamed in tiles like occupancy
+        };
+
+        enum class Backend
+        {
+            Auto,   // Vulkan, or the CPU when no usable device is found
+            Vulkan,
+            Cpu
+        };
+
+        struct Settings
+        {
+            OutputFormat output_format;
+            bool         solid;   // fill the interior of the surface shell by parity along x
+            Backend      backend;
+            bool         verify;  // compare the Vulkan result against the CPU voxelizer
+            glm::uvec3   extent;
+            uint32_t     tile_depth; // layers voxelized at once, 0 for the whole grid
+            float        scale;      // fraction of the grid height the model spans around its origin
+            bool         mesh_cache; // load meshes from and save them to FILE.obj.bzmesh
+            bool         png_store;  // leave the PNG atlas uncompressed, for speed
+            bool         profile;    // write the GPU phases and CPU zones of every job next to its output
+        };
+
+        // One model voxelized into one output file, with its own grid
+        struct Job
+        {
+            std::string input;
+            std::string output;
+            glm::uvec3  extent;
+            float       scale;
+        };
+
+        App(const std::string_view& name, const Settings& settings);
         ~App();
 
         App(const App&)            = delete;
@@ -26,39 +83,213 @@ namespace boza
         App(App&&)                 = delete;
         App& operator=(App&&)      = delete;
 
-        void run();
+        // Voxelizes model.obj into output.png or output.vox
+        bool run(VoxelizationMode mode = VoxelizationMode::PerTriangle);
+
+        // Voxelizes every job with the same device and pipelines, loading the next meshes on
+        // worker threads meanwhile. Failed jobs are logged and skipped; false if any failed
+        bool run_batch(std::span<const Job> jobs, VoxelizationMode mode = VoxelizationMode::PerTriangle);
+
+        // Times the candidate dispatch shapes on a synthetic mesh and stores the fastest for this
+        // GPU and driver, where later runs pick them up at startup
+        bool autotune();
 
         operator bool () const noexcept { return ok; }
 
     private:
+        // What a tile writes on the GPU. Tiles on different lanes share nothing they write, so the
+        // lanes run on different compute queues, or compute on one while another is copied out
+        struct Lane
+        {
+            Image3D  occupancy{ nullptr };
+            Image3D  solid{ nullptr };
+            Image3D  image{ nullptr };
+            Buffer   row_parity_buffer{ nullptr };
+            Buffer   uniform_buffer{ nullptr };
+            uint32_t queue{ 0 }; // compute queue of the device's scheduler
+        };
+
+        // What the commands recorded for a tile depend on besides the buffers the descriptor sets
+        // point at, the tile inputs and the mesh dispatches. A readback slot that recorded a tile
+        // of the same shape submits its command buffers again instead of recording new ones
+        struct TileRecording
+        {
+            VoxelizationMode mode;
+            uint32_t         lane;
+            uint32_t         depth;
+
+            bool operator==(const TileRecording&) const = default;
+        };
+
+        // Written by the host for every tile, at the readback slot it uses
+        struct TileInputs
+        {
+            Params                      params; // copied into the lane's uniform buffer
+            vk::DispatchIndirectCommand setup;  // the triangle setups, on the first tile only
+        };
+
+        // Workgroup counts of the dispatches over the triangles, read by the GPU so a recorded tile
+        // stays valid for the next mesh
+        struct MeshDispatches
+        {
+            vk::DispatchIndirectCommand flip;      // solid_flip.comp, linear_workgroup_size
+            vk::DispatchIndirectCommand triangles; // voxelize_triangles.comp, in the tuned shape
+        };
+
         [[nodiscard]] bool initialize_vulkan_objects();
-        [[nodiscard]] bool create_compute_shader(const std::string_view& filename);
-        [[nodiscard]] bool create_image3d();
+        [[nodiscard]] bool create_gpu_resources();
+        [[nodiscard]] bool create_job_resources();
+        [[nodiscard]] bool configure(const Job& job);
+        [[nodiscard]] bool voxelize(const Job& job, VoxelizationMode mode);
+        [[nodiscard]] bool create_compute_shader(
+            ComputeShader&                                        shader,
+            const std::string_view&                               filename,
+            std::span<const ComputeShader::DescriptorBindingInfo> extra_bindings = {});
+        [[nodiscard]] bool create_expand_shader();
+
+        // voxelize_voxels.comp, or its atomic variant where subgroup arithmetic is missing
+        [[nodiscard]] std::string_view voxel_shader_name() const;
+        [[nodiscard]] bool create_solid_shaders();
+        [[nodiscard]] bool create_lanes(uint32_t lane_count);
+        [[nodiscard]] bool create_images(Lane& lane);
+
+        // Hands the parser one mapped staging buffer holding the vertices followed by the indices
+        [[nodiscard]] MeshSink staging_sink() const;
+        [[nodiscard]] static const Buffer* staging_of(const MeshData& mesh_data);
 
         [[nodiscard]] bool create_vertex_buffer(const MeshData& mesh_data);
         [[nodiscard]] bool create_index_buffer(const MeshData& mesh_data);
-        [[nodiscard]] bool create_uniform_buffer();
-        [[nodiscard]] bool dispatch();
+        [[nodiscard]] bool create_triangle_setup_buffer();
+        [[nodiscard]] bool create_bin_buffers(const MeshData& mesh_data);
+        [[nodiscard]] bool create_bvh_buffers(const MeshData& mesh_data);
+        [[nodiscard]] bool create_row_parity_buffer(Lane& lane);
+        // Device-local unless the host reads or rewrites the buffer later
+        [[nodiscard]] bool create_storage_buffer(Buffer& buffer, const void* data, vk::DeviceSize size,
+                                                 const std::string_view& buffer_name, bool host_access = false);
+        [[nodiscard]] bool create_storage_buffer(Buffer& buffer, const Buffer& staging, vk::DeviceSize offset,
+                                                 vk::DeviceSize size, const std::string_view& buffer_name);
+        [[nodiscard]] bool create_uniform_buffer(Lane& lane);
+        [[nodiscard]] bool create_indirect_buffers();
+        [[nodiscard]] bool create_readback_ring();
+        [[nodiscard]] bool create_profiler();
+        void load_tuning();
+
+        // Receives each tile in order: its occupancy words and, for the PNG atlas, its rgba8 texels
+        using TileConsumer = std::function<bool(const VoxelTile&, std::span<const uint32_t>, std::span<const uint8_t>)>;
+
+        // Keeps up to readback_slots tiles queued while the host consumes the oldest finished one
+        [[nodiscard]] bool voxelize_pipelined(VoxelizationMode mode, const TileConsumer& consume);
+
+        // Specialization of a shader for the current grid, the extent of the tile and the candidate source of mode
+        [[nodiscard]] ComputeShader::Variant make_variant(const glm::uvec3& workgroup_size, const VoxelTile& tile,
+                                                          VoxelizationMode mode = VoxelizationMode::PerVoxel) const;
+
+        // Points the shaders' dispatches at the descriptor sets of lane `index`
+        void select_lane(uint32_t index);
+
+        // Inputs of `tile` for the submission using readback slot `slot`, which must have finished
+        [[nodiscard]] bool write_tile_inputs(uint32_t slot, const VoxelTile& tile);
+
+        // Workgroup counts for the current mesh and tuning, while no tile is in flight
+        [[nodiscard]] bool write_mesh_dispatches();
+
+        [[nodiscard]] bool record_tile(const vk::CommandBuffer& command_buffer, VoxelizationMode mode, const VoxelTile& tile,
+                                       const Lane& lane, uint32_t slot);
+        [[nodiscard]] bool record_tile_setup(const vk::CommandBuffer& command_buffer, const VoxelTile& tile, const Lane& lane,
+                                             uint32_t slot);
+        [[nodiscard]] bool record_surface(const vk::CommandBuffer& command_buffer, VoxelizationMode mode,
+                                          const VoxelTile& tile);
+        [[nodiscard]] bool record_solid_fill(const vk::CommandBuffer& command_buffer, const VoxelTile& tile,
+                                             const Lane& lane);
+        // Lane resources are bound once per grid, the mesh buffers for every job
+        void bind_lane_resources(uint32_t index);
+        void bind_mesh_resources(uint32_t index);
+        void report_bvh_traversal() const;
+        void report_pipelines();
+
+        // FILE.trace.json and FILE.profile.json next to the output of the job, with the GPU phases and
+        // the CPU zones since start_ns
+        void write_profile(const Job& job, int64_t start_ns);
+
+        uint64_t count_mismatches(const VoxelTile& tile, std::span<const uint32_t> words, uint64_t& filled) const;
+
+        // Whether the occupancy grid is expanded into an RGBA8 image and read back with it
+        [[nodiscard]] bool has_rgba_output() const { return settings.output_format != OutputFormat::Occupancy; }
 
-        void save_image(const std::span<uint8_t>& data, const std::string_view& filename) const;
+        [[nodiscard]] bool save_image(std::span<const uint8_t> data, const std::string& filename) const;
 
-        const uint32_t width{ 128 };
-        const uint32_t height{ 64 };
-        const uint32_t depth{ 128 };
+        // Grid of the current job
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        uint32_t depth{ 0 };
+        float    scale{ 0.0f };
+        uint32_t tile_depth{ 0 };
+
+        static constexpr uint32_t readback_slots{ 3 }; // and at most as many lanes
+        static constexpr uint32_t max_readback_slots{ 2 * readback_slots - 1 }; // rounded up to a multiple of the lanes
+        static constexpr uint32_t linear_workgroup_size{ 64 }; // triangle setup and solid fill, not tuned
+
+        static constexpr std::string_view tuning_filename{ "dispatch_tuning.txt" };
+        static constexpr uint32_t         autotune_repetitions{ 5 };
+
+        DispatchTuning tuning;
+
+        // Lanes the device can keep busy at once, one per compute queue and one more to compute
+        // while the transfer queue copies
+        uint32_t max_lanes{ 1 };
+
+        // Grid the lanes and readback ring were created for
+        glm::uvec3 resource_extent{ 0 };
+        uint32_t   resource_tile_depth{ 0 };
 
         uint32_t index_count{ 0 };
+        bool     use_gpu{ false };
+
+        Settings settings;
 
         std::string name;
 
         Instance      instance{ nullptr };
         Device        device{ nullptr };
+        PipelineCache pipeline_cache{ nullptr };
         CommandPool   command_pool{ nullptr };
-        ComputeShader compute_shader{ nullptr };
-        Image3D       image{ nullptr };
+        CommandPool   transfer_command_pool{ nullptr }; // only when the device has a transfer queue
+        ComputeShader setup_shader{ nullptr };
+        ComputeShader triangle_shader{ nullptr };
+        ComputeShader voxel_shader{ nullptr };
+        ComputeShader expand_shader{ nullptr };
+        ComputeShader solid_flip_shader{ nullptr };
+        ComputeShader solid_resolve_shader{ nullptr };
+
+        std::vector<Lane> lanes;
+
+        // What the host writes for the recorded tiles to read: TileInputs for every readback slot
+        // and the MeshDispatches
+        Buffer tile_input_buffer{ nullptr };
+        Buffer dispatch_buffer{ nullptr };
+
+        // What each readback slot last recorded, if it can be submitted again
+        std::vector<std::optional<TileRecording>> recordings;
 
         Buffer vertex_buffer{ nullptr };
         Buffer index_buffer{ nullptr };
-        Buffer uniform_buffer{ nullptr };
+        Buffer triangle_setup_buffer{ nullptr };
+
+        Buffer brick_offset_buffer{ nullptr };
+        Buffer brick_triangle_buffer{ nullptr };
+
+        Buffer bvh_node_buffer{ nullptr };
+        Buffer bvh_triangle_buffer{ nullptr };
+        Buffer bvh_stats_buffer{ nullptr };
+
+        // May hold the staging buffer it was parsed into, which has to go before the device
+        MeshData mesh_data;
+
+        // Frames match the readback slots, one per tile in flight
+        GpuProfiler profiler{ nullptr };
+
+        // Last, so pending copies finish before anything they use is destroyed
+        ReadbackRing readback_ring{ nullptr };
 
         bool ok = false;
     };
@@ -0,0 +1,214 @@
+#include "Autotuner.hpp"
+
+#include "Logger.hpp"
+
+namespace boza
+{
+    Autotuner::Autotuner(const Device& device, CommandPool& command_pool, const uint32_t repetitions)
+        : repetitions{ std::max(repetitions, 1u) }, device{ std::cref(device) }, ok{ true }
+    {
+        if (!create_query_pool()) return;
+
+        std::vector<vk::UniqueCommandBuffer> command_buffers = command_pool.allocate_command_buffers(device, 1);
+        if (command_buffers.empty())
+        {
+            ok = false;
+            return;
+        }
+
+        command_buffer = std::move(command_buffers[0]);
+    }
+
+
+    Autotuner::Autotuner(Autotuner&& other) noexcept
+    {
+        command_buffer   = std::move(other.command_buffer);
+        query_pool       = std::move(other.query_pool);
+        repetitions      = std::exchange(other.repetitions, 0);
+        timestamp_period = std::exchange(other.timestamp_period, 0.0f);
+        ok               = std::exchange(other.ok, false);
+
+        if (other.device) device = std::cref(other.device->get());
+        other.device = std::nullopt;
+    }
+
+    Autotuner& Autotuner::operator=(Autotuner&& other) noexcept
+    {
+        if (this != &other)
+        {
+            command_buffer   = std::move(other.command_buffer);
+            query_pool       = std::move(other.query_pool);
+                repetitions      = std::exchange(other.repetitions, 0);
+            timestamp_period = std::exchange(other.timestamp_period, 0.0f);
+            ok               = std::exchange(other.ok, false);
+
+            if (other.device) device = std::cref(other.device->get());
+            other.device = std::nullopt;
+        }
+
+        return *this;
+    }
+
+
+    bool Autotuner::time(const Recorder& prepare, const Recorder& measure, double& milliseconds)
+    {
+        const vk::CommandBuffer& cmd = *command_buffer;
+        if (cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit }) != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to begin autotuner command buffer");
+            return false;
+        }
+
+        cmd.resetQueryPool(*query_pool, 0, repetitions * 2);
+
+        for (uint32_t i = 0; i < repetitions; ++i)
+        {
+            // Bottom of pipe on both ends: the start waits for prepare, the end for measure
+            bool recorded = prepare(cmd);
+            cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, i * 2);
+            recorded = recorded && measure(cmd);
+            cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, i * 2 + 1);
+
+            if (!recorded)
+            {
+                // Begun again with an implicit reset next time
+                if (cmd.end() != vk::Result::eSuccess) Logger::warn("Failed to end a cancelled autotuner command buffer");
+                return false;
+            }
+        }
+
+        if (cmd.end() != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to end autotuner command buffer");
+            return false;
+        }
+
+        QueueScheduler& scheduler = device->get().get_scheduler();
+        QueueTicket     ticket;
+        if (!scheduler.submit(0, { &cmd, 1 }, {}, ticket))
+        {
+            Logger::error("Failed to submit autotuner command buffer");
+            return false;
+        }
+
+        if (!scheduler.wait(ticket))
+        {
+            Logger::error("Failed to wait for autotuner command buffer");
+            return false;
+        }
+
+        std::vector<uint64_t> ticks(repetitions * 2);
+        if (device->get().get().getQueryPoolResults(*query_pool, 0, repetitions * 2,
+                                                    ticks.size() * sizeof(uint64_t), ticks.data(), sizeof(uint64_t),
+                                                    vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait)
+            != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to read autotuner timestamps");
+            return false;
+        }
+
+        uint64_t fastest = UINT64_MAX;
+        for (uint32_t i = 0; i < repetitions; ++i)
+            fastest = std::min(fastest, ticks[i * 2 + 1] - ticks[i * 2]);
+
+        milliseconds = static_cast<double>(fastest) * timestamp_period / 1e6;
+        return true;
+    }
+
+
+    std::vector<uint32_t> Autotuner::triangle_workgroup_sizes(const vk::PhysicalDeviceLimits& limits)
+    {
+        std::vector<uint32_t> sizes;
+        for (const uint32_t size : { 32u, 64u, 128u, 256u, 512u })
+        {
+            if (DispatchTuning{ size, 1, glm::uvec3{ 1 } }.fits(limits)) sizes.push_back(size);
+        }
+
+        return sizes;
+    }
+
+    std::vector<uint32_t> Autotuner::triangles_per_invocation_counts()
+    {
+        return { 1, 2, 4, 8 };
+    }
+
+    std::vector<glm::uvec3> Autotuner::voxel_workgroup_sizes(const vk::PhysicalDeviceLimits& limits)
+    {
+        // Wide along x keeps the occupancy atomics of a workgroup in few words, deep along z
+        // keeps its voxels in few BVH leaves
+        const std::array<glm::uvec3, 9> candidates
+        {{
+            { 4, 4, 4 }, { 8, 4, 4 }, { 8, 8, 4 }, { 8, 8, 8 }, { 16, 4, 4 },
+            { 16, 8, 4 }, { 32, 2, 2 }, { 32, 4, 2 }, { 32, 8, 1 }
+        }};
+
+        std::vector<glm::uvec3> sizes;
+        for (const glm::uvec3& size : candidates)
+        {
+            if (DispatchTuning{ 1, 1, size }.fits(limits)) sizes.push_back(size);
+        }
+
+        return sizes;
+    }
+
+    MeshData Autotuner::make_benchmark_mesh(const uint32_t segments)
+    {
+        const uint32_t rings = std::max(segments / 2, 2u);
+
+        std::vector<glm::vec4> vertices;
+        vertices.reserve(static_cast<size_t>(rings + 1) * segments);
+        for (uint32_t ring = 0; ring <= rings; ++ring)
+        {
+            const float polar = glm::pi<float>() * static_cast<float>(ring) / static_cast<float>(rings);
+            for (uint32_t segment = 0; segment < segments; ++segment)
+            {
+                const float azimuth = glm::two_pi<float>() * static_cast<float>(segment) / static_cast<float>(segments);
+                vertices.emplace_back(std::sin(polar) * std::cos(azimuth), std::cos(polar),
+                                      std::sin(polar) * std::sin(azimuth), 0.0f);
+            }
+        }
+
+        // Two triangles per quad; the ones at the poles are degenerate, like in many real meshes
+        std::vector<uint32_t> indices;
+        indices.reserve(static_cast<size_t>(rings) * segments * 6);
+        for (uint32_t ring = 0; ring < rings; ++ring)
+        {
+            for (uint32_t segment = 0; segment < segments; ++segment)
+            {
+                const uint32_t a = ring * segments + segment;
+                const uint32_t b = ring * segments + (segment + 1) % segments;
+                const uint32_t c = a + segments;
+                const uint32_t d = b + segments;
+                indices.insert(indices.end(), { a, c, b, b, c, d });
+            }
+        }
+
+        return { std::move(vertices), std::move(indices), glm::vec3{ -1.0f }, glm::vec3{ 1.0f } };
+    }
+
+
+    bool Autotuner::create_query_pool()
+    {
+        const auto families = device->get().get_physical_device().getQueueFamilyProperties();
+        if (families[device->get().get_compute_queue_family_index()].timestampValidBits == 0)
+        {
+            Logger::error("The compute queue has no timestamps, dispatches cannot be timed");
+            ok = false;
+            return false;
+        }
+
+        const vk::QueryPoolCreateInfo create_info{ {}, vk::QueryType::eTimestamp, repetitions * 2 };
+
+        auto [result, pool] = device->get().get().createQueryPoolUnique(create_info);
+        if (result != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to create timestamp query pool");
+            ok = false;
+            return false;
+        }
+
+        query_pool       = std::move(pool);
+        timestamp_period = device->get().get_physical_device().getProperties().limits.timestampPeriod;
+        return true;
+    }
+}
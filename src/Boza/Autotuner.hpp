@@ -0,0 +1,53 @@
+#pragma once
+#include "pch.hpp"
+#include "CommandPool.hpp"
+#include "Device.hpp"
+#include "TriangleLoader.hpp"
+#include "TuningDatabase.hpp"
+
+namespace boza
+{
+    // Times candidate dispatches with timestamp queries on the compute queue. Each measurement
+    // is repeated and the fastest run counts, which filters out clock ramp-up and other noise.
+    class Autotuner final
+    {
+    public:
+        // Records commands into the given command buffer, false if recording failed
+        using Recorder = std::function<bool(const vk::CommandBuffer&)>;
+
+        Autotuner(nullptr_t) {}
+        Autotuner(const Device& device, CommandPool& command_pool, uint32_t repetitions);
+
+        Autotuner(const Autotuner&)            = delete;
+        Autotuner& operator=(const Autotuner&) = delete;
+
+        Autotuner(Autotuner&& other) noexcept;
+        Autotuner& operator=(Autotuner&& other) noexcept;
+
+        operator bool () const { return ok; }
+
+        // Runs prepare, then measure between two timestamps, repetitions times in one submission.
+        // milliseconds is the fastest measure
+        [[nodiscard]] bool time(const Recorder& prepare, const Recorder& measure, double& milliseconds);
+
+        // Candidates within the device limits, the default DispatchTuning always among them
+        [[nodiscard]] static std::vector<uint32_t>   triangle_workgroup_sizes(const vk::PhysicalDeviceLimits& limits);
+        [[nodiscard]] static std::vector<uint32_t>   triangles_per_invocation_counts();
+        [[nodiscard]] static std::vector<glm::uvec3> voxel_workgroup_sizes(const vk::PhysicalDeviceLimits& limits);
+
+        // Unit sphere with enough triangles to keep the GPU busy for a while
+        [[nodiscard]] static MeshData make_benchmark_mesh(uint32_t segments);
+
+    private:
+        [[nodiscard]] bool create_query_pool();
+
+        vk::UniqueCommandBuffer command_buffer;
+        vk::UniqueQueryPool     query_pool;
+        uint32_t                repetitions{ 0 };
+        float                   timestamp_period{ 0.0f };
+
+        std::optional<std::reference_wrapper<const Device>> device{ std::nullopt };
+
+        bool ok = false;
+    };
+}
@@ -1,5 +1,6 @@
 #include "Buffer.hpp"
 
+#include "CpuProfiler.hpp"
 #include "Logger.hpp"
 
 namespace boza
@@ -8,16 +9,19 @@ namespace boza
         const Device&                 device,
         const vk::DeviceSize          size,
         const vk::BufferUsageFlags    usage,
-        const vk::MemoryPropertyFlags properties)
+        const vk::MemoryPropertyFlags properties,
+        const MemoryLifetime          lifetime)
         : device{ std::cref(device) }, ok{ true }
     {
+        // Concurrent when there is a transfer queue, which may copy from or into any buffer
+        const std::span<const uint32_t> families = device.get_queue_family_indices();
         const vk::BufferCreateInfo buffer_info
         {
             {},
             size,
             usage,
-            vk::SharingMode::eExclusive,
-            device.get_compute_queue_family_index()
+            families.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+            static_cast<uint32_t>(families.size()), families.data()
         };
 
         auto [buf_result, _buffer] = device.get().createBufferUnique(buffer_info);
@@ -30,41 +34,16 @@ namespace boza
 
         buffer = std::move(_buffer);
 
-        const uint32_t memory_type = [&]
-        {
-            const auto memory_properties = device.get_physical_device().getMemoryProperties();
-            for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
-            {
-                if ((memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
-                    return i;
-            }
-            return UINT32_MAX;
-        }();
-
-        if (memory_type == UINT32_MAX)
-        {
-            Logger::error("Failed to find suitable memory type");
-            ok = false;
-            return;
-        }
-
         const auto memory_requirements = device.get().getBufferMemoryRequirements(buffer.get());
 
-        const vk::MemoryAllocateInfo allocate_info
-        {
-            memory_requirements.size,
-            memory_type
-        };
-
-        auto [mem_result, _memory] = device.get().allocateMemoryUnique(allocate_info);
-        if (mem_result != vk::Result::eSuccess)
+        allocation = device.get_allocator().allocate(memory_requirements, properties, ResourceKind::Linear, lifetime);
+        if (!allocation)
         {
             Logger::error("Failed to allocate buffer memory");
             ok = false;
             return;
         }
 
-        memory = std::move(_memory);
         this->size = size;
     }
 
@@ -78,12 +57,59 @@ namespace boza
         };
     }
 
+    Buffer Buffer::device_local(
+        const Device&              device,
+        CommandPool&               command_pool,
+        const vk::BufferUsageFlags usage,
+        const void*                data,
+        const vk::DeviceSize       size,
+        const MemoryLifetime       lifetime)
+    {
+        if (has_unified_memory(device))
+        {
+            Buffer buffer{ device, size, usage, vk::MemoryPropertyFlagBits::eDeviceLocal | host_properties, lifetime };
+            if (!buffer || !buffer.bind() || !buffer.copy_data(data, size)) return Buffer{ nullptr };
+            return buffer;
+        }
+
+        Buffer staging{ device, size, vk::BufferUsageFlagBits::eTransferSrc, host_properties, MemoryLifetime::Transient };
+        if (!staging || !staging.bind() || !staging.copy_data(data, size))
+        {
+            Logger::error("Failed to fill staging buffer");
+            return Buffer{ nullptr };
+        }
+
+        return device_local(device, command_pool, usage, staging, 0, size, lifetime);
+    }
+
+    Buffer Buffer::device_local(
+        const Device&              device,
+        CommandPool&               command_pool,
+        const vk::BufferUsageFlags usage,
+        const Buffer&              staging,
+        const vk::DeviceSize       offset,
+        const vk::DeviceSize       size,
+        const MemoryLifetime       lifetime)
+    {
+        if (has_unified_memory(device))
+            return device_local(device, command_pool, usage, staging.get_mapped() + offset, size, lifetime);
+
+        if (!staging.flush()) return Buffer{ nullptr };
+
+        Buffer buffer{ device, size, usage | vk::BufferUsageFlagBits::eTransferDst,
+                       vk::MemoryPropertyFlagBits::eDeviceLocal, lifetime };
+        if (!buffer || !buffer.bind()) return Buffer{ nullptr };
+
+        if (!upload(device, command_pool, staging, offset, buffer, size)) return Buffer{ nullptr };
+        return buffer;
+    }
+
     Buffer::Buffer(Buffer&& other) noexcept
     {
-        buffer = std::move(other.buffer);
-        memory = std::move(other.memory);
-        size   = std::exchange(other.size, 0);
-        ok     = std::exchange(other.ok, false);
+        buffer     = std::move(other.buffer);
+        allocation = std::move(other.allocation);
+        size       = std::exchange(other.size, 0);
+        ok         = std::exchange(other.ok, false);
 
         if (other.device) device = std::cref(other.device->get());
         other.device = std::nullopt;
@@ -93,10 +119,10 @@ namespace boza
     {
         if (this != &other)
         {
-            buffer = std::move(other.buffer);
-            memory = std::move(other.memory);
-            size   = std::exchange(other.size, 0);
-            ok     = std::exchange(other.ok, false);
+            buffer     = std::move(other.buffer);
+            allocation = std::move(other.allocation);
+            size       = std::exchange(other.size, 0);
+            ok         = std::exchange(other.ok, false);
 
             if (other.device) device = std::cref(other.device->get());
             other.device = std::nullopt;
@@ -106,25 +132,43 @@ namespace boza
     }
 
 
-    bool Buffer::copy_data(const void* data, const vk::DeviceSize size)
+    bool Buffer::copy_data(const void* data, const vk::DeviceSize size, const vk::DeviceSize offset)
     {
-        auto [result, dest] = device->get().get().mapMemory(*memory, 0, size, {});
-        if (result != vk::Result::eSuccess)
+        PROFILE_ZONE("staging copy");
+        PROFILE_BYTES(size);
+
+        if (allocation.get_mapped() == nullptr)
         {
-            Logger::error("Failed to map buffer memory");
+            Logger::error("Buffer memory is not host-visible");
             ok = false;
             return false;
         }
 
-        std::memcpy(dest, data, size);
-        device->get().get().unmapMemory(*memory);
+        std::memcpy(allocation.get_mapped() + offset, data, size);
+        return allocation.flush();
+    }
 
+    bool Buffer::read_data(void* data, const vk::DeviceSize size) const
+    {
+        PROFILE_ZONE("readback copy");
+        PROFILE_BYTES(size);
+
+        if (allocation.get_mapped() == nullptr)
+        {
+            Logger::error("Buffer memory is not host-visible");
+            return false;
+        }
+
+        if (!allocation.invalidate()) return false;
+
+        std::memcpy(data, allocation.get_mapped(), size);
         return true;
     }
 
     bool Buffer::bind()
     {
-        if (device->get().get().bindBufferMemory(*buffer, *memory, 0) != vk::Result::eSuccess)
+        if (device->get().get().bindBufferMemory(*buffer, allocation.get_memory(), allocation.get_offset()) !=
+            vk::Result::eSuccess)
         {
             Logger::error("Failed to bind buffer memory");
             ok = false;
@@ -136,17 +180,64 @@ namespace boza
 
     bool Buffer::update_uniform(const void* data, const vk::DeviceSize size)
     {
-        auto [result, mapped_memory] = device->get().get().mapMemory(*memory, 0, size, {});
-        if (result != vk::Result::eSuccess)
+        return copy_data(data, size);
+    }
+
+
+    bool Buffer::has_unified_memory(const Device& device)
+    {
+        const vk::PhysicalDeviceType device_type = device.get_physical_device().getProperties().deviceType;
+        return (device_type == vk::PhysicalDeviceType::eIntegratedGpu ||
+                device_type == vk::PhysicalDeviceType::eCpu) &&
+               device.get_allocator().find_memory_type(
+                   UINT32_MAX, vk::MemoryPropertyFlagBits::eDeviceLocal | host_properties) != UINT32_MAX;
+    }
+
+    bool Buffer::upload(const Device& device, CommandPool& command_pool, const Buffer& source,
+                        const vk::DeviceSize offset, const Buffer& destination, const vk::DeviceSize size)
+    {
+        PROFILE_ZONE("upload");
+        PROFILE_BYTES(size);
+
+        auto command_buffers = command_pool.allocate_command_buffers(device, 1);
+        if (command_buffers.empty()) return false;
+
+        const vk::CommandBuffer& command_buffer = *command_buffers[0];
+
+        if (command_buffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit }) != vk::Result::eSuccess)
         {
-            Logger::error("Failed to map buffer memory");
-            ok = false;
+            Logger::error("Failed to begin upload command buffer");
+            return false;
+        }
+
+        command_buffer.copyBuffer(source.get_buffer(), destination.get_buffer(), vk::BufferCopy{ offset, 0, size });
+
+        // Covers the voxelization commands submitted after this one on the same queue
+        const vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead };
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                       vk::PipelineStageFlagBits::eComputeShader,
+                                       {}, barrier, {}, {});
+
+        if (command_buffer.end() != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to end upload command buffer");
             return false;
         }
 
-        std::memcpy(mapped_memory, data, size);
-        device->get().get().unmapMemory(*memory);
+        QueueScheduler& scheduler = device.get_scheduler();
+        QueueTicket     ticket;
+        if (!scheduler.submit(0, { &command_buffer, 1 }, {}, ticket))
+        {
+            Logger::error("Failed to submit upload command buffer");
+            return false;
+        }
+
+        if (!scheduler.wait(ticket))
+        {
+            Logger::error("Failed to wait for upload");
+            return false;
+        }
 
         return true;
     }
-}
\ No newline at end of file
+}
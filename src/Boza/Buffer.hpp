@@ -1,5 +1,6 @@
 #pragma once
 #include "pch.hpp"
+#include "CommandPool.hpp"
 #include "Device.hpp"
 
 namespace boza
@@ -12,10 +13,30 @@ namespace boza
         Buffer(const Device&           device,
                vk::DeviceSize          size,
                vk::BufferUsageFlags    usage,
-               vk::MemoryPropertyFlags properties);
+               vk::MemoryPropertyFlags properties,
+               MemoryLifetime          lifetime = MemoryLifetime::Persistent);
 
         static Buffer uniform_buffer(const Device& device, vk::DeviceSize size);
 
+        // A bound buffer in device-local memory holding a copy of data. Integrated GPUs, whose
+        // device-local memory is also host-visible, have it written directly; elsewhere it goes
+        // through a staging buffer and a transfer on the compute queue, waited for before returning
+        static Buffer device_local(const Device&        device,
+                                   CommandPool&         command_pool,
+                                   vk::BufferUsageFlags usage,
+                                   const void*          data,
+                                   vk::DeviceSize       size,
+                                   MemoryLifetime       lifetime = MemoryLifetime::Persistent);
+
+        // The same, from `size` bytes at `offset` in a host-visible buffer that already holds them
+        static Buffer device_local(const Device&        device,
+                                   CommandPool&         command_pool,
+                                   vk::BufferUsageFlags usage,
+                                   const Buffer&        staging,
+                                   vk::DeviceSize       offset,
+                                   vk::DeviceSize       size,
+                                   MemoryLifetime       lifetime = MemoryLifetime::Persistent);
+
         Buffer(const Buffer&)            = delete;
         Buffer& operator=(const Buffer&) = delete;
 
@@ -25,19 +46,38 @@ namespace boza
         operator bool () const noexcept { return ok; }
 
 
-        [[nodiscard]] bool copy_data(const void* data, vk::DeviceSize size);
+        [[nodiscard]] bool copy_data(const void* data, vk::DeviceSize size, vk::DeviceSize offset = 0);
+        [[nodiscard]] bool read_data(void* data, vk::DeviceSize size) const;
         [[nodiscard]] bool bind();
 
+        // Make host writes through get_mapped() visible to the device, and device writes to the host
+        [[nodiscard]] bool flush() const { return allocation.flush(); }
+        [[nodiscard]] bool invalidate() const { return allocation.invalidate(); }
+
         [[nodiscard]]
         bool update_uniform(const void* data, vk::DeviceSize size);
 
         [[nodiscard]] const vk::Buffer&       get_buffer() const { return *buffer; }
-        [[nodiscard]] const vk::DeviceMemory& get_memory() const { return *memory; }
+        [[nodiscard]] const vk::DeviceMemory& get_memory() const { return allocation.get_memory(); }
+
+        // Host-visible memory stays mapped for as long as the buffer lives; null otherwise
+        [[nodiscard]] uint8_t* get_mapped() const { return allocation.get_mapped(); }
 
     private:
-        vk::UniqueBuffer       buffer{ nullptr };
-        vk::UniqueDeviceMemory memory{ nullptr };
-        vk::DeviceSize         size{};
+        static constexpr vk::MemoryPropertyFlags host_properties{
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+        };
+
+        // Integrated GPUs, where writing device-local memory from the host is as cheap as a staging copy
+        [[nodiscard]] static bool has_unified_memory(const Device& device);
+
+        [[nodiscard]] static bool upload(const Device& device, CommandPool& command_pool, const Buffer& source,
+                                         vk::DeviceSize offset, const Buffer& destination, vk::DeviceSize size);
+
+        // Before the buffer, which must be destroyed before its range is handed out again
+        MemoryAllocation allocation{ nullptr };
+        vk::UniqueBuffer buffer{ nullptr };
+        vk::DeviceSize   size{};
 
         std::optional<std::reference_wrapper<const Device>> device { std::nullopt };
 
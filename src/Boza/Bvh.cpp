@@ -0,0 +1,245 @@
+#include "Bvh.hpp"
+#include "CpuProfiler.hpp"
+#include "Logger.hpp"
+
+namespace boza
+{
+    namespace
+    {
+        struct Bounds final
+        {
+            glm::vec3 min{ std::numeric_limits<float>::max() };
+            glm::vec3 max{ std::numeric_limits<float>::lowest() };
+
+            void grow(const glm::vec3& point)
+            {
+                min = glm::min(min, point);
+                max = glm::max(max, point);
+            }
+
+            void grow(const Bounds& other)
+            {
+                min = glm::min(min, other.min);
+                max = glm::max(max, other.max);
+            }
+
+            [[nodiscard]] float half_area() const
+            {
+                if (min.x > max.x) return 0.0f;
+                const glm::vec3 d = max - min;
+                return d.x * d.y + d.y * d.z + d.z * d.x;
+            }
+        };
+
+        struct BuildStats final
+        {
+            std::atomic<uint32_t> leaves{ 0 };
+            std::atomic<uint32_t> depth{ 0 };
+        };
+
+        class BuildContext final
+        {
+        public:
+            BuildContext(std::vector<Bounds> triangle_bounds, std::vector<uint32_t>& order)
+                : triangle_bounds{ std::move(triangle_bounds) }, order{ order }
+            {
+                centroids.reserve(this->triangle_bounds.size());
+                for (const auto& b : this->triangle_bounds)
+                    centroids.push_back(0.5f * (b.min + b.max));
+
+                const uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+                parallel_depth = static_cast<uint32_t>(std::bit_width(threads));
+            }
+
+            // Builds the subtree over order[begin, end) and appends it to out in depth-first order
+            void build(const uint32_t begin, const uint32_t end, const uint32_t depth, std::vector<BvhNode>& out)
+            {
+                uint32_t deepest = stats.depth.load(std::memory_order_relaxed);
+                while (deepest < depth && !stats.depth.compare_exchange_weak(deepest, depth, std::memory_order_relaxed)) {}
+
+                Bounds bounds, centroid_bounds;
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    bounds.grow(triangle_bounds[order[i]]);
+                    centroid_bounds.grow(centroids[order[i]]);
+                }
+
+                const uint32_t node_index = static_cast<uint32_t>(out.size());
+                out.push_back({ glm::vec4(bounds.min, 0.0f), glm::vec4(bounds.max, 0.0f) });
+
+                const uint32_t count = end - begin;
+                const uint32_t mid   = count <= 1 || depth + 1 >= BvhBuilder::max_depth
+                                           ? begin
+                                           : split(begin, end, bounds, centroid_bounds);
+
+                if (mid == begin || mid == end)
+                {
+                    out[node_index].min.w = std::bit_cast<float>(begin);
+                    out[node_index].max.w = std::bit_cast<float>(count);
+                    stats.leaves.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                // The top levels are split across threads; each task builds into its own
+                // vector, which is then spliced in with its child indices rebased.
+                if (depth < parallel_depth && count > parallel_threshold)
+                {
+                    std::vector<BvhNode> right_nodes;
+                    auto right = std::async(std::launch::async, [&]
+                    {
+                        build(mid, end, depth + 1, right_nodes);
+                    });
+
+                    build(begin, mid, depth + 1, out);
+                    right.wait();
+
+                    const uint32_t right_index = static_cast<uint32_t>(out.size());
+                    for (auto& node : right_nodes)
+                    {
+                        if (std::bit_cast<uint32_t>(node.max.w) == 0)
+                            node.min.w = std::bit_cast<float>(std::bit_cast<uint32_t>(node.min.w) + right_index);
+                    }
+
+                    out[node_index].min.w = std::bit_cast<float>(right_index);
+                    out.insert(out.end(), right_nodes.begin(), right_nodes.end());
+                    return;
+                }
+
+                build(begin, mid, depth + 1, out);
+                out[node_index].min.w = std::bit_cast<float>(static_cast<uint32_t>(out.size()));
+                build(mid, end, depth + 1, out);
+            }
+
+            BuildStats stats;
+
+        private:
+            static constexpr uint32_t parallel_threshold = 4096;
+
+            // Returns the partition point of the cheapest binned SAH split, or begin to make a leaf
+            uint32_t split(const uint32_t begin, const uint32_t end, const Bounds& bounds, const Bounds& centroid_bounds)
+            {
+                constexpr uint32_t bins = BvhBuilder::bin_count;
+                const uint32_t     count = end - begin;
+
+                float    best_cost = std::numeric_limits<float>::max();
+                int      best_axis = -1;
+                uint32_t best_bin  = 0;
+
+                const glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    if (extent[axis] <= 0.0f) continue;
+
+                    std::array<Bounds, bins>   bin_bounds{};
+                    std::array<uint32_t, bins> bin_counts{};
+
+                    const float bin_scale = static_cast<float>(bins) / extent[axis];
+                    for (uint32_t i = begin; i < end; ++i)
+                    {
+                        const uint32_t b = bin_of(centroids[order[i]][axis], centroid_bounds.min[axis], bin_scale);
+                        bin_bounds[b].grow(triangle_bounds[order[i]]);
+                        ++bin_counts[b];
+                    }
+
+                    // Sweep from the right to get the cost of every right-hand side, then from the left
+                    std::array<float, bins> right_cost{};
+                    Bounds                  right_bounds;
+                    uint32_t                right_count = 0;
+                    for (uint32_t b = bins - 1; b > 0; --b)
+                    {
+                        right_bounds.grow(bin_bounds[b]);
+                        right_count += bin_counts[b];
+                        right_cost[b] = right_bounds.half_area() * static_cast<float>(right_count);
+                    }
+
+                    Bounds   left_bounds;
+                    uint32_t left_count = 0;
+                    for (uint32_t b = 0; b + 1 < bins; ++b)
+                    {
+                        left_bounds.grow(bin_bounds[b]);
+                        left_count += bin_counts[b];
+                        if (left_count == 0 || left_count == count) continue;
+
+                        const float cost = left_bounds.half_area() * static_cast<float>(left_count) + right_cost[b + 1];
+                        if (cost < best_cost)
+                        {
+                            best_cost = cost;
+                            best_axis = axis;
+                            best_bin  = b;
+                        }
+                    }
+                }
+
+                // All centroids coincide: only worth splitting arbitrarily if the leaf would be too big
+                if (best_axis < 0)
+                    return count > BvhBuilder::max_leaf_size ? begin + count / 2 : begin;
+
+                const float leaf_cost = bounds.half_area() * static_cast<float>(count);
+                if (count <= BvhBuilder::max_leaf_size && best_cost >= leaf_cost)
+                    return begin;
+
+                const float axis_min  = centroid_bounds.min[best_axis];
+                const float bin_scale = static_cast<float>(bins) / extent[best_axis];
+
+                const auto first = order.begin() + begin;
+                const auto last  = order.begin() + end;
+                const auto it    = std::partition(first, last, [&](const uint32_t t)
+                {
+                    return bin_of(centroids[t][best_axis], axis_min, bin_scale) <= best_bin;
+                });
+
+                return static_cast<uint32_t>(it - order.begin());
+            }
+
+            static uint32_t bin_of(const float value, const float axis_min, const float bin_scale)
+            {
+                const auto b = static_cast<uint32_t>((value - axis_min) * bin_scale);
+                return std::min(b, BvhBuilder::bin_count - 1);
+            }
+
+            std::vector<Bounds>    triangle_bounds;
+            std::vector<glm::vec3> centroids;
+            std::vector<uint32_t>& order;
+
+            uint32_t parallel_depth{ 0 };
+        };
+    }
+
+
+    Bvh BvhBuilder::build(const MeshData& mesh_data, const VoxelGrid& grid)
+    {
+        PROFILE_ZONE("BVH build");
+        const auto start = std::chrono::steady_clock::now();
+
+        const auto triangle_count = static_cast<uint32_t>(mesh_data.indices.size() / 3);
+
+        std::vector<Bounds> triangle_bounds(triangle_count);
+        for (uint32_t t = 0; t < triangle_count; ++t)
+        {
+            for (uint32_t k = 0; k < 3; ++k)
+                triangle_bounds[t].grow(grid.to_voxel_space(glm::vec3{ mesh_data.vertices[mesh_data.indices[t * 3 + k]] }));
+
+            // Guard against the GPU transform rounding a vertex just outside the CPU bounds
+            triangle_bounds[t].min -= 1e-4f;
+            triangle_bounds[t].max += 1e-4f;
+        }
+
+        Bvh bvh;
+        bvh.triangles.resize(triangle_count);
+        std::iota(bvh.triangles.begin(), bvh.triangles.end(), 0u);
+
+        BuildContext context{ std::move(triangle_bounds), bvh.triangles };
+        bvh.nodes.reserve(2 * static_cast<size_t>(triangle_count) / max_leaf_size + 1);
+        context.build(0, triangle_count, 0, bvh.nodes);
+
+        const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+
+        const uint32_t leaves = context.stats.leaves.load();
+        Logger::info("Built BVH over {} triangles in {:.2f} ms: {} nodes, {} leaves, depth {}, {:.2f} triangles per leaf",
+                     triangle_count, elapsed.count(), bvh.nodes.size(), leaves, context.stats.depth.load(),
+                     leaves ? static_cast<double>(triangle_count) / leaves : 0.0);
+
+        return bvh;
+    }
+}
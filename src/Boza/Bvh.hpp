@@ -0,0 +1,38 @@
+#pragma once
+#include "pch.hpp"
+#include "TriangleLoader.hpp"
+#include "VoxelGrid.hpp"
+
+namespace boza
+{
+    // Flattened node in the layout read by voxelize_voxels.comp. Nodes are stored depth first,
+    // so the left child of an inner node is always the next node.
+    //   min.w - inner node: index of the right child, leaf: first entry in Bvh::triangles
+    //   max.w - inner node: 0, leaf: number of triangles
+    // Both w components hold uint32_t bit patterns.
+    struct BvhNode final
+    {
+        glm::vec4 min;
+        glm::vec4 max;
+    };
+
+    struct Bvh final
+    {
+        std::vector<BvhNode>  nodes;
+        std::vector<uint32_t> triangles;
+
+        operator bool () const { return !nodes.empty(); }
+    };
+
+    // Binned SAH builder working in voxel units, so the shader can query it with the voxel bounds directly
+    class BvhBuilder final
+    {
+    public:
+        static constexpr uint32_t bin_count      = 16;
+        static constexpr uint32_t max_leaf_size  = 8;
+        static constexpr uint32_t max_depth      = 64; // must not exceed the traversal stack in voxelize_voxels.comp
+
+        BvhBuilder() = delete;
+        static Bvh build(const MeshData& mesh_data, const VoxelGrid& grid);
+    };
+}
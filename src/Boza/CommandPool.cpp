@@ -4,20 +4,14 @@
 
 namespace boza
 {
-    CommandPool::CommandPool(const Device& device) : ok{ true }
-    {
-        Logger::trace("Creating command pool");
-
-        if (!create_command_pool(device)) return;
+    CommandPool::CommandPool(const Device& device) : CommandPool{ device, device.get_compute_queue_family_index() } {}
 
-        auto cmd_buffs = allocate_command_buffers(device, 1);
-        if (cmd_buffs.empty())
-        {
-            ok = false;
-            return;
-        }
+    CommandPool::CommandPool(const Device& device, const uint32_t queue_family_index) : ok{ true }
+    {
+        Logger::trace("Creating command pool for queue family {}", queue_family_index);
 
-        command_buffer = std::move(cmd_buffs[0]);
+        // Command buffers are allocated by their owners, which record and reuse them as they need
+        create_command_pool(device, queue_family_index);
     }
 
     CommandPool::~CommandPool()
@@ -28,7 +22,6 @@ namespace boza
 
     CommandPool::CommandPool(CommandPool&& other) noexcept
     {
-        command_buffer = std::move(other.command_buffer);
         command_pool = std::move(other.command_pool);
         ok = std::exchange(other.ok, false);
     }
@@ -37,7 +30,6 @@ namespace boza
     {
         if (this != &other)
         {
-            command_buffer = std::move(other.command_buffer);
             command_pool = std::move(other.command_pool);
             ok = std::exchange(other.ok, false);
         }
@@ -65,12 +57,12 @@ namespace boza
         return std::move(buffers);
     }
 
-    bool CommandPool::create_command_pool(const Device& device)
+    bool CommandPool::create_command_pool(const Device& device, const uint32_t queue_family_index)
     {
         const vk::CommandPoolCreateInfo pool_info
         {
             vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-            device.get_compute_queue_family_index()
+            queue_family_index
         };
 
         auto [result, _command_pool] = device.get().createCommandPoolUnique(pool_info);
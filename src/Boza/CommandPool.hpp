@@ -9,6 +9,9 @@ namespace boza
     public:
         CommandPool(nullptr_t) {}
         explicit CommandPool(const Device& device);
+
+        // For the queues of another family than the compute one
+        CommandPool(const Device& device, uint32_t queue_family_index);
         ~CommandPool();
 
         CommandPool(const CommandPool&) = delete;
@@ -22,14 +25,12 @@ namespace boza
         [[nodiscard]]
         std::vector<vk::UniqueCommandBuffer> allocate_command_buffers(const Device& device, uint32_t count);
 
-        [[nodiscard]] const vk::CommandPool&   get() const { return *command_pool; }
-        [[nodiscard]] const vk::CommandBuffer& get_command_buffer() const { return *command_buffer; }
+        [[nodiscard]] const vk::CommandPool& get() const { return *command_pool; }
 
     private:
-        bool create_command_pool(const Device& device);
+        bool create_command_pool(const Device& device, uint32_t queue_family_index);
 
         vk::UniqueCommandPool command_pool;
-        vk::UniqueCommandBuffer command_buffer;
 
         bool ok = false;
     };
@@ -9,14 +9,15 @@ namespace boza
         const std::string_view&                   shader_path,
         const std::vector<DescriptorBindingInfo>& descriptor_bindings,
         const std::vector<PushConstantRange>&     push_constant_ranges,
-        const vk::PipelineCache                   pipeline_cache)
-        : device{ std::cref(device) }, ok{ true }
+        const vk::PipelineCache                   pipeline_cache,
+        const uint32_t                            descriptor_set_count)
+        : pipeline_cache{ pipeline_cache }, device{ std::cref(device) }, ok{ true }
     {
+        // Pipelines are compiled per variant, see select_variant
         if (!create_shader_module(shader_path)) return;
         if (!create_descriptor_set_layout(descriptor_bindings)) return;
         if (!create_pipeline_layout(push_constant_ranges)) return;
-        if (!create_pipeline(pipeline_cache)) return;
-        if (!create_descriptor_pool_and_set(descriptor_bindings)) return;
+        if (!create_descriptor_pool_and_sets(descriptor_bindings, descriptor_set_count)) return;
 
         uint32_t total_push_constant_size = 0;
         for (auto& pc : push_constant_ranges)
@@ -30,13 +31,22 @@ namespace boza
     {
         shader_module         = std::move(other.shader_module);
         pipeline_layout       = std::move(other.pipeline_layout);
-        pipeline              = std::move(other.pipeline);
         descriptor_set_layout = std::move(other.descriptor_set_layout);
         descriptor_pool       = std::move(other.descriptor_pool);
-        descriptor_set        = std::move(other.descriptor_set);
+        descriptor_sets       = std::move(other.descriptor_sets);
+
+        current_descriptor_set = std::exchange(other.current_descriptor_set, 0);
 
         push_constant_buffer = std::exchange(other.push_constant_buffer, {});
 
+        variants               = std::move(other.variants);
+        current_pipeline       = std::exchange(other.current_pipeline, nullptr);
+        current_workgroup_size = std::exchange(other.current_workgroup_size, glm::uvec3{ 1 });
+        pipeline_cache         = std::exchange(other.pipeline_cache, nullptr);
+        pipeline_creation_ms   = std::exchange(other.pipeline_creation_ms, 0.0);
+        pipeline_cache_hits    = std::exchange(other.pipeline_cache_hits, 0);
+        pipeline_cache_misses  = std::exchange(other.pipeline_cache_misses, 0);
+
         ok = std::exchange(other.ok, false);
 
         if (other.device) device = std::cref(other.device->get());
@@ -49,13 +59,22 @@ namespace boza
         {
             shader_module         = std::move(other.shader_module);
             pipeline_layout       = std::move(other.pipeline_layout);
-            pipeline              = std::move(other.pipeline);
             descriptor_set_layout = std::move(other.descriptor_set_layout);
             descriptor_pool       = std::move(other.descriptor_pool);
-            descriptor_set        = std::move(other.descriptor_set);
+            descriptor_sets       = std::move(other.descriptor_sets);
+
+            current_descriptor_set = std::exchange(other.current_descriptor_set, 0);
 
             push_constant_buffer = std::exchange(other.push_constant_buffer, {});
 
+            variants               = std::move(other.variants);
+            current_pipeline       = std::exchange(other.current_pipeline, nullptr);
+            current_workgroup_size = std::exchange(other.current_workgroup_size, glm::uvec3{ 1 });
+            pipeline_cache         = std::exchange(other.pipeline_cache, nullptr);
+            pipeline_creation_ms   = std::exchange(other.pipeline_creation_ms, 0.0);
+            pipeline_cache_hits    = std::exchange(other.pipeline_cache_hits, 0);
+            pipeline_cache_misses  = std::exchange(other.pipeline_cache_misses, 0);
+
             ok = std::exchange(other.ok, false);
 
             if (other.device) device = std::cref(other.device->get());
@@ -79,7 +98,7 @@ namespace boza
 
         vk::WriteDescriptorSet write
         {
-            *descriptor_set,
+            *descriptor_sets[current_descriptor_set],
             binding,
             0,
             1,
@@ -102,7 +121,7 @@ namespace boza
 
         vk::WriteDescriptorSet write
         {
-            *descriptor_set,
+            *descriptor_sets[current_descriptor_set],
             binding,
             0,
             1,
@@ -125,7 +144,7 @@ namespace boza
 
         vk::WriteDescriptorSet write
         {
-            *descriptor_set,
+            *descriptor_sets[current_descriptor_set],
             binding,
             0,
             1,
@@ -148,7 +167,7 @@ namespace boza
 
         vk::WriteDescriptorSet write
         {
-            *descriptor_set,
+            *descriptor_sets[current_descriptor_set],
             binding,
             0,
             1,
@@ -161,21 +180,69 @@ namespace boza
         device->get().get().updateDescriptorSets({ write }, {});
     }
 
+    bool ComputeShader::select_variant(const Variant& variant)
+    {
+        std::vector<uint32_t> specialization{ variant.workgroup_size.x, variant.workgroup_size.y, variant.workgroup_size.z };
+        specialization.insert(specialization.end(), variant.constants.begin(), variant.constants.end());
+
+        auto found = variants.find(specialization);
+        if (found == variants.end())
+        {
+            vk::UniquePipeline pipeline = create_pipeline(specialization);
+            if (!pipeline) return false;
+
+            found = variants.emplace(std::move(specialization), std::move(pipeline)).first;
+        }
+
+        current_pipeline       = *found->second;
+        current_workgroup_size = variant.workgroup_size;
+        return true;
+    }
+
     void ComputeShader::dispatch(
         const vk::CommandBuffer command_buffer,
         const uint32_t          group_count_x,
         const uint32_t          group_count_y,
         const uint32_t          group_count_z)
     {
-        command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+        bind(command_buffer);
+        command_buffer.dispatch(group_count_x, group_count_y, group_count_z);
+    }
+
+    bool ComputeShader::dispatch(
+        const vk::CommandBuffer command_buffer,
+        const Variant&          variant,
+        const glm::uvec3&       invocations)
+    {
+        if (!select_variant(variant)) return false;
+
+        const glm::uvec3 group_count = (invocations + current_workgroup_size - 1u) / current_workgroup_size;
+        dispatch(command_buffer, group_count.x, group_count.y, group_count.z);
+        return true;
+    }
+
+    bool ComputeShader::dispatch_indirect(
+        const vk::CommandBuffer command_buffer,
+        const Variant&          variant,
+        const vk::Buffer        buffer,
+        const vk::DeviceSize    offset)
+    {
+        if (!select_variant(variant)) return false;
+
+        bind(command_buffer);
+        command_buffer.dispatchIndirect(buffer, offset);
+        return true;
+    }
+
+    void ComputeShader::bind(const vk::CommandBuffer command_buffer) const
+    {
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, current_pipeline);
         command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipeline_layout, 0,
-                                          { *descriptor_set }, {});
+                                          { *descriptor_sets[current_descriptor_set] }, {});
 
         if (!push_constant_buffer.empty())
             command_buffer.pushConstants<uint8_t>(*pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0,
                                                   push_constant_buffer);
-
-        command_buffer.dispatch(group_count_x, group_count_y, group_count_z);
     }
 
 
@@ -213,20 +280,35 @@ namespace boza
 
     bool ComputeShader::create_descriptor_set_layout(const std::vector<DescriptorBindingInfo>& descriptor_bindings)
     {
+        const bool update_after_bind = has_update_after_bind(descriptor_bindings);
+
         std::vector<vk::DescriptorSetLayoutBinding> bindings;
+        std::vector<vk::DescriptorBindingFlags>     binding_flags;
         bindings.reserve(descriptor_bindings.size());
+        binding_flags.reserve(descriptor_bindings.size());
 
         for (const auto& [binding, descriptorType, stageFlags, descriptorCount] : descriptor_bindings)
         {
             vk::DescriptorSetLayoutBinding dsl_binding(binding, descriptorType, descriptorCount, stageFlags);
             bindings.push_back(dsl_binding);
+            binding_flags.push_back(update_after_bind && descriptorType == vk::DescriptorType::eStorageBuffer
+                                        ? vk::DescriptorBindingFlagBits::eUpdateAfterBind
+                                        : vk::DescriptorBindingFlags{});
         }
 
+        const vk::DescriptorSetLayoutBindingFlagsCreateInfo flags_info
+        {
+            static_cast<uint32_t>(binding_flags.size()),
+            binding_flags.data()
+        };
+
         const vk::DescriptorSetLayoutCreateInfo layout_info
         {
-            {},
+            update_after_bind ? vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool
+                              : vk::DescriptorSetLayoutCreateFlags{},
             static_cast<uint32_t>(bindings.size()),
-            bindings.data()
+            bindings.data(),
+            update_after_bind ? &flags_info : nullptr
         };
 
         auto [result, _descriptor_set_layout] = device->get().get().createDescriptorSetLayoutUnique(layout_info);
@@ -241,6 +323,15 @@ namespace boza
         return true;
     }
 
+    bool ComputeShader::has_update_after_bind(const std::vector<DescriptorBindingInfo>& descriptor_bindings) const
+    {
+        return device->get().has_storage_buffer_update_after_bind() &&
+               std::ranges::any_of(descriptor_bindings, [](const DescriptorBindingInfo& binding)
+               {
+                   return binding.descriptorType == vk::DescriptorType::eStorageBuffer;
+               });
+    }
+
     bool ComputeShader::create_pipeline_layout(const std::vector<PushConstantRange>& push_constant_ranges)
     {
         std::vector<vk::PushConstantRange> push_ranges;
@@ -270,49 +361,77 @@ namespace boza
         return true;
     }
 
-    bool ComputeShader::create_pipeline(const vk::PipelineCache pipeline_cache)
+    vk::UniquePipeline ComputeShader::create_pipeline(const std::vector<uint32_t>& specialization)
     {
+        std::vector<vk::SpecializationMapEntry> entries;
+        entries.reserve(specialization.size());
+        for (uint32_t id = 0; id < specialization.size(); ++id)
+            entries.emplace_back(id, id * static_cast<uint32_t>(sizeof(uint32_t)), sizeof(uint32_t));
+
+        const vk::SpecializationInfo specialization_info
+        {
+            static_cast<uint32_t>(entries.size()), entries.data(),
+            specialization.size() * sizeof(uint32_t), specialization.data()
+        };
+
         const vk::PipelineShaderStageCreateInfo stage_info
         {
             {},
             vk::ShaderStageFlagBits::eCompute,
             *shader_module,
-            "main"
+            "main",
+            &specialization_info
         };
 
-        const vk::ComputePipelineCreateInfo pipeline_info
+        vk::PipelineCreationFeedbackEXT           feedback{};
+        vk::PipelineCreationFeedbackCreateInfoEXT feedback_info{ &feedback, 0, nullptr };
+
+        vk::ComputePipelineCreateInfo pipeline_info
         {
             {},
             stage_info,
             *pipeline_layout
         };
 
+        if (device->get().has_pipeline_creation_feedback()) pipeline_info.pNext = &feedback_info;
+
+        const auto start = std::chrono::steady_clock::now();
         auto [result, _pipeline] = device->get().get().createComputePipelineUnique(pipeline_cache, pipeline_info);
+        pipeline_creation_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
         if (result != vk::Result::eSuccess)
         {
             Logger::error("Failed to create compute pipeline");
-            ok = false;
-            return false;
+            return vk::UniquePipeline{ nullptr };
         }
 
-        pipeline = std::move(_pipeline);
-        return true;
+        if (feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eValid)
+        {
+            if (feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit) ++pipeline_cache_hits;
+            else ++pipeline_cache_misses;
+        }
+
+        return std::move(_pipeline);
     }
 
-    bool ComputeShader::create_descriptor_pool_and_set(const std::vector<DescriptorBindingInfo>& descriptor_bindings)
+    bool ComputeShader::create_descriptor_pool_and_sets(const std::vector<DescriptorBindingInfo>& descriptor_bindings,
+                                                        const uint32_t                            set_count)
     {
         std::unordered_map<vk::DescriptorType, uint32_t> type_counts;
         for (auto& b : descriptor_bindings)
-            type_counts[b.descriptorType] += b.descriptorCount;
+            type_counts[b.descriptorType] += b.descriptorCount * set_count;
 
         std::vector<vk::DescriptorPoolSize> pool_sizes;
         for (auto& [descriptor, count] : type_counts)
             pool_sizes.emplace_back(descriptor, count);
 
+        vk::DescriptorPoolCreateFlags pool_flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
+        if (has_update_after_bind(descriptor_bindings)) pool_flags |= vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind;
+
         const vk::DescriptorPoolCreateInfo pool_info
         {
-            vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-            1,
+            pool_flags,
+            set_count,
             static_cast<uint32_t>(pool_sizes.size()),
             pool_sizes.data()
         };
@@ -327,22 +446,23 @@ namespace boza
 
         descriptor_pool = std::move(_descriptor_pool);
 
+        const std::vector                   layouts(set_count, *descriptor_set_layout);
         const vk::DescriptorSetAllocateInfo alloc_info
         {
             *descriptor_pool,
-            1, &descriptor_set_layout.get()
+            set_count, layouts.data()
         };
 
-        auto [set_result, _descriptor_set] = device->get().get().allocateDescriptorSetsUnique(alloc_info);
+        auto [set_result, _descriptor_sets] = device->get().get().allocateDescriptorSetsUnique(alloc_info);
 
-        if (set_result != vk::Result::eSuccess || _descriptor_set.size() != 1)
+        if (set_result != vk::Result::eSuccess || _descriptor_sets.size() != set_count)
         {
-            Logger::error("Failed to allocate descriptor set");
+            Logger::error("Failed to allocate {} descriptor set{}", set_count, set_count > 1 ? "s" : "");
             ok = false;
             return false;
         }
 
-        descriptor_set = std::move(_descriptor_set[0]);
+        descriptor_sets = std::move(_descriptor_sets);
 
         return true;
     }
@@ -22,6 +22,15 @@ namespace boza
             uint32_t             size;
         };
 
+        // Specialization constants of one pipeline, all 32 bits wide. Ids 0 to 2 are the
+        // workgroup size (local_size_*_id), `constants` fill ids 3 and up in order.
+        // Constants a shader does not declare are ignored.
+        struct Variant final
+        {
+            glm::uvec3            workgroup_size{ 1 };
+            std::vector<uint32_t> constants;
+        };
+
         ComputeShader(nullptr_t) {}
 
         ComputeShader(
@@ -29,7 +38,8 @@ namespace boza
             const std::string_view&                   shader_path,
             const std::vector<DescriptorBindingInfo>& descriptor_bindings,
             const std::vector<PushConstantRange>&     push_constant_ranges = {},
-            vk::PipelineCache                         pipeline_cache       = nullptr);
+            vk::PipelineCache                         pipeline_cache       = nullptr,
+            uint32_t                                  descriptor_set_count = 1);
 
         ComputeShader(const ComputeShader&)            = delete;
         ComputeShader& operator=(const ComputeShader&) = delete;
@@ -39,6 +49,11 @@ namespace boza
 
         operator bool() const { return ok; }
 
+        // Sets of the same layout, one per group of resources recorded in flight at once. The
+        // update_ functions write the selected one and dispatches bind it
+        void select_descriptor_set(const uint32_t index) { current_descriptor_set = index; }
+        [[nodiscard]] uint32_t get_descriptor_set_count() const { return static_cast<uint32_t>(descriptor_sets.size()); }
+
         void update_storage_image(uint32_t binding, vk::ImageView image_view, vk::ImageLayout layout) const;
         void update_storage_buffer(uint32_t binding, vk::Buffer buffer, vk::DeviceSize range = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) const;
         void update_uniform_buffer(uint32_t binding, vk::Buffer buffer, vk::DeviceSize range = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) const;
@@ -47,20 +62,47 @@ namespace boza
         template <typename T>
         void set_push_constant(const T& data, uint32_t offset = 0);
 
+        // Makes the pipeline for `variant` current, compiling it the first time it is asked for
+        [[nodiscard]] bool select_variant(const Variant& variant);
+
+        // Dispatches the current variant
         void dispatch(vk::CommandBuffer command_buffer, uint32_t group_count_x, uint32_t group_count_y = 1,
                       uint32_t          group_count_z                                                  = 1);
 
-        [[nodiscard]] const vk::Pipeline&       get_pipeline() const { return *pipeline; }
+        // Selects `variant` and dispatches as many of its workgroups as cover `invocations`
+        [[nodiscard]] bool dispatch(vk::CommandBuffer command_buffer, const Variant& variant, const glm::uvec3& invocations);
+
+        // Selects `variant` and dispatches the workgroup counts read from `buffer` when the
+        // commands execute, so they can change without recording the dispatch again
+        [[nodiscard]] bool dispatch_indirect(vk::CommandBuffer command_buffer, const Variant& variant, vk::Buffer buffer,
+                                             vk::DeviceSize offset = 0);
+
+        [[nodiscard]] const vk::Pipeline&       get_pipeline() const { return current_pipeline; }
         [[nodiscard]] const vk::PipelineLayout& get_pipeline_layout() const { return *pipeline_layout; }
-        [[nodiscard]] const vk::DescriptorSet&  get_descriptor_set() const { return *descriptor_set; }
+        [[nodiscard]] const vk::DescriptorSet&  get_descriptor_set() const { return *descriptor_sets[current_descriptor_set]; }
+
+        // Over all variants compiled so far. Hits and misses only count pipelines the driver
+        // reported on, see Device::has_pipeline_creation_feedback
+        [[nodiscard]] uint32_t get_variant_count() const { return static_cast<uint32_t>(variants.size()); }
+        [[nodiscard]] double   get_pipeline_creation_ms() const { return pipeline_creation_ms; }
+        [[nodiscard]] uint32_t get_pipeline_cache_hits() const { return pipeline_cache_hits; }
+        [[nodiscard]] uint32_t get_pipeline_cache_misses() const { return pipeline_cache_misses; }
 
     private:
         [[nodiscard]] bool create_shader_module(const std::string_view& shader_path);
         [[nodiscard]] bool create_descriptor_set_layout(const std::vector<DescriptorBindingInfo>& descriptor_bindings);
 
+        // Storage buffers are bound update-after-bind where the device allows it, so a recorded
+        // command buffer survives them being pointed at other buffers
+        [[nodiscard]] bool has_update_after_bind(const std::vector<DescriptorBindingInfo>& descriptor_bindings) const;
+
+        // Binds the current variant, its descriptor set and the push constants
+        void bind(vk::CommandBuffer command_buffer) const;
+
         [[nodiscard]] bool create_pipeline_layout(const std::vector<PushConstantRange>& push_constant_ranges);
-        [[nodiscard]] bool create_pipeline(vk::PipelineCache pipeline_cache);
-        [[nodiscard]] bool create_descriptor_pool_and_set(const std::vector<DescriptorBindingInfo>& descriptor_bindings);
+        [[nodiscard]] vk::UniquePipeline create_pipeline(const std::vector<uint32_t>& specialization);
+        [[nodiscard]] bool create_descriptor_pool_and_sets(const std::vector<DescriptorBindingInfo>& descriptor_bindings,
+                                                           uint32_t set_count);
 
         [[nodiscard]]
         static std::vector<uint32_t> load_shader_binary(const std::string_view& path);
@@ -68,12 +110,23 @@ namespace boza
         vk::UniqueShaderModule        shader_module;
         vk::UniqueDescriptorSetLayout descriptor_set_layout;
         vk::UniquePipelineLayout      pipeline_layout;
-        vk::UniquePipeline            pipeline;
         vk::UniqueDescriptorPool      descriptor_pool;
-        vk::UniqueDescriptorSet       descriptor_set;
+        std::vector<vk::UniqueDescriptorSet> descriptor_sets;
+        uint32_t                             current_descriptor_set{ 0 };
 
         std::vector<uint8_t> push_constant_buffer;
 
+        // Keyed by the workgroup size followed by the constants
+        std::map<std::vector<uint32_t>, vk::UniquePipeline> variants;
+
+        vk::Pipeline      current_pipeline{ nullptr };
+        glm::uvec3        current_workgroup_size{ 1 };
+        vk::PipelineCache pipeline_cache{ nullptr };
+
+        double   pipeline_creation_ms{ 0.0 };
+        uint32_t pipeline_cache_hits{ 0 };
+        uint32_t pipeline_cache_misses{ 0 };
+
         std::optional<std::reference_wrapper<const Device>> device;
 
         bool ok = false;
@@ -0,0 +1,126 @@
+#include "CpuProfiler.hpp"
+
+#include "Logger.hpp"
+
+namespace boza
+{
+    std::atomic<CpuProfiler::ThreadBuffer*> CpuProfiler::buffers{ nullptr };
+    std::atomic<uint32_t>                   CpuProfiler::buffer_count{ 0 };
+
+    thread_local CpuProfiler::Owner CpuProfiler::owner;
+    thread_local uint64_t           CpuProfiler::thread_bytes{ 0 };
+    thread_local uint64_t           CpuProfiler::thread_allocations{ 0 };
+
+    CpuProfiler::Zone::Zone(const char* name)
+        : name{ name }, begin_ns{ now_ns() }, bytes{ thread_bytes }, allocations{ thread_allocations } {}
+
+    CpuProfiler::Zone::~Zone()
+    {
+        record({ name, begin_ns, now_ns(), thread_bytes - bytes, thread_allocations - allocations });
+    }
+
+
+    void CpuProfiler::add_bytes(const uint64_t bytes) { thread_bytes += bytes; }
+
+    void CpuProfiler::add_allocation() { ++thread_allocations; }
+
+    int64_t CpuProfiler::now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+
+    std::vector<TraceEvent> CpuProfiler::collect(const int64_t since_ns)
+    {
+        std::vector<TraceEvent> events;
+
+        for (const ThreadBuffer* buffer = buffers.load(std::memory_order_acquire); buffer != nullptr;
+             buffer = buffer->next.load(std::memory_order_acquire))
+        {
+            const std::string track = std::format("CPU thread {}", buffer->index);
+
+            for (const Chunk* chunk = &buffer->first; chunk != nullptr; chunk = chunk->next.load(std::memory_order_acquire))
+            {
+                const uint32_t count = chunk->count.load(std::memory_order_acquire);
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    const Record& record = chunk->records[i];
+                    if (record.end_ns < since_ns) continue;
+
+                    events.push_back({ record.name, track, record.begin_ns, record.end_ns - record.begin_ns,
+                                       record.bytes, record.allocations });
+                }
+            }
+        }
+
+        // Newest buffers are first in the list, the trace reads better from the main thread down
+        std::ranges::stable_sort(events, {}, [](const TraceEvent& event) { return event.begin_ns; });
+        return events;
+    }
+
+    void CpuProfiler::flush(const std::string& name)
+    {
+        const std::vector<TraceEvent> events = collect();
+        if (events.empty()) return;
+
+        if (TraceWriter::write_chrome_trace(name + ".trace.json", events) &&
+            TraceWriter::write_summary(name + ".json", "", events))
+            Logger::info("Wrote {} CPU zones to {}.trace.json and {}.json", events.size(), name, name);
+    }
+
+
+    void CpuProfiler::record(const Record& record)
+    {
+        ThreadBuffer& buffer = thread_buffer();
+
+        Chunk*         chunk = buffer.last;
+        const uint32_t count = chunk->count.load(std::memory_order_relaxed);
+        if (count == Chunk::capacity)
+        {
+            Chunk* next = new Chunk;
+            next->records[0] = record;
+            next->count.store(1, std::memory_order_relaxed);
+
+            // Published whole, with its first record
+            chunk->next.store(next, std::memory_order_release);
+            buffer.last = next;
+            return;
+        }
+
+        chunk->records[count] = record;
+        chunk->count.store(count + 1, std::memory_order_release);
+    }
+
+    CpuProfiler::ThreadBuffer& CpuProfiler::thread_buffer()
+    {
+        if (owner.buffer != nullptr) return *owner.buffer;
+
+        // A buffer left behind by a thread that has exited, else a new one
+        for (ThreadBuffer* buffer = buffers.load(std::memory_order_acquire); buffer != nullptr;
+             buffer = buffer->next.load(std::memory_order_acquire))
+        {
+            bool expected = false;
+            if (buffer->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            {
+                owner.buffer = buffer;
+                return *buffer;
+            }
+        }
+
+        auto* buffer  = new ThreadBuffer;
+        buffer->index = buffer_count.fetch_add(1, std::memory_order_relaxed);
+
+        ThreadBuffer* head = buffers.load(std::memory_order_relaxed);
+        do buffer->next.store(head, std::memory_order_relaxed);
+        while (!buffers.compare_exchange_weak(head, buffer, std::memory_order_release, std::memory_order_relaxed));
+
+        owner.buffer = buffer;
+        return *buffer;
+    }
+
+    CpuProfiler::Owner::~Owner()
+    {
+        if (buffer != nullptr) buffer->in_use.store(false, std::memory_order_release);
+    }
+}
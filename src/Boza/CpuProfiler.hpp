@@ -0,0 +1,98 @@
+#pragma once
+#include "pch.hpp"
+#include "TraceWriter.hpp"
+
+namespace boza
+{
+    // Scoped timing of CPU stages, used through the PROFILE_ macros in macros.hpp.
+    //
+    // Every thread appends its finished zones to a buffer of its own, a list of fixed-size chunks
+    // that are only ever added to, publishing each zone with a release store of the chunk's count.
+    // Recording takes no lock and never waits for a reader; readers walk the same chunks with
+    // acquire loads. A thread that exits hands its buffer to the next new thread, so short-lived
+    // workers reuse a handful of tracks.
+    //
+    // Zones count the bytes and allocations reported on their thread while they are open, nested
+    // zones included. Times are on the steady clock, like the GPU profiler's events.
+    class CpuProfiler final
+    {
+    public:
+        CpuProfiler() = delete;
+
+        class Zone final
+        {
+        public:
+            // name has to live until the profile is written, a string literal in practice
+            explicit Zone(const char* name);
+            ~Zone();
+
+            Zone(const Zone&)            = delete;
+            Zone& operator=(const Zone&) = delete;
+            Zone(Zone&&)                 = delete;
+            Zone& operator=(Zone&&)      = delete;
+
+        private:
+            const char* name;
+            int64_t     begin_ns;
+            uint64_t    bytes;
+            uint64_t    allocations;
+        };
+
+        static void add_bytes(uint64_t bytes);
+        static void add_allocation();
+
+        [[nodiscard]] static int64_t now_ns();
+
+        // Zones of every thread that ended at or after since_ns
+        [[nodiscard]] static std::vector<TraceEvent> collect(int64_t since_ns = std::numeric_limits<int64_t>::min());
+
+        // NAME.trace.json and NAME.json with every zone recorded so far
+        static void flush(const std::string& name);
+
+    private:
+        struct Record final
+        {
+            const char* name;
+            int64_t     begin_ns;
+            int64_t     end_ns;
+            uint64_t    bytes;
+            uint64_t    allocations;
+        };
+
+        struct Chunk final
+        {
+            static constexpr uint32_t capacity{ 1024 };
+
+            std::array<Record, capacity> records;
+            std::atomic<uint32_t>        count{ 0 };
+            std::atomic<Chunk*>          next{ nullptr };
+        };
+
+        struct ThreadBuffer final
+        {
+            Chunk                      first;
+            Chunk*                     last{ &first }; // only touched by the owning thread
+            std::atomic<bool>          in_use{ true };
+            std::atomic<ThreadBuffer*> next{ nullptr };
+            uint32_t                   index{ 0 };
+        };
+
+        // Releases the thread's buffer for reuse when the thread exits
+        struct Owner final
+        {
+            ThreadBuffer* buffer{ nullptr };
+            ~Owner();
+        };
+
+        static void record(const Record& record);
+        [[nodiscard]] static ThreadBuffer& thread_buffer();
+
+        // Buffers live until the process exits, as readers may still walk them
+        static std::atomic<ThreadBuffer*> buffers;
+        static std::atomic<uint32_t>      buffer_count;
+
+        static thread_local Owner    owner;
+        static thread_local uint64_t thread_bytes;
+        static thread_local uint64_t thread_allocations;
+    };
+}
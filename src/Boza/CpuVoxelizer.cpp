@@ -0,0 +1,506 @@
+#include "CpuVoxelizer.hpp"
+#include "CpuProfiler.hpp"
+#include "Logger.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BOZA_CPU_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define BOZA_CPU_NEON 1
+#include <arm_neon.h>
+#endif
+
+// This file is compiled with -ffp-contract=off (see CMakeLists.txt): every product and sum
+// below is rounded on its own, in the same order as the precise expressions in the shaders.
+
+namespace boza
+{
+    namespace
+    {
+        // Depth of the Z-slabs handed out to the worker threads. A slab owns all of its rows
+        // in the occupancy grid, so no two threads ever write the same word.
+        constexpr uint32_t slab_depth = 4;
+
+        // Voxels per call of a row kernel
+        constexpr uint32_t row_lanes = 8;
+
+        // Tests the voxels x0 .. x0 + 7 of row (y, z) against the x-dependent part of
+        // triangle_overlaps_voxel: the plane and the xy and zx edge functions. Bit i is set
+        // when voxel x0 + i passes. The bounds and the yz edges are checked once per row.
+        using RowKernel = uint32_t (*)(const TriangleSetup& setup, float y, float z, float x0);
+
+        uint32_t row_kernel_scalar(const TriangleSetup& setup, const float y, const float z, const float x0)
+        {
+            const float ny = setup.normal.y * y;
+            const float nz = setup.normal.z * z;
+
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i < row_lanes; ++i)
+            {
+                const float x     = x0 + static_cast<float>(i);
+                const float np    = setup.normal.x * x + ny + nz;
+                const float plane = (np + setup.bounds_min.w) * (np + setup.bounds_max.w);
+                if (plane > 0.0f) continue;
+
+                bool inside = true;
+                for (uint32_t e = 0; e < 3 && inside; ++e)
+                {
+                    const glm::vec4& xy = setup.edges_xy[e];
+                    const glm::vec4& zx = setup.edges_zx[e];
+                    inside = !(xy.x * x + xy.y * y + xy.z < 0.0f) && !(zx.x * z + zx.y * x + zx.z < 0.0f);
+                }
+
+                if (inside) mask |= 1u << i;
+            }
+
+            return mask;
+        }
+
+#if BOZA_CPU_AVX2
+        __attribute__((target("avx2")))
+        uint32_t row_kernel_avx2(const TriangleSetup& setup, const float y, const float z, const float x0)
+        {
+            const __m256 zero = _mm256_setzero_ps();
+            const __m256 x    = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+
+            __m256 np = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(setup.normal.x), x), _mm256_set1_ps(setup.normal.y * y));
+            np        = _mm256_add_ps(np, _mm256_set1_ps(setup.normal.z * z));
+
+            const __m256 plane = _mm256_mul_ps(_mm256_add_ps(np, _mm256_set1_ps(setup.bounds_min.w)),
+                                               _mm256_add_ps(np, _mm256_set1_ps(setup.bounds_max.w)));
+
+            // Unordered predicates keep NaN lanes, as the `> 0.0` and `< 0.0` rejections in GLSL do
+            __m256 pass = _mm256_cmp_ps(plane, zero, _CMP_NGT_UQ);
+
+            for (uint32_t e = 0; e < 3; ++e)
+            {
+                const glm::vec4& xy = setup.edges_xy[e];
+                const glm::vec4& zx = setup.edges_zx[e];
+
+                const __m256 xy_value = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(xy.x), x), _mm256_set1_ps(xy.y * y)),
+                    _mm256_set1_ps(xy.z));
+                const __m256 zx_value = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_set1_ps(zx.x * z), _mm256_mul_ps(_mm256_set1_ps(zx.y), x)),
+                    _mm256_set1_ps(zx.z));
+
+                pass = _mm256_and_ps(pass, _mm256_cmp_ps(xy_value, zero, _CMP_NLT_UQ));
+                pass = _mm256_and_ps(pass, _mm256_cmp_ps(zx_value, zero, _CMP_NLT_UQ));
+            }
+
+            return static_cast<uint32_t>(_mm256_movemask_ps(pass));
+        }
+#endif
+
+#if BOZA_CPU_NEON
+        uint32_t row_kernel_neon_half(const TriangleSetup& setup, const float y, const float z, const float x0)
+        {
+            const float32x4_t zero    = vdupq_n_f32(0.0f);
+            const float       ramp[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+            const float32x4_t x       = vaddq_f32(vdupq_n_f32(x0), vld1q_f32(ramp));
+
+            float32x4_t np = vaddq_f32(vmulq_f32(vdupq_n_f32(setup.normal.x), x), vdupq_n_f32(setup.normal.y * y));
+            np             = vaddq_f32(np, vdupq_n_f32(setup.normal.z * z));
+
+            const float32x4_t plane = vmulq_f32(vaddq_f32(np, vdupq_n_f32(setup.bounds_min.w)),
+                                                vaddq_f32(np, vdupq_n_f32(setup.bounds_max.w)));
+
+            // Ordered compares are false for NaN, so the complement keeps NaN lanes like GLSL does
+            uint32x4_t pass = vmvnq_u32(vcgtq_f32(plane, zero));
+
+            for (uint32_t e = 0; e < 3; ++e)
+            {
+                const glm::vec4& xy = setup.edges_xy[e];
+                const glm::vec4& zx = setup.edges_zx[e];
+
+                const float32x4_t xy_value = vaddq_f32(
+                    vaddq_f32(vmulq_f32(vdupq_n_f32(xy.x), x), vdupq_n_f32(xy.y * y)),
+                    vdupq_n_f32(xy.z));
+                const float32x4_t zx_value = vaddq_f32(
+                    vaddq_f32(vdupq_n_f32(zx.x * z), vmulq_f32(vdupq_n_f32(zx.y), x)),
+                    vdupq_n_f32(zx.z));
+
+                pass = vbicq_u32(pass, vcltq_f32(xy_value, zero));
+                pass = vbicq_u32(pass, vcltq_f32(zx_value, zero));
+            }
+
+            const uint32_t bits[4] = { 1, 2, 4, 8 };
+            return vaddvq_u32(vandq_u32(pass, vld1q_u32(bits)));
+        }
+
+        uint32_t row_kernel_neon(const TriangleSetup& setup, const float y, const float z, const float x0)
+        {
+            return row_kernel_neon_half(setup, y, z, x0) | row_kernel_neon_half(setup, y, z, x0 + 4.0f) << 4;
+        }
+#endif
+
+        struct RowKernelInfo final
+        {
+            RowKernel        kernel;
+            std::string_view name;
+        };
+
+        RowKernelInfo select_row_kernel()
+        {
+#if BOZA_CPU_AVX2
+            if (__builtin_cpu_supports("avx2")) return { row_kernel_avx2, "AVX2" };
+#elif BOZA_CPU_NEON
+            return { row_kernel_neon, "NEON" };
+#endif
+            return { row_kernel_scalar, "scalar" };
+        }
+
+        // Voxels p kept by the bounds test of triangle_overlaps_voxel, min <= p + 1 and p <= max,
+        // clamped to the grid. Same as the loop range of voxelize_triangles.comp.
+        bool voxel_range(const float min, const float max, const uint32_t size, uint32_t& first, uint32_t& last)
+        {
+            const float lo = std::ceil(min) - 1.0f;
+            const float hi = std::floor(max);
+            if (!(lo <= hi) || hi < 0.0f || lo >= static_cast<float>(size)) return false;
+
+            first = static_cast<uint32_t>(std::max(lo, 0.0f));
+            last  = static_cast<uint32_t>(std::min(hi, static_cast<float>(size - 1)));
+            return true;
+        }
+
+        // Rows whose voxel center lies within [min, max], as solid_flip.comp computes them
+        bool center_range(const float min, const float max, const uint32_t size, uint32_t& first, uint32_t& last)
+        {
+            const float lo = std::ceil(min - 0.5f);
+            const float hi = std::floor(max - 0.5f);
+            if (!(lo <= hi) || hi < 0.0f || lo >= static_cast<float>(size)) return false;
+
+            first = static_cast<uint32_t>(std::max(lo, 0.0f));
+            last  = static_cast<uint32_t>(std::min(hi, static_cast<float>(size - 1)));
+            return true;
+        }
+
+        glm::vec4 edge_equation(const float ex, const float ey, const float vx, const float vy, const float orientation)
+        {
+            const float nx = -ey * orientation;
+            const float ny = ex * orientation;
+            const float d  = -(nx * vx + ny * vy) + std::max(0.0f, nx) + std::max(0.0f, ny);
+            return { nx, ny, d, 0.0f };
+        }
+
+        // Edge function of the yz projection, the only part of the SAT constant along a row
+        bool passes_yz_edges(const TriangleSetup& setup, const float y, const float z)
+        {
+            for (const glm::vec4& edge : setup.edges_yz)
+                if (edge.x * y + edge.y * z + edge.z < 0.0f) return false;
+            return true;
+        }
+
+        bool covers(const float e, const float edge_x, const float edge_y)
+        {
+            return e > 0.0f || (e == 0.0f && (edge_y > 0.0f || (edge_y == 0.0f && edge_x > 0.0f)));
+        }
+
+        struct SlabContext final
+        {
+            const std::vector<TriangleSetup>& setups;
+            const std::vector<uint32_t>&      slab_offsets;
+            const std::vector<uint32_t>&      slab_triangles;
+            glm::uvec3                        extent;
+            VoxelTile                         tile;
+            uint32_t                          words_per_row;
+            bool                              solid;
+            RowKernel                         kernel;
+            std::vector<uint32_t>&            occupancy;
+        };
+
+        // x0 is not word aligned, so the mask can spill into the next word, but never past the row
+        void or_row_bits(uint32_t* row, const uint32_t x0, const uint32_t mask, const uint32_t words_per_row)
+        {
+            const uint32_t shift = x0 & 31;
+            row[x0 >> 5] |= mask << shift;
+            if (shift != 0 && (mask >> (32 - shift)) != 0 && (x0 >> 5) + 1 < words_per_row)
+                row[(x0 >> 5) + 1] |= mask >> (32 - shift);
+        }
+
+        // The padding bits past width in the last word stay clear, like in the occupancy grid
+        void flip_row(uint32_t* row, const uint32_t first_x, const uint32_t width)
+        {
+            const uint32_t words = (width + 31) >> 5;
+            for (uint32_t word = first_x >> 5; word < words; ++word)
+            {
+                uint32_t mask = word == first_x >> 5 ? 0xFFFFFFFFu << (first_x & 31) : 0xFFFFFFFFu;
+                if (word == words - 1 && (width & 31) != 0) mask &= (1u << (width & 31)) - 1;
+                row[word] ^= mask;
+            }
+        }
+
+        void mark_surface(const SlabContext& ctx, const TriangleSetup& setup, const uint32_t z_begin, const uint32_t z_end)
+        {
+            uint32_t x_first, x_last, y_first, y_last, z_first, z_last;
+            if (!voxel_range(setup.bounds_min.x, setup.bounds_max.x, ctx.extent.x, x_first, x_last) ||
+                !voxel_range(setup.bounds_min.y, setup.bounds_max.y, ctx.extent.y, y_first, y_last) ||
+                !voxel_range(setup.bounds_min.z, setup.bounds_max.z, ctx.extent.z, z_first, z_last))
+                return;
+
+            for (uint32_t z = std::max(z_first, z_begin); z <= std::min(z_last, z_end - 1); ++z)
+            {
+                for (uint32_t y = y_first; y <= y_last; ++y)
+                {
+                    const float fy = static_cast<float>(y);
+                    const float fz = static_cast<float>(z);
+                    if (!passes_yz_edges(setup, fy, fz)) continue;
+
+                    uint32_t* row = ctx.occupancy.data() +
+                                    (static_cast<size_t>(z - ctx.tile.first) * ctx.extent.y + y) * ctx.words_per_row;
+                    for (uint32_t x0 = x_first; x0 <= x_last; x0 += row_lanes)
+                    {
+                        uint32_t mask = ctx.kernel(setup, fy, fz, static_cast<float>(x0));
+                        if (x_last - x0 < row_lanes - 1) mask &= (1u << (x_last - x0 + 1)) - 1;
+                        if (mask != 0) or_row_bits(row, x0, mask, ctx.words_per_row);
+                    }
+                }
+            }
+        }
+
+        // Same walk as solid_flip.comp, into the slab-local solid rows and parities
+        void flip_solid(const SlabContext& ctx, const TriangleSetup& setup, const uint32_t z_begin, const uint32_t z_end,
+                        std::vector<uint32_t>& solid, std::vector<uint32_t>& parity)
+        {
+            const glm::vec4& n = setup.normal;
+            if (n.x == 0.0f) return;
+
+            const std::array<glm::vec4, 3> v{ setup.v0, setup.v1, setup.v2 };
+
+            const float orientation = n.x > 0.0f ? 1.0f : -1.0f;
+            std::array<glm::vec2, 3> edges{};
+            for (uint32_t i = 0; i < 3; ++i)
+            {
+                const glm::vec4& a = v[i];
+                const glm::vec4& b = v[(i + 1) % 3];
+                edges[i]           = { (b.y - a.y) * orientation, (b.z - a.z) * orientation };
+            }
+
+            uint32_t y_first, y_last, z_first, z_last;
+            if (!center_range(setup.bounds_min.y, setup.bounds_max.y, ctx.extent.y, y_first, y_last) ||
+                !center_range(setup.bounds_min.z, setup.bounds_max.z, ctx.extent.z, z_first, z_last))
+                return;
+
+            for (uint32_t z = std::max(z_first, z_begin); z <= std::min(z_last, z_end - 1); ++z)
+            {
+                for (uint32_t y = y_first; y <= y_last; ++y)
+                {
+                    const float py = static_cast<float>(y) + 0.5f;
+                    const float pz = static_cast<float>(z) + 0.5f;
+
+                    bool inside = true;
+                    for (uint32_t i = 0; i < 3 && inside; ++i)
+                    {
+                        const float dy = py - v[i].y;
+                        const float dz = pz - v[i].z;
+                        const float e  = edges[i].x * dz - edges[i].y * dy;
+                        inside         = covers(e, edges[i].x, edges[i].y);
+                    }
+
+                    if (!inside) continue;
+
+                    const size_t row = static_cast<size_t>(z - z_begin) * ctx.extent.y + y;
+                    parity[row] ^= 1u;
+
+                    const float crossing = v[0].x - (n.y * (py - v[0].y) + n.z * (pz - v[0].z)) / n.x;
+                    const float first_x  = std::floor(crossing - 0.5f) + 1.0f;
+                    if (first_x < static_cast<float>(ctx.extent.x))
+                        flip_row(solid.data() + row * ctx.words_per_row,
+                                 static_cast<uint32_t>(std::max(first_x, 0.0f)), ctx.extent.x);
+                }
+            }
+        }
+
+        void voxelize_slab(const SlabContext& ctx, const uint32_t slab, std::vector<uint32_t>& solid,
+                           std::vector<uint32_t>& parity)
+        {
+            const uint32_t z_begin = ctx.tile.first + slab * slab_depth;
+            const uint32_t z_end   = std::min(z_begin + slab_depth, ctx.tile.first + ctx.tile.depth);
+
+            if (ctx.solid)
+            {
+                std::ranges::fill(solid, 0u);
+                std::ranges::fill(parity, 0u);
+            }
+
+            for (uint32_t i = ctx.slab_offsets[slab]; i < ctx.slab_offsets[slab + 1]; ++i)
+            {
+                const TriangleSetup& setup = ctx.setups[ctx.slab_triangles[i]];
+                mark_surface(ctx, setup, z_begin, z_end);
+                if (ctx.solid) flip_solid(ctx, setup, z_begin, z_end, solid, parity);
+            }
+
+            if (!ctx.solid) return;
+
+            // Resolve as solid_resolve.comp does: rows with an odd number of crossings keep the surface only
+            for (uint32_t z = z_begin; z < z_end; ++z)
+            {
+                for (uint32_t y = 0; y < ctx.extent.y; ++y)
+                {
+                    const size_t row = static_cast<size_t>(z - z_begin) * ctx.extent.y + y;
+                    if ((parity[row] & 1u) != 0) continue;
+
+                    uint32_t*       dst = ctx.occupancy.data() +
+                                          (static_cast<size_t>(z - ctx.tile.first) * ctx.extent.y + y) * ctx.words_per_row;
+                    const uint32_t* src = solid.data() + row * ctx.words_per_row;
+                    for (uint32_t word = 0; word < ctx.words_per_row; ++word)
+                        dst[word] |= src[word];
+                }
+            }
+        }
+    }
+
+
+    TriangleSetup CpuVoxelizer::setup_triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+    {
+        const std::array<glm::vec3, 3> v{ v0, v1, v2 };
+        const std::array<glm::vec3, 3> e{ v1 - v0, v2 - v1, v0 - v2 };
+
+        const glm::vec3 n{
+            e[0].y * e[1].z - e[0].z * e[1].y,
+            e[0].z * e[1].x - e[0].x * e[1].z,
+            e[0].x * e[1].y - e[0].y * e[1].x
+        };
+
+        // Critical point: the box corner furthest along the normal
+        const glm::vec3 c{ n.x > 0.0f ? 1.0f : 0.0f, n.y > 0.0f ? 1.0f : 0.0f, n.z > 0.0f ? 1.0f : 0.0f };
+        const glm::vec3 c1 = c - v0;
+        const glm::vec3 c2 = (1.0f - c) - v0;
+        const float     d1 = n.x * c1.x + n.y * c1.y + n.z * c1.z;
+        const float     d2 = n.x * c2.x + n.y * c2.y + n.z * c2.z;
+
+        const float xy_orientation = n.z >= 0.0f ? 1.0f : -1.0f;
+        const float yz_orientation = n.x >= 0.0f ? 1.0f : -1.0f;
+        const float zx_orientation = n.y >= 0.0f ? 1.0f : -1.0f;
+
+        TriangleSetup setup{};
+        setup.bounds_min = glm::vec4(glm::min(v0, glm::min(v1, v2)), d1);
+        setup.bounds_max = glm::vec4(glm::max(v0, glm::max(v1, v2)), d2);
+        setup.normal     = glm::vec4(n, 0.0f);
+
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            setup.edges_xy[i] = edge_equation(e[i].x, e[i].y, v[i].x, v[i].y, xy_orientation);
+            setup.edges_yz[i] = edge_equation(e[i].y, e[i].z, v[i].y, v[i].z, yz_orientation);
+            setup.edges_zx[i] = edge_equation(e[i].z, e[i].x, v[i].z, v[i].x, zx_orientation);
+        }
+
+        setup.v0 = glm::vec4(v0, 0.0f);
+        setup.v1 = glm::vec4(v1, 0.0f);
+        setup.v2 = glm::vec4(v2, 0.0f);
+        return setup;
+    }
+
+    std::vector<uint32_t> CpuVoxelizer::voxelize(const MeshData& mesh_data, const VoxelGrid& grid, const VoxelTile& tile,
+                                                 const bool solid)
+    {
+        PROFILE_ZONE("CPU voxelize");
+        const auto start = std::chrono::steady_clock::now();
+
+        const glm::uvec3 extent         = grid.extent;
+        const uint32_t   words_per_row  = (extent.x + 31) / 32;
+        const uint32_t   triangle_count = static_cast<uint32_t>(mesh_data.indices.size() / 3);
+        const uint32_t   slab_count     = (tile.depth + slab_depth - 1) / slab_depth;
+        const uint32_t   thread_count   = std::clamp(parallel_thread_count(), 1u, std::max(slab_count, 1u));
+
+        // Spelled out instead of VoxelGrid::to_voxel_space, so that the multiply and add are
+        // rounded separately no matter how the inline copy elsewhere was compiled
+        const float voxel_scale  = grid.voxel_scale();
+        const float voxel_offset = grid.voxel_offset();
+        const auto  load_vertex  = [&](const size_t index)
+        {
+            const glm::vec4& vertex = mesh_data.vertices[mesh_data.indices[index]];
+            return glm::vec3{
+                vertex.x * voxel_scale + voxel_offset,
+                vertex.y * voxel_scale + voxel_offset,
+                vertex.z * voxel_scale + voxel_offset
+            };
+        };
+
+        std::vector<TriangleSetup> setups(triangle_count);
+        constexpr uint32_t setup_chunk = 4096;
+        parallel_for((triangle_count + setup_chunk - 1) / setup_chunk, thread_count, [&](const uint32_t chunk)
+        {
+            const uint32_t end = std::min((chunk + 1) * setup_chunk, triangle_count);
+            for (uint32_t t = chunk * setup_chunk; t < end; ++t)
+                setups[t] = setup_triangle(load_vertex(t * 3 + 0), load_vertex(t * 3 + 1), load_vertex(t * 3 + 2));
+        });
+
+        // Slab lists by count, exclusive prefix sum, scatter, as in TriangleBinner
+        std::vector<std::pair<uint32_t, uint32_t>> slab_ranges(triangle_count, { 1, 0 });
+        std::vector<uint32_t>                      slab_offsets(slab_count + 1, 0);
+        for (uint32_t t = 0; t < triangle_count; ++t)
+        {
+            uint32_t z_first, z_last;
+            if (!voxel_range(setups[t].bounds_min.z, setups[t].bounds_max.z, extent.z, z_first, z_last)) continue;
+            if (z_last < tile.first || z_first >= tile.first + tile.depth) continue;
+
+            z_first        = std::max(z_first, tile.first) - tile.first;
+            z_last         = std::min(z_last, tile.first + tile.depth - 1) - tile.first;
+            slab_ranges[t] = { z_first / slab_depth, z_last / slab_depth };
+            for (uint32_t s = slab_ranges[t].first; s <= slab_ranges[t].second; ++s)
+                ++slab_offsets[s + 1];
+        }
+
+        std::inclusive_scan(slab_offsets.begin(), slab_offsets.end(), slab_offsets.begin());
+
+        std::vector<uint32_t> slab_triangles(slab_offsets.back());
+        std::vector<uint32_t> cursors(slab_offsets.begin(), slab_offsets.end() - 1);
+        for (uint32_t t = 0; t < triangle_count; ++t)
+            for (uint32_t s = slab_ranges[t].first; s <= slab_ranges[t].second; ++s)
+                slab_triangles[cursors[s]++] = t;
+
+        const RowKernelInfo row_kernel = select_row_kernel();
+
+        std::vector<uint32_t> occupancy(static_cast<size_t>(words_per_row) * extent.y * tile.depth, 0);
+        const SlabContext     context{
+            setups, slab_offsets, slab_triangles, extent, tile, words_per_row, solid, row_kernel.kernel, occupancy
+        };
+
+        std::atomic<uint32_t> next_slab{ 0 };
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(thread_count);
+            for (uint32_t t = 0; t < thread_count; ++t)
+                workers.emplace_back([&]
+                {
+                    std::vector<uint32_t> solid_rows(solid ? static_cast<size_t>(slab_depth) * extent.y * words_per_row : 0);
+                    std::vector<uint32_t> parity(solid ? static_cast<size_t>(slab_depth) * extent.y : 0);
+
+                    for (uint32_t slab = next_slab.fetch_add(1); slab < slab_count; slab = next_slab.fetch_add(1))
+                        voxelize_slab(context, slab, solid_rows, parity);
+                });
+        }
+
+        const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        Logger::info("Voxelized {} triangles on the CPU in {:.2f} ms ({}, {} threads)",
+                     triangle_count, elapsed.count(), row_kernel.name, thread_count);
+
+        return occupancy;
+    }
+
+    std::vector<uint8_t> CpuVoxelizer::expand_to_rgba8(const std::span<const uint32_t> words, const glm::uvec3& extent)
+    {
+        constexpr std::array<uint8_t, 4> filled_voxel{ 255, 0, 0, 255 };
+
+        const uint32_t       words_per_row = (extent.x + 31) / 32;
+        std::vector<uint8_t> rgba(static_cast<size_t>(extent.x) * extent.y * extent.z * 4, 0);
+
+        for (size_t row = 0; row < static_cast<size_t>(extent.y) * extent.z; ++row)
+        {
+            for (uint32_t x = 0; x < extent.x; ++x)
+            {
+                if ((words[row * words_per_row + (x >> 5)] & 1u << (x & 31)) == 0) continue;
+                std::ranges::copy(filled_voxel, rgba.begin() + static_cast<std::ptrdiff_t>((row * extent.x + x) * 4));
+            }
+        }
+
+        return rgba;
+    }
+
+    std::string_view CpuVoxelizer::instruction_set()
+    {
+        return select_row_kernel().name;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "pch.hpp"
+#include "TriangleLoader.hpp"
+#include "TriangleSetup.hpp"
+#include "VoxelGrid.hpp"
+
+namespace boza
+{
+    // Voxelization without a GPU, making the same decisions as the Vulkan path bit for bit:
+    // triangle_setup.comp and triangle_overlaps_voxel for the surface, solid_flip.comp and
+    // solid_resolve.comp for the interior. Runs over Z-slabs on all hardware threads and
+    // tests eight voxels along x at once with AVX2 or NEON when the CPU has them.
+    class CpuVoxelizer final
+    {
+    public:
+        CpuVoxelizer() = delete;
+
+        // Bit-packed occupancy of the tile laid out like App's occupancy image: bit x & 31 of
+        // word ((z - tile.first) * height + y) * words_per_row + x / 32
+        static std::vector<uint32_t> voxelize(const MeshData& mesh_data, const VoxelGrid& grid, const VoxelTile& tile,
+                                              bool solid);
+
+        // The values triangle_setup.comp writes for a triangle given in voxel units
+        static TriangleSetup setup_triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+
+        // The rgba8 volume expand_occupancy.comp produces from the same grid
+        static std::vector<uint8_t> expand_to_rgba8(std::span<const uint32_t> words, const glm::uvec3& extent);
+
+        // Instruction set the voxel test runs with on this machine
+        static std::string_view instruction_set();
+    };
+}
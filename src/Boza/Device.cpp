@@ -17,7 +17,21 @@
                 *logical_device, vkGetDeviceProcAddr
             };
 
-            compute_queue = logical_device->getQueue(compute_queue_family_index, 0);
+            std::vector<QueueScheduler::Queue> scheduled_queues;
+            for (uint32_t i = 0; i < compute_queue_count; ++i)
+            {
+                compute_queues.push_back(logical_device->getQueue(compute_queue_family_index, i));
+                scheduled_queues.push_back({ compute_queues.back(), compute_queue_family_index });
+            }
+
+            std::optional<QueueScheduler::Queue> transfer_queue;
+            if (transfer_queue_family_index)
+                transfer_queue = QueueScheduler::Queue{ logical_device->getQueue(*transfer_queue_family_index, 0),
+                                                        *transfer_queue_family_index };
+
+            allocator = std::make_unique<MemoryAllocator>(physical_device, *logical_device);
+            scheduler = std::make_unique<QueueScheduler>(*logical_device, scheduled_queues, transfer_queue);
+            if (!*scheduler) ok = false;
         }
 
         Device::~Device()
@@ -28,11 +42,19 @@
 
         Device::Device(Device&& other) noexcept
         {
-            logical_device             = std::move(other.logical_device);
-            physical_device            = std::move(other.physical_device);
-            compute_queue              = std::move(other.compute_queue);
-            compute_queue_family_index = std::exchange(other.compute_queue_family_index, 0);
-            ok                         = std::exchange(other.ok, false);
+            scheduler                        = std::move(other.scheduler);
+            allocator                        = std::move(other.allocator);
+            logical_device                   = std::move(other.logical_device);
+            physical_device                  = std::move(other.physical_device);
+            compute_queues                   = std::move(other.compute_queues);
+            compute_queue_family_index       = std::exchange(other.compute_queue_family_index, 0);
+            compute_queue_count              = std::exchange(other.compute_queue_count, 1);
+            transfer_queue_family_index      = std::exchange(other.transfer_queue_family_index, std::nullopt);
+            queue_family_indices             = std::move(other.queue_family_indices);
+            pipeline_creation_feedback       = std::exchange(other.pipeline_creation_feedback, false);
+            storage_buffer_update_after_bind = std::exchange(other.storage_buffer_update_after_bind, false);
+            subgroup_arithmetic              = std::exchange(other.subgroup_arithmetic, false);
+            ok                               = std::exchange(other.ok, false);
 
             if (logical_device) vk::defaultDispatchLoaderDynamic.init(*logical_device);
         }
@@ -41,11 +63,19 @@
         {
             if (this != &other)
             {
-                logical_device             = std::move(other.logical_device);
-                physical_device            = std::move(other.physical_device);
-                compute_queue              = std::move(other.compute_queue);
-                compute_queue_family_index = std::exchange(other.compute_queue_family_index, 0);
-                ok                         = std::exchange(other.ok, false);
+                scheduler                        = std::move(other.scheduler);
+                allocator                        = std::move(other.allocator);
+                logical_device                   = std::move(other.logical_device);
+                physical_device                  = std::move(other.physical_device);
+                compute_queues                   = std::move(other.compute_queues);
+                compute_queue_family_index       = std::exchange(other.compute_queue_family_index, 0);
+                compute_queue_count              = std::exchange(other.compute_queue_count, 1);
+                transfer_queue_family_index      = std::exchange(other.transfer_queue_family_index, std::nullopt);
+                queue_family_indices             = std::move(other.queue_family_indices);
+                pipeline_creation_feedback       = std::exchange(other.pipeline_creation_feedback, false);
+                storage_buffer_update_after_bind = std::exchange(other.storage_buffer_update_after_bind, false);
+                subgroup_arithmetic              = std::exchange(other.subgroup_arithmetic, false);
+                ok                               = std::exchange(other.ok, false);
             }
 
             if (logical_device) vk::defaultDispatchLoaderDynamic.init(*logical_device);
@@ -77,15 +107,35 @@
 
             for (const auto& device : physical_devices)
             {
+                // Readbacks are tracked with timeline semaphores, core since Vulkan 1.2
+                if (!supports_timeline_semaphores(device))
+                {
+                    Logger::trace("Skipping {}, it has no timeline semaphores", device.getProperties().deviceName.data());
+                    continue;
+                }
+
+                // The compute family with the most queues, tiles are spread over all of them, and a
+                // family that transfers and nothing else. Tiles copy any number of layers, so the
+                // transfer family has to copy images texel by texel, or the copies stay on compute
                 bool       suitable   = false;
                 const auto properties = device.getQueueFamilyProperties();
+                compute_queue_count = 0;
+                transfer_queue_family_index.reset();
                 for (uint32_t i = 0; i < properties.size(); ++i)
                 {
-                    if (properties[i].queueFlags & vk::QueueFlagBits::eCompute)
+                    const vk::QueueFlags flags = properties[i].queueFlags;
+                    if (flags & vk::QueueFlagBits::eCompute && properties[i].queueCount >= compute_queue_count)
                     {
                         suitable = true;
                         compute_queue_family_index = i;
+                        compute_queue_count        = properties[i].queueCount;
                     }
+
+                    if (flags & vk::QueueFlagBits::eTransfer &&
+                        !(flags & (vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eGraphics)) &&
+                        properties[i].queueCount > 0 && !transfer_queue_family_index &&
+                        properties[i].minImageTransferGranularity == vk::Extent3D{ 1, 1, 1 })
+                        transfer_queue_family_index = i;
                 }
 
                 #ifndef NDEBUG
@@ -100,7 +150,15 @@
                 if (suitable)
                 {
                     physical_device = device;
+                    queue_family_indices = { compute_queue_family_index };
+                    if (transfer_queue_family_index) queue_family_indices.push_back(*transfer_queue_family_index);
+
                     Logger::trace("A suitable device is chosen - {}", device.getProperties().deviceName.data());
+                    Logger::trace("{} compute queue{} in family {}, {}", compute_queue_count,
+                                  compute_queue_count > 1 ? "s" : "", compute_queue_family_index,
+                                  transfer_queue_family_index
+                                      ? std::format("transfer queue in family {}", *transfer_queue_family_index)
+                                      : std::string{ "no dedicated transfer queue" });
                     Logger::trace("Max compute work group invocations - {}", device.getProperties().limits.maxComputeWorkGroupInvocations);
                     return true;
                 }
@@ -111,27 +169,68 @@
             return false;
         }
 
+        bool Device::supports_timeline_semaphores(const vk::PhysicalDevice& device)
+        {
+            if (device.getProperties().apiVersion < VK_API_VERSION_1_2) return false;
+
+            const auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+            return features.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore;
+        }
+
 
         bool Device::create_logical_device()
         {
-            constexpr float queue_priority = 1.0f;
+            // Tiles on every compute queue are equally urgent
+            const std::vector queue_priorities(compute_queue_count, 1.0f);
 
-            vk::DeviceQueueCreateInfo queue_create_info
+            std::vector<vk::DeviceQueueCreateInfo> queue_create_infos
             {
-                {},
-                compute_queue_family_index,
-                1, &queue_priority
+                { {}, compute_queue_family_index, compute_queue_count, queue_priorities.data() }
             };
 
+            if (transfer_queue_family_index)
+                queue_create_infos.push_back({ {}, *transfer_queue_family_index, 1, queue_priorities.data() });
+
             vk::PhysicalDeviceFeatures device_features = physical_device.getFeatures();
 
+            vk::PhysicalDeviceVulkan12Features vulkan12_features{};
+            vulkan12_features.timelineSemaphore = VK_TRUE;
+
+            // Optional, lets recorded tiles be resubmitted for the next mesh, see App::voxelize_pipelined
+            const auto supported = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+            storage_buffer_update_after_bind = supported.get<vk::PhysicalDeviceVulkan12Features>()
+                                                        .descriptorBindingStorageBufferUpdateAfterBind;
+            vulkan12_features.descriptorBindingStorageBufferUpdateAfterBind = storage_buffer_update_after_bind;
+
+            // Vulkan 1.1 only guarantees basic subgroup operations, arithmetic has to be reported
+            // for compute shaders before voxelize_voxels.comp can sum its stats with subgroupAdd
+            const auto subgroup = physical_device.getProperties2<vk::PhysicalDeviceProperties2,
+                                                                 vk::PhysicalDeviceSubgroupProperties>()
+                                                 .get<vk::PhysicalDeviceSubgroupProperties>();
+            subgroup_arithmetic = (subgroup.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic) &&
+                                  (subgroup.supportedStages & vk::ShaderStageFlagBits::eCompute);
+
+            // Optional, only used to tell pipeline cache hits from misses
+            std::vector<const char*> extensions;
+            if (auto [ext_result, available] = physical_device.enumerateDeviceExtensionProperties();
+                ext_result == vk::Result::eSuccess)
+            {
+                pipeline_creation_feedback = std::ranges::any_of(available, [](const vk::ExtensionProperties& extension)
+                {
+                    return std::string_view{ extension.extensionName.data() } == VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME;
+                });
+            }
+
+            if (pipeline_creation_feedback) extensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+
             const vk::DeviceCreateInfo device_info
             {
                 {},
-                1, &queue_create_info,
-                0, nullptr,
+                static_cast<uint32_t>(queue_create_infos.size()), queue_create_infos.data(),
                 0, nullptr,
-                &device_features
+                static_cast<uint32_t>(extensions.size()), extensions.data(),
+                &device_features,
+                &vulkan12_features
             };
 
             auto [result, _logical_device] = physical_device.createDeviceUnique(device_info);
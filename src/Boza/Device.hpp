@@ -1,5 +1,7 @@
 #pragma once
 #include "Instance.hpp"
+#include "MemoryAllocator.hpp"
+#include "QueueScheduler.hpp"
 #include "pch.hpp"
 
 namespace boza
@@ -21,19 +23,58 @@ namespace boza
 
         [[nodiscard]] const vk::Device&         get() const { return *logical_device; }
         [[nodiscard]] const vk::PhysicalDevice& get_physical_device() const { return physical_device; }
-        [[nodiscard]] const vk::Queue&          get_compute_queue() const { return compute_queue; }
+        [[nodiscard]] const vk::Queue&          get_compute_queue() const { return compute_queues.front(); }
 
         [[nodiscard]] uint32_t get_compute_queue_family_index() const { return compute_queue_family_index; }
 
+        // A queue of a family that only transfers, which copies on the DMA engines where there are
+        // any. Resources are shared concurrently with its family when the device has one
+        [[nodiscard]] bool     has_transfer_queue() const { return transfer_queue_family_index.has_value(); }
+        [[nodiscard]] uint32_t get_transfer_queue_family_index() const { return transfer_queue_family_index.value_or(compute_queue_family_index); }
+
+        // Families of every queue created, for the sharing mode of buffers and images
+        [[nodiscard]] std::span<const uint32_t> get_queue_family_indices() const { return queue_family_indices; }
+
+        // Shared by every buffer and image created on this device
+        [[nodiscard]] MemoryAllocator& get_allocator() const { return *allocator; }
+
+        // Submits to and tracks all the queues above
+        [[nodiscard]] QueueScheduler& get_scheduler() const { return *scheduler; }
+
+        // Whether VK_EXT_pipeline_creation_feedback is enabled, reporting pipeline cache hits
+        [[nodiscard]] bool has_pipeline_creation_feedback() const { return pipeline_creation_feedback; }
+
+        // Whether storage buffer descriptors can be rewritten without invalidating the command
+        // buffers they are bound in (descriptorBindingStorageBufferUpdateAfterBind)
+        [[nodiscard]] bool has_storage_buffer_update_after_bind() const { return storage_buffer_update_after_bind; }
+
+        // Whether compute shaders support subgroup arithmetic operations such as subgroupAdd
+        [[nodiscard]] bool has_subgroup_arithmetic() const { return subgroup_arithmetic; }
+
     private:
         [[nodiscard]] bool choose_physical_device(const Instance& instance);
         [[nodiscard]] bool create_logical_device();
 
+        [[nodiscard]] static bool supports_timeline_semaphores(const vk::PhysicalDevice& device);
+
         vk::PhysicalDevice physical_device;
         vk::UniqueDevice   logical_device;
 
-        vk::Queue compute_queue;
-        uint32_t  compute_queue_family_index{};
+        // After the device, so all memory is freed before it is destroyed
+        std::unique_ptr<MemoryAllocator> allocator;
+
+        // After the allocator, so pending submissions finish before any memory is freed
+        std::unique_ptr<QueueScheduler> scheduler;
+
+        std::vector<vk::Queue>  compute_queues;
+        uint32_t                compute_queue_family_index{};
+        uint32_t                compute_queue_count{ 1 };
+        std::optional<uint32_t> transfer_queue_family_index;
+        std::vector<uint32_t>   queue_family_indices;
+
+        bool pipeline_creation_feedback{ false };
+        bool storage_buffer_update_after_bind{ false };
+        bool subgroup_arithmetic{ false };
 
         bool ok = false;
     };
@@ -0,0 +1,245 @@
+#include "GpuProfiler.hpp"
+
+#include "Logger.hpp"
+
+namespace boza
+{
+    GpuProfiler::GpuProfiler(const Device& device, CommandPool& command_pool, const uint32_t frame_count)
+        : frames(std::max(frame_count, 1u)), device{ std::cref(device) }, ok{ true }
+    {
+        if (!create_query_pool(static_cast<uint32_t>(frames.size())) || !query_pool) return;
+
+        std::vector<vk::UniqueCommandBuffer> command_buffers = command_pool.allocate_command_buffers(device, 1);
+        if (command_buffers.empty())
+        {
+            ok = false;
+            return;
+        }
+
+        command_buffer = std::move(command_buffers[0]);
+        if (!calibrate()) ok = false;
+    }
+
+
+    GpuProfiler::GpuProfiler(GpuProfiler&& other) noexcept
+    {
+        query_pool        = std::move(other.query_pool);
+        command_buffer    = std::move(other.command_buffer);
+        timestamp_period  = std::exchange(other.timestamp_period, 0.0);
+        timestamp_bits    = std::exchange(other.timestamp_bits, 0);
+        frames            = std::move(other.frames);
+        recording_frame   = std::exchange(other.recording_frame, 0);
+        calibration_ticks = std::exchange(other.calibration_ticks, 0);
+        calibration_ns    = std::exchange(other.calibration_ns, 0);
+        events            = std::move(other.events);
+        ok                = std::exchange(other.ok, false);
+
+        if (other.device) device = std::cref(other.device->get());
+        other.device = std::nullopt;
+    }
+
+    GpuProfiler& GpuProfiler::operator=(GpuProfiler&& other) noexcept
+    {
+        if (this != &other)
+        {
+            query_pool        = std::move(other.query_pool);
+            command_buffer    = std::move(other.command_buffer);
+            timestamp_period  = std::exchange(other.timestamp_period, 0.0);
+            timestamp_bits    = std::exchange(other.timestamp_bits, 0);
+            frames            = std::move(other.frames);
+            recording_frame   = std::exchange(other.recording_frame, 0);
+            calibration_ticks = std::exchange(other.calibration_ticks, 0);
+            calibration_ns    = std::exchange(other.calibration_ns, 0);
+            events            = std::move(other.events);
+            ok                = std::exchange(other.ok, false);
+
+            if (other.device) device = std::cref(other.device->get());
+            other.device = std::nullopt;
+        }
+
+        return *this;
+    }
+
+
+    bool GpuProfiler::calibrate()
+    {
+        if (!query_pool) return true;
+
+        const vk::CommandBuffer& cmd = *command_buffer;
+        if (cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit }) != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to begin profiler calibration");
+            return false;
+        }
+
+        cmd.resetQueryPool(*query_pool, calibration_query(), 1);
+        cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, calibration_query());
+
+        if (cmd.end() != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to end profiler calibration");
+            return false;
+        }
+
+        // Through the scheduler like every other submission, so its timeline stays in step with the queue
+        QueueScheduler& scheduler = device->get().get_scheduler();
+        QueueTicket     ticket;
+
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point submitted = Clock::now();
+        if (!scheduler.submit(0, { &cmd, 1 }, {}, ticket) || !scheduler.wait(ticket))
+        {
+            Logger::error("Failed to run profiler calibration");
+            return false;
+        }
+        const Clock::time_point finished = Clock::now();
+
+        uint64_t ticks = 0;
+        if (device->get().get().getQueryPoolResults(*query_pool, calibration_query(), 1, sizeof(ticks), &ticks,
+                                                    sizeof(uint64_t), vk::QueryResultFlagBits::e64) !=
+            vk::Result::eSuccess)
+        {
+            Logger::error("Failed to read profiler calibration");
+            return false;
+        }
+
+        calibration_ticks = ticks;
+        calibration_ns    = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            (submitted + (finished - submitted) / 2).time_since_epoch()).count();
+        return true;
+    }
+
+    void GpuProfiler::begin_frame(const vk::CommandBuffer& command_buffer, const uint64_t sequence, const uint32_t queue)
+    {
+        if (!query_pool) return;
+
+        recording_frame = static_cast<uint32_t>(sequence % frames.size());
+
+        Frame& frame = frames[recording_frame];
+        frame.names.clear();
+        frame.open.clear();
+        frame.queue    = queue;
+        frame.recorded = true;
+
+        command_buffer.resetQueryPool(*query_pool, recording_frame * max_zones * 2, max_zones * 2);
+    }
+
+    void GpuProfiler::reuse_frame(const uint64_t sequence)
+    {
+        if (!query_pool) return;
+
+        // The zone names are still the ones of the recording
+        frames[sequence % frames.size()].recorded = true;
+    }
+
+    void GpuProfiler::begin_zone(const vk::CommandBuffer& command_buffer, const std::string_view name)
+    {
+        if (!query_pool) return;
+
+        Frame& frame = frames[recording_frame];
+        if (frame.names.size() == max_zones)
+        {
+            // Ended like any other zone, but never timed
+            frame.open.push_back(UINT32_MAX);
+            return;
+        }
+
+        const auto zone = static_cast<uint32_t>(frame.names.size());
+        frame.names.push_back(name);
+        frame.open.push_back(zone);
+
+        command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool,
+                                      (recording_frame * max_zones + zone) * 2);
+    }
+
+    void GpuProfiler::end_zone(const vk::CommandBuffer& command_buffer)
+    {
+        if (!query_pool) return;
+
+        Frame& frame = frames[recording_frame];
+        if (frame.open.empty())
+        {
+            Logger::warn("GPU profiler zone ended without being begun");
+            return;
+        }
+
+        const uint32_t zone = frame.open.back();
+        frame.open.pop_back();
+        if (zone == UINT32_MAX) return;
+
+        command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool,
+                                      (recording_frame * max_zones + zone) * 2 + 1);
+    }
+
+    void GpuProfiler::resolve(const uint64_t sequence)
+    {
+        if (!query_pool) return;
+
+        const uint32_t index = static_cast<uint32_t>(sequence % frames.size());
+        Frame&         frame = frames[index];
+        if (!frame.recorded || frame.names.empty()) return;
+
+        frame.recorded = false;
+        if (!frame.open.empty())
+        {
+            Logger::warn("GPU profiler frame {} has {} zones left open", sequence, frame.open.size());
+            return;
+        }
+
+        std::array<uint64_t, max_zones * 2> ticks{};
+        const auto                          query_count = static_cast<uint32_t>(frame.names.size()) * 2;
+        if (device->get().get().getQueryPoolResults(*query_pool, index * max_zones * 2, query_count,
+                                                    query_count * sizeof(uint64_t), ticks.data(), sizeof(uint64_t),
+                                                    vk::QueryResultFlagBits::e64) != vk::Result::eSuccess)
+        {
+            Logger::warn("Failed to read GPU profiler frame {}", sequence);
+            return;
+        }
+
+        // Frames on different queues run at the same time, so each queue gets a track of its own
+        const std::string frame_track = std::format("{} {}", track, frame.queue);
+        for (size_t zone = 0; zone < frame.names.size(); ++zone)
+        {
+            const int64_t begin = to_host_ns(ticks[zone * 2]);
+            const int64_t end   = to_host_ns(ticks[zone * 2 + 1]);
+            events.push_back({ std::string{ frame.names[zone] }, frame_track, begin,
+                               std::max(end - begin, int64_t{ 0 }) });
+        }
+    }
+
+
+    bool GpuProfiler::create_query_pool(const uint32_t frame_count)
+    {
+        const auto     families = device->get().get_physical_device().getQueueFamilyProperties();
+        const uint32_t bits     = families[device->get().get_compute_queue_family_index()].timestampValidBits;
+        if (bits == 0)
+        {
+            Logger::warn("The compute queue has no timestamps, GPU phases cannot be profiled");
+            return true;
+        }
+
+        // Every frame, then the calibration timestamp
+        const vk::QueryPoolCreateInfo create_info{ {}, vk::QueryType::eTimestamp, frame_count * max_zones * 2 + 1 };
+
+        auto [result, pool] = device->get().get().createQueryPoolUnique(create_info);
+        if (result != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to create profiler query pool");
+            ok = false;
+            return false;
+        }
+
+        query_pool       = std::move(pool);
+        timestamp_bits   = bits;
+        timestamp_period = device->get().get_physical_device().getProperties().limits.timestampPeriod;
+        return true;
+    }
+
+    int64_t GpuProfiler::to_host_ns(const uint64_t ticks) const
+    {
+        // Only the low timestamp_bits count, and the counter may have wrapped since the calibration
+        const uint32_t unused = 64 - timestamp_bits;
+        const int64_t  delta  = static_cast<int64_t>((ticks - calibration_ticks) << unused) >> unused;
+        return calibration_ns + static_cast<int64_t>(static_cast<double>(delta) * timestamp_period);
+    }
+}
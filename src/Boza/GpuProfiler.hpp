@@ -0,0 +1,88 @@
+#pragma once
+#include "pch.hpp"
+#include "CommandPool.hpp"
+#include "Device.hpp"
+#include "TraceWriter.hpp"
+
+namespace boza
+{
+    // Brackets the phases recorded into a command buffer with timestamps. Like the readback ring,
+    // submission n uses frame n % frame_count of the query pool, so several submissions can be in
+    // flight; resolve() reads a frame back once its submission has finished and turns each zone
+    // into a TraceEvent on the host clock.
+    //
+    // The GPU clock is matched to the host one by calibrate(), which submits a lone timestamp and
+    // takes the midpoint of the host times around it. Zones are nested like scopes, and both ends
+    // are taken at the bottom of the pipe, so a zone covers its own commands and whatever the
+    // barriers in it wait for. Without timestamps on the compute queue, every call is a no-op.
+    class GpuProfiler final
+    {
+    public:
+        GpuProfiler(nullptr_t) {}
+        GpuProfiler(const Device& device, CommandPool& command_pool, uint32_t frame_count);
+
+        GpuProfiler(const GpuProfiler&)            = delete;
+        GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+        GpuProfiler(GpuProfiler&& other) noexcept;
+        GpuProfiler& operator=(GpuProfiler&& other) noexcept;
+
+        operator bool () const { return ok; }
+
+        // Waits for the queue, so it belongs between jobs, where it also catches up with clock drift
+        [[nodiscard]] bool calibrate();
+
+        // Starts frame `sequence` in the command buffer of that submission, to compute queue `queue`
+        void begin_frame(const vk::CommandBuffer& command_buffer, uint64_t sequence, uint32_t queue);
+
+        // Frame `sequence` is submitted again with the commands recorded for an earlier frame of
+        // the same index, which reset and write its queries again, to the same queue
+        void reuse_frame(uint64_t sequence);
+
+        // name has to outlive the frame, a string literal in practice
+        void begin_zone(const vk::CommandBuffer& command_buffer, std::string_view name);
+        void end_zone(const vk::CommandBuffer& command_buffer);
+
+        // Adds the zones of frame `sequence` to the events once its submission has finished
+        void resolve(uint64_t sequence);
+
+        [[nodiscard]] std::span<const TraceEvent> get_events() const { return events; }
+        void clear() { events.clear(); }
+
+    private:
+        struct Frame final
+        {
+            std::vector<std::string_view> names;
+            std::vector<uint32_t>         open; // zones begun and not yet ended, innermost last
+            uint32_t                      queue{ 0 }; // of the scheduler, one track per queue
+            bool                          recorded{ false };
+        };
+
+        static constexpr uint32_t         max_zones{ 16 };
+        static constexpr std::string_view track{ "GPU compute queue" };
+
+        [[nodiscard]] bool create_query_pool(uint32_t frame_count);
+
+        // Host nanoseconds of a GPU timestamp, relative to the calibration
+        [[nodiscard]] int64_t to_host_ns(uint64_t ticks) const;
+
+        [[nodiscard]] uint32_t calibration_query() const { return static_cast<uint32_t>(frames.size()) * max_zones * 2; }
+
+        vk::UniqueQueryPool     query_pool{ nullptr };
+        vk::UniqueCommandBuffer command_buffer{ nullptr };
+        double                  timestamp_period{ 0.0 }; // nanoseconds per tick
+        uint32_t                timestamp_bits{ 0 };
+
+        std::vector<Frame> frames;
+        uint32_t           recording_frame{ 0 };
+
+        uint64_t calibration_ticks{ 0 };
+        int64_t  calibration_ns{ 0 };
+
+        std::vector<TraceEvent> events;
+
+        std::optional<std::reference_wrapper<const Device>> device{ std::nullopt };
+
+        bool ok = false;
+    };
+}
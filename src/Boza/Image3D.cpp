@@ -1,19 +1,39 @@
 #include "Image3D.hpp"
 
-#include "Buffer.hpp"
 #include "Logger.hpp"
 
 namespace boza
 {
+    static vk::DeviceSize get_texel_size(const vk::Format format)
+    {
+        switch (format)
+        {
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eR32Uint:
+        case vk::Format::eR32Sfloat:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+
     Image3D::Image3D(
         const Device&       device,
-        CommandPool&  command_pool,
         vk::Format          format,
         vk::Extent3D        extent,
         vk::ImageUsageFlags usage,
         bool                create_view)
-        : extent{ extent }, device{ std::cref(device) }, ok{ true }
+        : extent{ extent }, texel_size{ get_texel_size(format) }, device{ std::cref(device) }, ok{ true }
     {
+        if (texel_size == 0)
+        {
+            Logger::error("Unsupported 3D image format {}", to_string(format));
+            ok = false;
+            return;
+        }
+
+        // Concurrent when there is a transfer queue, which copies tiles out of the images
+        const std::span<const uint32_t> families = device.get_queue_family_indices();
         const vk::ImageCreateInfo image_create_info
         {
             {},
@@ -24,7 +44,9 @@ namespace boza
             1,
             vk::SampleCountFlagBits::e1,
             vk::ImageTiling::eOptimal,
-            usage
+            usage,
+            families.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+            static_cast<uint32_t>(families.size()), families.data()
         };
 
         auto [img_result, img] = device.get().createImageUnique(image_create_info);
@@ -39,39 +61,16 @@ namespace boza
 
         const vk::MemoryRequirements mem_reqs = device.get().getImageMemoryRequirements(image.get());
 
-        const auto mem_props = device.get_physical_device().getMemoryProperties();
-        uint32_t   mem_type  = UINT32_MAX;
-        for (uint32_t i = 0; i < mem_props.memoryTypeCount; i++)
-        {
-            if ((mem_reqs.memoryTypeBits & (1 << i)) &&
-                (mem_props.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal))
-            {
-                mem_type = i;
-                break;
-            }
-        }
-
-        if (mem_type == UINT32_MAX)
-        {
-            Logger::error("Failed to find suitable memory type for image");
-            ok = false;
-            return;
-        }
-
-        const vk::MemoryAllocateInfo alloc_info{ mem_reqs.size, mem_type };
-
-        auto [mem_result, _memory] = device.get().allocateMemoryUnique(alloc_info);
-
-        if (mem_result != vk::Result::eSuccess)
+        allocation = device.get_allocator().allocate(mem_reqs, vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                                     ResourceKind::OptimalImage);
+        if (!allocation)
         {
             Logger::error("Failed to allocate image memory");
             ok = false;
             return;
         }
 
-        memory = std::move(_memory);
-
-        if (device.get().bindImageMemory(*image, *memory, 0) != vk::Result::eSuccess)
+        if (device.get().bindImageMemory(*image, allocation.get_memory(), allocation.get_offset()) != vk::Result::eSuccess)
         {
             Logger::error("Failed to bind image memory");
             ok = false;
@@ -99,27 +98,16 @@ namespace boza
             }
             image_view = std::move(_image_view);
         }
-
-        auto command_buffer_vec = command_pool.allocate_command_buffers(device, 1);
-
-        if (command_buffer_vec.empty())
-        {
-            Logger::error("Failed to allocate command buffer");
-            ok = false;
-            return;
-        }
-
-        copy_buffer = std::move(command_buffer_vec[0]);
     }
 
     Image3D::Image3D(Image3D&& other) noexcept
     {
         image = std::move(other.image);
-        memory = std::move(other.memory);
+        allocation = std::move(other.allocation);
         image_view = std::move(other.image_view);
-        copy_buffer = std::move(other.copy_buffer);
 
         extent = std::exchange(other.extent, {});
+        texel_size = std::exchange(other.texel_size, 0);
         ok = std::exchange(other.ok, false);
 
         if (other.device) device = std::cref(other.device->get());
@@ -131,11 +119,11 @@ namespace boza
         if (this != &other)
         {
             image = std::move(other.image);
-            memory = std::move(other.memory);
+            allocation = std::move(other.allocation);
             image_view = std::move(other.image_view);
-            copy_buffer = std::move(other.copy_buffer);
 
             extent = std::exchange(other.extent, {});
+            texel_size = std::exchange(other.texel_size, 0);
             ok = std::exchange(other.ok, false);
 
             if (other.device) device = std::cref(other.device->get());
@@ -144,87 +132,4 @@ namespace boza
 
         return *this;
     }
-
-    std::vector<uint8_t> Image3D::get_data() const
-    {
-        const vk::DeviceSize total_size = device->get().get().getImageMemoryRequirements(*image).size;
-
-        Buffer staging_buffer
-        {
-            device->get(),
-            total_size,
-            vk::BufferUsageFlagBits::eTransferDst,
-            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
-        };
-
-        if (!staging_buffer)
-        {
-            Logger::error("Failed to create staging buffer");
-            return {};
-        }
-
-        if (!staging_buffer.bind())
-        {
-            Logger::error("Failed to bind staging buffer memory");
-            return {};
-        }
-
-        if (copy_buffer->begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit }) != vk::Result::eSuccess)
-        {
-            Logger::error("Failed to begin copy command buffer");
-            return {};
-        }
-
-        vk::BufferImageCopy region
-        {
-            0,
-            0, 0,
-            { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
-            { 0, 0, 0 },
-            extent
-        };
-
-        copy_buffer->copyImageToBuffer(
-            *image,
-            vk::ImageLayout::eTransferSrcOptimal,
-            staging_buffer.get_buffer(),
-            { region }
-        );
-
-        if (copy_buffer->end() != vk::Result::eSuccess)
-        {
-            Logger::error("Failed to end copy command buffer");
-            return {};
-        }
-
-        vk::SubmitInfo submitInfo;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &copy_buffer.get();
-
-
-        if (device->get().get_compute_queue().submit(1, &submitInfo, {}) != vk::Result::eSuccess)
-        {
-            Logger::error("Failed to submit copy command buffer");
-            return {};
-        }
-
-        if (device->get().get_compute_queue().waitIdle() != vk::Result::eSuccess)
-        {
-            Logger::error("Failed to wait for copy command buffer");
-            return {};
-        }
-
-        auto [result, mapped] = device->get().get().mapMemory(staging_buffer.get_memory(), 0, vk::WholeSize);
-        if (result != vk::Result::eSuccess)
-        {
-            Logger::error("Failed to map memory");
-            return {};
-        }
-
-        std::vector<uint8_t> image_data(total_size);
-        std::memcpy(image_data.data(), mapped, total_size);
-
-        device->get().get().unmapMemory(staging_buffer.get_memory());
-        return image_data;
-    }
 }
@@ -1,5 +1,4 @@
 #pragma once
-#include "CommandPool.hpp"
 #include "pch.hpp"
 #include "Device.hpp"
 
@@ -11,7 +10,6 @@ namespace boza
         Image3D(nullptr_t) {}
 
         Image3D(const Device&       device,
-                CommandPool&        command_pool,
                 vk::Format          format,
                 vk::Extent3D        extent,
                 vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc,
@@ -25,20 +23,18 @@ namespace boza
 
         operator bool () const { return ok; }
 
-        [[nodiscard]]
-        std::vector<uint8_t> get_data() const;
-
         [[nodiscard]] const vk::Image&        get_image() const { return *image; }
-        [[nodiscard]] const vk::DeviceMemory& get_memory() const { return *memory; }
+        [[nodiscard]] const vk::DeviceMemory& get_memory() const { return allocation.get_memory(); }
         [[nodiscard]] const vk::ImageView&    get_image_view() const { return *image_view; }
+        [[nodiscard]] const vk::Extent3D&     get_extent() const { return extent; }
 
     private:
+        MemoryAllocation        allocation{ nullptr };
         vk::UniqueImage         image{ nullptr };
-        vk::UniqueDeviceMemory  memory{ nullptr };
         vk::UniqueImageView     image_view{ nullptr };
-        vk::UniqueCommandBuffer copy_buffer{ nullptr };
 
-        vk::Extent3D extent{};
+        vk::Extent3D   extent{};
+        vk::DeviceSize texel_size{};
 
         std::optional<std::reference_wrapper<const Device>> device{ std::nullopt };
 
@@ -2,29 +2,270 @@
 
 namespace boza
 {
-    static std::string time;
-    static std::mutex time_mutex;
+    namespace
+    {
+        // Local time as text, recomputed only when the second changes
+        struct TimeCache final
+        {
+            std::time_t second{ -1 };
+            std::string text;
+
+            const std::string& get(const std::time_t time)
+            {
+                if (time == second) return text;
+
+                std::tm time_info{};
+#ifdef _WIN32
+                localtime_s(&time_info, &time);
+#else
+                localtime_r(&time, &time_info);
+#endif
+
+                std::array<char, 32> buffer{};
+                text.assign(buffer.data(), std::strftime(buffer.data(), buffer.size(), "%Y-%m-%d %H:%M:%S", &time_info));
+                second = time;
+                return text;
+            }
+        };
+
+        // Set once the sink is gone, so lines logged from later static destructors are still written
+        std::atomic sink_destroyed{ false };
+    }
+
+    // A bounded queue with a sequence number per cell, after Dmitry Vyukov's: producers claim a
+    // position with a compare-and-swap and publish the cell by bumping its sequence, and the sink
+    // thread takes cells in position order. No thread ever waits for a lock to queue a line.
+    //
+    // When the queue is full, trace, debug and info lines are dropped and counted, while warnings
+    // and errors wait for room. Critical lines are written on the calling thread after whatever is
+    // queued, for crash paths where the sink thread may not run again.
+    struct Logger::Sink final
+    {
+        struct Record final
+        {
+            Level       level{ Level::Info };
+            std::time_t time{ 0 };
+            std::string message;
+        };
+
+        struct Cell final
+        {
+            std::atomic<uint64_t> sequence{ 0 };
+            Record                record;
+        };
+
+        static constexpr uint64_t capacity{ 8192 };
+        static constexpr uint32_t max_batch{ 256 };
+
+        Sink() : cells{ std::make_unique<Cell[]>(capacity) }
+        {
+            for (uint64_t i = 0; i < capacity; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+            thread = std::jthread{ [this](const std::stop_token& stop) { run(stop); } };
+        }
+
+        ~Sink()
+        {
+            thread.request_stop();
+            wake();
+            thread.join();
+
+            sink_destroyed = true;
+            if (dropped > 0 || blocked > 0)
+            {
+                write_direct({ Level::Warn, std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()),
+                               std::format("The log queue dropped {} lines and held up {} more while full",
+                                           dropped.load(), blocked.load()) });
+            }
+        }
+
+        Sink(const Sink&)            = delete;
+        Sink& operator=(const Sink&) = delete;
+
+        // Moves the record into the queue, false when it is full
+        bool try_push(Record& record)
+        {
+            uint64_t position = enqueue_position.load(std::memory_order_relaxed);
+            while (true)
+            {
+                Cell&          cell     = cells[position % capacity];
+                const uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto     distance = static_cast<int64_t>(sequence - position);
+
+                if (distance == 0)
+                {
+                    if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        cell.record = std::move(record);
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (distance < 0) return false;
+                else position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Sink thread only
+        bool try_pop(Record& record)
+        {
+            Cell& cell = cells[dequeue_position % capacity];
+            if (cell.sequence.load(std::memory_order_acquire) != dequeue_position + 1) return false;
+
+            record = std::move(cell.record);
+            cell.sequence.store(dequeue_position + capacity, std::memory_order_release);
+            ++dequeue_position;
+            return true;
+        }
+
+        [[nodiscard]] bool has_pending() const
+        {
+            return cells[dequeue_position % capacity].sequence.load(std::memory_order_acquire) == dequeue_position + 1;
+        }
+
+        void wake()
+        {
+            signal.fetch_add(1);
+            signal.notify_one();
+        }
+
+        void flush()
+        {
+            // The sink thread may be asleep with lines from producers that never saw it sleeping
+            const uint64_t target = enqueue_position.load(std::memory_order_acquire);
+            if (written.load(std::memory_order_acquire) < target) wake();
+
+            for (uint64_t done = written.load(std::memory_order_acquire); done < target;
+                 done = written.load(std::memory_order_acquire))
+                written.wait(done);
+        }
+
+        void run(const std::stop_token& stop)
+        {
+            std::string batch;
+            Record      record;
 
-    std::string& Logger::get_time()
+            while (true)
+            {
+                uint32_t count      = 0;
+                bool     flush_now = false;
+                for (; count < max_batch && try_pop(record); ++count)
+                {
+                    append_line(batch, sink_time, record);
+                    flush_now |= record.level >= Level::Warn;
+                }
+
+                if (count > 0)
+                {
+                    {
+                        std::lock_guard lock{ output_mutex };
+                        std::cout.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+                        if (flush_now) std::cout.flush();
+                    }
+
+                    batch.clear();
+                    written.fetch_add(count, std::memory_order_release);
+                    written.notify_all();
+                    continue;
+                }
+
+                // Everything queued before the stop has been written
+                if (stop.stop_requested()) break;
+
+                // A producer either sees sleeping and bumps the signal, or queued its line before
+                // the check below. The fences, here and in Logger::write, order each store before
+                // the other side's load, which acquire and release alone do not
+                const uint32_t observed = signal.load();
+                sleeping.store(true);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!has_pending() && !stop.stop_requested()) signal.wait(observed);
+                sleeping.store(false);
+            }
+
+            std::cout.flush();
+        }
+
+        void write_direct(const Record& record)
+        {
+            std::string line;
+            std::lock_guard lock{ output_mutex };
+            append_line(line, direct_time, record);
+            std::cout.write(line.data(), static_cast<std::streamsize>(line.size()));
+            std::cout.flush();
+        }
+
+        static void append_line(std::string& text, TimeCache& time_cache, const Record& record)
+        {
+            std::format_to(std::back_inserter(text), "[{}] [{}] {}\n", time_cache.get(record.time),
+                           to_string(record.level), record.message);
+        }
+
+        std::unique_ptr<Cell[]> cells;
+
+        alignas(64) std::atomic<uint64_t> enqueue_position{ 0 };
+        alignas(64) uint64_t              dequeue_position{ 0 };
+
+        std::atomic<uint64_t> written{ 0 }; // lines the sink thread has written, for flush
+        std::atomic<uint32_t> signal{ 0 };
+        std::atomic<bool>     sleeping{ false };
+
+        std::atomic<uint64_t> dropped{ 0 };
+        std::atomic<uint64_t> blocked{ 0 };
+
+        // Keeps critical lines from landing inside a batch
+        std::mutex output_mutex;
+        TimeCache  sink_time;
+        TimeCache  direct_time; // under output_mutex
+
+        // Last, so it stops before anything it uses is destroyed
+        std::jthread thread;
+    };
+
+
+    Logger::Sink& Logger::get_sink()
     {
-    	std::lock_guard lock(time_mutex);
-
-    	const auto now = std::chrono::system_clock::now();
-    	std::time_t current_time = std::chrono::system_clock::to_time_t(now);
-
-    	std::tm time_info{};
-    	#ifdef _WIN32
-    	localtime_s(&time_info, &current_time);
-    	#else
-    	localtime_r(&current_time, &time_info);
-    	#endif
-
-    	std::ostringstream oss;
-    	oss << std::put_time(&time_info, "%Y-%m-%d %H:%M:%S");
-    	time = oss.str();
-    	return time;
+        static Sink sink;
+        return sink;
     }
 
-    static std::mutex logging_mutex;
-    std::mutex& Logger::get_mutex() { return logging_mutex; }
+    void Logger::write(const Level level, std::string&& message)
+    {
+        Sink::Record record{ level, std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()),
+                             std::move(message) };
+
+        if (sink_destroyed)
+        {
+            TimeCache time_cache;
+            std::string line;
+            Sink::append_line(line, time_cache, record);
+            std::cout << line << std::flush;
+            return;
+        }
+
+        Sink& sink = get_sink();
+        if (level == Level::Critical)
+        {
+            sink.flush();
+            sink.write_direct(record);
+            return;
+        }
+
+        bool held_up = false;
+        while (!sink.try_push(record))
+        {
+            if (level < Level::Warn)
+            {
+                sink.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            if (!held_up) sink.blocked.fetch_add(1, std::memory_order_relaxed);
+            held_up = true;
+
+            sink.wake();
+            std::this_thread::yield();
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sink.sleeping.load()) sink.wake();
+    }
 }
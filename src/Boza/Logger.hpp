@@ -35,7 +35,6 @@ namespace boza
         template<formattable... Args> static void error   (const std::format_string<Args...> format, Args&&... args) { log(Level::Error   , format, std::forward<Args>(args)...); }
         template<formattable... Args> static void critical(const std::format_string<Args...> format, Args&&... args) { log(Level::Critical, format, std::forward<Args>(args)...); }
 
-
     private:
 		enum class Level
 		{
@@ -61,21 +60,18 @@ namespace boza
 			std::unreachable();
 		}
 
-		[[nodiscard]] static std::mutex& get_mutex();
-        [[nodiscard]] static std::string& get_time();
+        struct Sink;
+        [[nodiscard]] static Sink& get_sink();
 
+        // Formats on the calling thread and queues the line for the sink thread
         template<formattable... Args>
         static void log(const Level level, const std::format_string<Args...> format, Args&&... args)
         {
-			std::lock_guard lock(get_mutex());
-
-            const std::string args_str = std::format(format, std::forward<Args>(args)...);
-	        const std::string message = std::format("[{}] [{}] {}", get_time(), to_string(level), args_str);
-
-			std::cout << message << '\n';
-            if (level >= Level::Warn) std::cout.flush();
+            write(level, std::format(format, std::forward<Args>(args)...));
         }
 
+        static void write(Level level, std::string&& message);
+
     	inline static bool created = false;
     };
 }
@@ -0,0 +1,192 @@
+#include "MappedFile.hpp"
+
+#include "Logger.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace boza
+{
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& filename)
+    {
+        const HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            Logger::error("Failed to open {}", filename);
+            return;
+        }
+
+        LARGE_INTEGER file_size{};
+        if (!GetFileSizeEx(file, &file_size))
+        {
+            Logger::error("Failed to get the size of {}", filename);
+            CloseHandle(file);
+            return;
+        }
+
+        size = static_cast<size_t>(file_size.QuadPart);
+        if (size == 0)
+        {
+            CloseHandle(file);
+            ok = true;
+            return;
+        }
+
+        // The mapping keeps its own reference to the file
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+        {
+            Logger::error("Failed to map {}", filename);
+            size = 0;
+            return;
+        }
+
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (data == nullptr)
+        {
+            Logger::error("Failed to map {}", filename);
+            unmap();
+            return;
+        }
+
+        ok = true;
+    }
+
+    void MappedFile::unmap()
+    {
+        if (data != nullptr) UnmapViewOfFile(data);
+        if (mapping != nullptr) CloseHandle(mapping);
+
+        data    = nullptr;
+        size    = 0;
+        mapping = nullptr;
+    }
+#else
+    MappedFile::MappedFile(const std::string& filename)
+    {
+        const int file = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file < 0)
+        {
+            Logger::error("Failed to open {}", filename);
+            return;
+        }
+
+        struct stat status{};
+        if (fstat(file, &status) != 0)
+        {
+            Logger::error("Failed to get the size of {}", filename);
+            close(file);
+            return;
+        }
+
+        size = static_cast<size_t>(status.st_size);
+        if (size == 0)
+        {
+            close(file);
+            ok = true;
+            return;
+        }
+
+        // The mapping keeps its own reference to the file
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (mapped == MAP_FAILED)
+        {
+            Logger::error("Failed to map {}", filename);
+            size = 0;
+            return;
+        }
+
+        // Every chunk is read front to back exactly once
+        madvise(mapped, size, MADV_SEQUENTIAL);
+
+        data = static_cast<const char*>(mapped);
+        ok   = true;
+    }
+
+    void MappedFile::unmap()
+    {
+        if (data != nullptr) munmap(const_cast<char*>(data), size);
+
+        data = nullptr;
+        size = 0;
+    }
+#endif
+
+    MappedFile::~MappedFile()
+    {
+        unmap();
+    }
+
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+#ifdef _WIN32
+        mapping = std::exchange(other.mapping, nullptr);
+#endif
+        ok = std::exchange(other.ok, false);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+
+            data = std::exchange(other.data, nullptr);
+            size = std::exchange(other.size, 0);
+#ifdef _WIN32
+            mapping = std::exchange(other.mapping, nullptr);
+#endif
+            ok = std::exchange(other.ok, false);
+        }
+
+        return *this;
+    }
+
+    bool write_file_atomically(const std::string&                                      filename,
+                               const std::initializer_list<std::span<const std::byte>> parts,
+                               std::string&                                            error)
+    {
+        // Unique per process, so concurrent runs never write into each other's file
+        const std::string temporary = std::format("{}.{:08x}.tmp", filename, std::random_device{}());
+        std::error_code   remove_error;
+        {
+            std::ofstream file{ temporary, std::ios::binary | std::ios::trunc };
+            for (const std::span<const std::byte> part : parts)
+                file.write(reinterpret_cast<const char*>(part.data()), static_cast<std::streamsize>(part.size()));
+            file.close();
+
+            if (!file)
+            {
+                error = std::format("{} could not be written", temporary);
+                std::filesystem::remove(temporary, remove_error);
+                return false;
+            }
+        }
+
+        std::error_code rename_error;
+        std::filesystem::rename(temporary, filename, rename_error);
+        if (rename_error)
+        {
+            error = std::format("{} could not replace {}: {}", temporary, filename, rename_error.message());
+            std::filesystem::remove(temporary, remove_error);
+            return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    // Read-only view of a whole file, mapped instead of read so that multi-gigabyte inputs are
+    // paged in on demand and never copied into the heap. The view stays valid until destruction.
+    class MappedFile final
+    {
+    public:
+        MappedFile(nullptr_t) {}
+        explicit MappedFile(const std::string& filename);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&)            = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        operator bool () const { return ok; }
+
+        [[nodiscard]] std::string_view get_data() const { return { data, size }; }
+
+    private:
+        void unmap();
+
+        const char* data{ nullptr };
+        size_t      size{ 0 };
+
+#ifdef _WIN32
+        void* mapping{ nullptr };
+#endif
+
+        bool ok = false;
+    };
+
+    // Writes the parts one after another to a file next to `filename` and renames it over, so no
+    // reader, a concurrent run included, ever sees a torn file. On failure the old file is left
+    // as it was and `error` says what went wrong
+    [[nodiscard]] bool write_file_atomically(const std::string&                                filename,
+                                             std::initializer_list<std::span<const std::byte>> parts,
+                                             std::string&                                      error);
+}
@@ -0,0 +1,417 @@
+#include "MemoryAllocator.hpp"
+
+#include "CpuProfiler.hpp"
+#include "Logger.hpp"
+
+namespace boza
+{
+    struct MemoryBlock final
+    {
+        vk::DeviceMemory memory{ nullptr };
+        vk::DeviceSize   size{ 0 };
+        uint8_t*         mapped{ nullptr };
+        uint32_t         memory_type{ 0 };
+        ResourceKind     kind{ ResourceKind::Linear };
+        MemoryLifetime   lifetime{ MemoryLifetime::Persistent };
+        bool             dedicated{ false };
+        uint32_t         live{ 0 };
+
+        // Persistent blocks: the free ranges by offset. Transient blocks: the end of the last allocation
+        std::map<vk::DeviceSize, vk::DeviceSize> free_ranges;
+        vk::DeviceSize                           top{ 0 };
+    };
+
+    static vk::DeviceSize align_up(const vk::DeviceSize value, const vk::DeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static double to_mib(const vk::DeviceSize bytes)
+    {
+        return static_cast<double>(bytes) / static_cast<double>(1 << 20);
+    }
+
+
+    MemoryAllocation::~MemoryAllocation()
+    {
+        release();
+    }
+
+    MemoryAllocation::MemoryAllocation(MemoryAllocation&& other) noexcept
+    {
+        allocator = std::exchange(other.allocator, nullptr);
+        block     = std::exchange(other.block, nullptr);
+        memory    = std::exchange(other.memory, nullptr);
+        offset    = std::exchange(other.offset, 0);
+        size      = std::exchange(other.size, 0);
+        mapped    = std::exchange(other.mapped, nullptr);
+        coherent  = std::exchange(other.coherent, true);
+    }
+
+    MemoryAllocation& MemoryAllocation::operator=(MemoryAllocation&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+
+            allocator = std::exchange(other.allocator, nullptr);
+            block     = std::exchange(other.block, nullptr);
+            memory    = std::exchange(other.memory, nullptr);
+            offset    = std::exchange(other.offset, 0);
+            size      = std::exchange(other.size, 0);
+            mapped    = std::exchange(other.mapped, nullptr);
+            coherent  = std::exchange(other.coherent, true);
+        }
+
+        return *this;
+    }
+
+    bool MemoryAllocation::flush() const
+    {
+        if (coherent || mapped == nullptr) return true;
+
+        const vk::MappedMemoryRange range{ memory, offset, size };
+        if (allocator->device.flushMappedMemoryRanges(range) != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to flush mapped memory");
+            return false;
+        }
+
+        return true;
+    }
+
+    bool MemoryAllocation::invalidate() const
+    {
+        if (coherent || mapped == nullptr) return true;
+
+        const vk::MappedMemoryRange range{ memory, offset, size };
+        if (allocator->device.invalidateMappedMemoryRanges(range) != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to invalidate mapped memory");
+            return false;
+        }
+
+        return true;
+    }
+
+    void MemoryAllocation::release()
+    {
+        if (allocator == nullptr) return;
+
+        allocator->free(block, offset, size);
+        allocator = nullptr;
+        block     = nullptr;
+    }
+
+
+    MemoryAllocator::MemoryAllocator(const vk::PhysicalDevice& physical_device, const vk::Device& device)
+        : memory_properties{ physical_device.getMemoryProperties() }, device{ device }
+    {
+        const vk::PhysicalDeviceLimits limits = physical_device.getProperties().limits;
+        buffer_image_granularity = std::max<vk::DeviceSize>(limits.bufferImageGranularity, 1);
+        non_coherent_atom_size   = std::max<vk::DeviceSize>(limits.nonCoherentAtomSize, 1);
+        max_allocation_count     = limits.maxMemoryAllocationCount;
+    }
+
+    MemoryAllocator::~MemoryAllocator()
+    {
+        if (!blocks.empty())
+            Logger::warn("{} device memory block{} still in use on exit", blocks.size(), blocks.size() > 1 ? "s" : "");
+
+        for (const auto& block : blocks)
+            device.freeMemory(block->memory);
+    }
+
+
+    MemoryAllocation MemoryAllocator::allocate(
+        const vk::MemoryRequirements& requirements,
+        const vk::MemoryPropertyFlags properties,
+        ResourceKind                  kind,
+        const MemoryLifetime          lifetime)
+    {
+        PROFILE_ALLOCATION();
+
+        const uint32_t memory_type = find_memory_type(requirements.memoryTypeBits, properties);
+        if (memory_type == UINT32_MAX)
+        {
+            Logger::error("Failed to find a memory type with {}", to_string(properties));
+            return nullptr;
+        }
+
+        const vk::MemoryPropertyFlags flags    = memory_properties.memoryTypes[memory_type].propertyFlags;
+        const bool                    coherent = !(flags & vk::MemoryPropertyFlagBits::eHostVisible) ||
+                                                 (flags & vk::MemoryPropertyFlagBits::eHostCoherent);
+
+        // Flushes and invalidations work on whole atoms, which must not reach into a neighbour
+        vk::DeviceSize size      = requirements.size;
+        vk::DeviceSize alignment = std::max<vk::DeviceSize>(requirements.alignment, 1);
+        if (!coherent)
+        {
+            size      = align_up(size, non_coherent_atom_size);
+            alignment = std::lcm(alignment, non_coherent_atom_size);
+        }
+
+        // Mapped ranges can hold vec4 data in place, whatever the buffer itself needs
+        if (flags & vk::MemoryPropertyFlagBits::eHostVisible) alignment = std::lcm(alignment, min_mapped_alignment);
+
+        if (buffer_image_granularity == 1) kind = ResourceKind::Linear;
+
+        std::lock_guard lock{ mutex };
+
+        MemoryBlock*   block  = nullptr;
+        vk::DeviceSize offset = 0;
+
+        const vk::DeviceSize block_size = block_size_of(memory_type);
+        if (size <= block_size / 2)
+        {
+            for (const auto& candidate : blocks)
+            {
+                if (candidate->dedicated || candidate->memory_type != memory_type || candidate->kind != kind ||
+                    candidate->lifetime != lifetime)
+                    continue;
+
+                if (place(*candidate, size, alignment, offset))
+                {
+                    block = candidate.get();
+                    break;
+                }
+            }
+
+            if (block == nullptr)
+            {
+                block = create_block(memory_type, block_size, kind, lifetime, false);
+                if (block != nullptr && !place(*block, size, alignment, offset)) block = nullptr;
+            }
+        }
+
+        // Too large to share a block, or no room left on the heap for a whole one
+        if (block == nullptr)
+        {
+            block  = create_block(memory_type, size, kind, lifetime, true);
+            offset = 0;
+        }
+
+        if (block == nullptr) return nullptr;
+
+        ++block->live;
+
+        TypeStats& type_stats = stats[memory_type];
+        type_stats.used += size;
+        type_stats.peak = std::max(type_stats.peak, type_stats.used);
+        ++type_stats.allocations;
+
+        MemoryAllocation allocation{ nullptr };
+        allocation.allocator = this;
+        allocation.block     = block;
+        allocation.memory    = block->memory;
+        allocation.offset    = offset;
+        allocation.size      = size;
+        allocation.mapped    = block->mapped != nullptr ? block->mapped + offset : nullptr;
+        allocation.coherent  = coherent;
+        return allocation;
+    }
+
+    uint32_t MemoryAllocator::find_memory_type(const uint32_t type_bits, const vk::MemoryPropertyFlags properties) const
+    {
+        uint32_t best       = UINT32_MAX;
+        int      best_extra = std::numeric_limits<int>::max();
+
+        for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+        {
+            const vk::MemoryPropertyFlags flags = memory_properties.memoryTypes[i].propertyFlags;
+            if (!(type_bits & 1u << i) || (flags & properties) != properties) continue;
+
+            const int extra = std::popcount(static_cast<VkMemoryPropertyFlags>(flags & ~properties));
+            if (extra < best_extra)
+            {
+                best       = i;
+                best_extra = extra;
+            }
+        }
+
+        return best;
+    }
+
+    void MemoryAllocator::report() const
+    {
+        std::lock_guard lock{ mutex };
+
+        uint64_t allocations = 0;
+        for (const TypeStats& type_stats : stats)
+            allocations += type_stats.allocations;
+
+        if (allocations == 0) return;
+
+        Logger::info("Device memory: {} allocations served from {} driver allocations", allocations,
+                     driver_allocations);
+
+        for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+        {
+            const TypeStats& type_stats = stats[i];
+            if (type_stats.allocations == 0) continue;
+
+            Logger::info("\ttype {} {}: {} block{}, {:.1f} MiB reserved, {:.1f} MiB in use, {:.1f} MiB peak, {} allocations",
+                         i, to_string(memory_properties.memoryTypes[i].propertyFlags),
+                         type_stats.blocks, type_stats.blocks == 1 ? "" : "s",
+                         to_mib(type_stats.reserved), to_mib(type_stats.used), to_mib(type_stats.peak),
+                         type_stats.allocations);
+        }
+    }
+
+
+    MemoryBlock* MemoryAllocator::create_block(
+        const uint32_t       memory_type,
+        const vk::DeviceSize size,
+        const ResourceKind   kind,
+        const MemoryLifetime lifetime,
+        const bool           dedicated)
+    {
+        if (driver_allocations >= max_allocation_count)
+        {
+            Logger::error("Reached the limit of {} device memory allocations", max_allocation_count);
+            return nullptr;
+        }
+
+        auto [result, memory] = device.allocateMemory({ size, memory_type });
+        if (result != vk::Result::eSuccess)
+        {
+            Logger::trace("Failed to allocate {:.1f} MiB of memory type {}", to_mib(size), memory_type);
+            return nullptr;
+        }
+
+        auto block = std::make_unique<MemoryBlock>();
+        block->memory      = memory;
+        block->size        = size;
+        block->memory_type = memory_type;
+        block->kind        = kind;
+        block->lifetime    = lifetime;
+        block->dedicated   = dedicated;
+        if (lifetime == MemoryLifetime::Persistent) block->free_ranges.emplace(0, size);
+
+        if (memory_properties.memoryTypes[memory_type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        {
+            auto [map_result, mapped] = device.mapMemory(memory, 0, VK_WHOLE_SIZE, {});
+            if (map_result != vk::Result::eSuccess)
+            {
+                Logger::error("Failed to map device memory block");
+                device.freeMemory(memory);
+                return nullptr;
+            }
+
+            block->mapped = static_cast<uint8_t*>(mapped);
+        }
+
+        ++driver_allocations;
+        ++stats[memory_type].blocks;
+        stats[memory_type].reserved += size;
+
+        Logger::trace("Allocated {}{:.1f} MiB block of memory type {}", dedicated ? "dedicated " : "", to_mib(size),
+                      memory_type);
+
+        blocks.push_back(std::move(block));
+        return blocks.back().get();
+    }
+
+    void MemoryAllocator::destroy_block(const MemoryBlock* block)
+    {
+        --driver_allocations;
+        --stats[block->memory_type].blocks;
+        stats[block->memory_type].reserved -= block->size;
+
+        // Freeing the memory unmaps it as well
+        device.freeMemory(block->memory);
+        std::erase_if(blocks, [block](const std::unique_ptr<MemoryBlock>& candidate) { return candidate.get() == block; });
+    }
+
+    bool MemoryAllocator::place(
+        MemoryBlock&         block,
+        const vk::DeviceSize size,
+        const vk::DeviceSize alignment,
+        vk::DeviceSize&      offset)
+    {
+        if (block.lifetime == MemoryLifetime::Transient)
+        {
+            const vk::DeviceSize start = align_up(block.top, alignment);
+            if (start + size > block.size) return false;
+
+            offset    = start;
+            block.top = start + size;
+            return true;
+        }
+
+        // First fit; the leftovers on either side of the allocation stay free
+        for (const auto [range_offset, range_size] : block.free_ranges)
+        {
+            const vk::DeviceSize start = align_up(range_offset, alignment);
+            const vk::DeviceSize end   = range_offset + range_size;
+            if (start + size > end) continue;
+
+            block.free_ranges.erase(range_offset);
+            if (start > range_offset) block.free_ranges.emplace(range_offset, start - range_offset);
+            if (start + size < end) block.free_ranges.emplace(start + size, end - start - size);
+
+            offset = start;
+            return true;
+        }
+
+        return false;
+    }
+
+    void MemoryAllocator::free(MemoryBlock* block, const vk::DeviceSize offset, const vk::DeviceSize size)
+    {
+        std::lock_guard lock{ mutex };
+
+        stats[block->memory_type].used -= size;
+        --block->live;
+
+        if (block->dedicated)
+        {
+            destroy_block(block);
+            return;
+        }
+
+        if (block->lifetime == MemoryLifetime::Persistent)
+        {
+            auto range = block->free_ranges.emplace(offset, size).first;
+
+            // Merge with the free range that ends where this one starts, then with the one after it
+            if (range != block->free_ranges.begin())
+            {
+                if (const auto previous = std::prev(range); previous->first + previous->second == offset)
+                {
+                    previous->second += range->second;
+                    block->free_ranges.erase(range);
+                    range = previous;
+                }
+            }
+
+            if (const auto next = std::next(range);
+                next != block->free_ranges.end() && range->first + range->second == next->first)
+            {
+                range->second += next->second;
+                block->free_ranges.erase(next);
+            }
+        }
+
+        if (block->live > 0) return;
+
+        // The arena starts over; one empty block of each pool is kept for the next job
+        block->top = 0;
+
+        const bool has_spare = std::ranges::any_of(blocks, [block](const std::unique_ptr<MemoryBlock>& candidate)
+        {
+            return candidate.get() != block && !candidate->dedicated && candidate->live == 0 &&
+                   candidate->memory_type == block->memory_type && candidate->kind == block->kind &&
+                   candidate->lifetime == block->lifetime;
+        });
+
+        if (has_spare) destroy_block(block);
+    }
+
+    vk::DeviceSize MemoryAllocator::block_size_of(const uint32_t memory_type) const
+    {
+        // Small heaps, such as a 256 MiB BAR window, are not taken by a couple of blocks
+        const vk::DeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[memory_type].heapIndex].size;
+        return std::clamp<vk::DeviceSize>(std::bit_floor(heap_size / 8), 1 << 20, default_block_size);
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    class MemoryAllocator;
+    struct MemoryBlock;
+
+    // How long a resource is expected to live, which decides the pool it is placed in
+    enum class MemoryLifetime
+    {
+        Persistent, // until it is destroyed, in any order
+        Transient   // for the current job, freed together with the rest of the job's resources
+    };
+
+    // What is bound to the memory; buffers and optimally tiled images may have to be kept
+    // bufferImageGranularity apart
+    enum class ResourceKind
+    {
+        Linear,
+        OptimalImage
+    };
+
+    // A range of a device memory block, handed back to the allocator when destroyed. Host-visible
+    // memory stays mapped for the lifetime of its block, so the range can be written at any time.
+    class MemoryAllocation final
+    {
+    public:
+        MemoryAllocation(nullptr_t) {}
+        ~MemoryAllocation();
+
+        MemoryAllocation(const MemoryAllocation&)            = delete;
+        MemoryAllocation& operator=(const MemoryAllocation&) = delete;
+
+        MemoryAllocation(MemoryAllocation&& other) noexcept;
+        MemoryAllocation& operator=(MemoryAllocation&& other) noexcept;
+
+        operator bool () const { return allocator != nullptr; }
+
+        // Needed around host accesses when the memory is not host-coherent, no-ops otherwise
+        [[nodiscard]] bool flush() const;
+        [[nodiscard]] bool invalidate() const;
+
+        [[nodiscard]] const vk::DeviceMemory& get_memory() const { return memory; }
+        [[nodiscard]] vk::DeviceSize          get_offset() const { return offset; }
+        [[nodiscard]] vk::DeviceSize          get_size() const { return size; }
+
+        // Null unless the memory is host-visible
+        [[nodiscard]] uint8_t* get_mapped() const { return mapped; }
+
+    private:
+        friend class MemoryAllocator;
+
+        void release();
+
+        MemoryAllocator* allocator{ nullptr };
+        MemoryBlock*     block{ nullptr };
+        vk::DeviceMemory memory{ nullptr };
+        vk::DeviceSize   offset{ 0 };
+        vk::DeviceSize   size{ 0 };
+        uint8_t*         mapped{ nullptr };
+        bool             coherent{ true };
+    };
+
+    // Sub-allocates buffers and images from large device memory blocks, so a batch of many
+    // meshes and tiles needs a handful of driver allocations instead of one per resource.
+    //
+    // Every memory type has its own blocks. Persistent allocations come from a free list that
+    // merges neighbouring ranges when they are freed; transient ones are bumped from an arena
+    // that starts over once everything in it has been freed. When the device has a
+    // bufferImageGranularity above 1, buffers and optimal images never share a block, so they
+    // cannot alias on one page. Allocations above half a block get a block of their own.
+    class MemoryAllocator final
+    {
+    public:
+        MemoryAllocator(const vk::PhysicalDevice& physical_device, const vk::Device& device);
+        ~MemoryAllocator();
+
+        MemoryAllocator(const MemoryAllocator&)            = delete;
+        MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+        [[nodiscard]] MemoryAllocation allocate(const vk::MemoryRequirements& requirements,
+                                                vk::MemoryPropertyFlags       properties,
+                                                ResourceKind                  kind,
+                                                MemoryLifetime                lifetime = MemoryLifetime::Persistent);
+
+        // The type allowed by type_bits with all of `properties` and the fewest others, which keeps
+        // device-local resources out of host-visible BAR memory and host buffers out of VRAM
+        [[nodiscard]] uint32_t find_memory_type(uint32_t type_bits, vk::MemoryPropertyFlags properties) const;
+
+        // Logs the blocks, bytes in use and peak usage of every memory type used so far
+        void report() const;
+
+    private:
+        friend class MemoryAllocation;
+
+        struct TypeStats final
+        {
+            uint32_t       blocks{ 0 };
+            vk::DeviceSize reserved{ 0 };
+            vk::DeviceSize used{ 0 };
+            vk::DeviceSize peak{ 0 };
+            uint64_t       allocations{ 0 };
+        };
+
+        static constexpr vk::DeviceSize default_block_size{ 64ull << 20 };
+        static constexpr vk::DeviceSize min_mapped_alignment{ 16 };
+
+        [[nodiscard]] MemoryBlock* create_block(uint32_t memory_type, vk::DeviceSize size, ResourceKind kind,
+                                                MemoryLifetime lifetime, bool dedicated);
+        void destroy_block(const MemoryBlock* block);
+
+        [[nodiscard]] static bool place(MemoryBlock& block, vk::DeviceSize size, vk::DeviceSize alignment,
+                                        vk::DeviceSize& offset);
+        void free(MemoryBlock* block, vk::DeviceSize offset, vk::DeviceSize size);
+
+        [[nodiscard]] vk::DeviceSize block_size_of(uint32_t memory_type) const;
+
+        vk::PhysicalDeviceMemoryProperties memory_properties{};
+        vk::DeviceSize                     buffer_image_granularity{ 1 };
+        vk::DeviceSize                     non_coherent_atom_size{ 1 };
+        uint32_t                           max_allocation_count{ 0 };
+        vk::Device                         device{ nullptr };
+
+        std::vector<std::unique_ptr<MemoryBlock>>  blocks;
+        std::array<TypeStats, VK_MAX_MEMORY_TYPES> stats{};
+        uint32_t                                   driver_allocations{ 0 };
+
+        mutable std::mutex mutex;
+    };
+}
@@ -0,0 +1,204 @@
+#include "PipelineCache.hpp"
+
+#include "Logger.hpp"
+#include "MappedFile.hpp"
+
+namespace boza
+{
+    PipelineCache::PipelineCache(const Device& device, const std::string& filename)
+        : filename{ filename }, device{ std::cref(device) }, ok{ true }
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        const std::vector<uint8_t> data = load();
+        loaded_hash = data.empty() ? 0 : hash(data);
+
+        auto [result, _pipeline_cache] = device.get().createPipelineCacheUnique({ {}, data.size(), data.data() });
+        if (result != vk::Result::eSuccess && !data.empty())
+        {
+            Logger::warn("The driver rejected pipeline cache {}, starting empty", filename);
+            loaded_hash = 0;
+
+            auto [empty_result, empty_cache] = device.get().createPipelineCacheUnique({});
+            result          = empty_result;
+            _pipeline_cache = std::move(empty_cache);
+        }
+
+        if (result != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to create pipeline cache");
+            ok = false;
+            return;
+        }
+
+        pipeline_cache = std::move(_pipeline_cache);
+
+        if (loaded_hash != 0)
+        {
+            Logger::info("Loaded {} bytes of pipeline cache from {} in {:.2f} ms", data.size(), filename,
+                         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+
+    PipelineCache::PipelineCache(PipelineCache&& other) noexcept
+    {
+        pipeline_cache = std::move(other.pipeline_cache);
+        filename       = std::exchange(other.filename, {});
+        loaded_hash    = std::exchange(other.loaded_hash, 0);
+        pipeline_count = std::exchange(other.pipeline_count, 0);
+        hit_count      = std::exchange(other.hit_count, 0);
+        miss_count     = std::exchange(other.miss_count, 0);
+        creation_ms    = std::exchange(other.creation_ms, 0.0);
+        ok             = std::exchange(other.ok, false);
+
+        if (other.device) device = std::cref(other.device->get());
+        other.device = std::nullopt;
+    }
+
+    PipelineCache& PipelineCache::operator=(PipelineCache&& other) noexcept
+    {
+        if (this != &other)
+        {
+            pipeline_cache = std::move(other.pipeline_cache);
+            filename       = std::exchange(other.filename, {});
+            loaded_hash    = std::exchange(other.loaded_hash, 0);
+            pipeline_count = std::exchange(other.pipeline_count, 0);
+            hit_count      = std::exchange(other.hit_count, 0);
+            miss_count     = std::exchange(other.miss_count, 0);
+            creation_ms    = std::exchange(other.creation_ms, 0.0);
+            ok             = std::exchange(other.ok, false);
+
+            if (other.device) device = std::cref(other.device->get());
+            other.device = std::nullopt;
+        }
+
+        return *this;
+    }
+
+
+    void PipelineCache::record(const std::string_view& name, const ComputeShader& shader)
+    {
+        if (shader.get_variant_count() == 0) return;
+
+        pipeline_count += shader.get_variant_count();
+        hit_count += shader.get_pipeline_cache_hits();
+        miss_count += shader.get_pipeline_cache_misses();
+        creation_ms += shader.get_pipeline_creation_ms();
+
+        Logger::trace("Created {} variants of {} in {:.2f} ms", shader.get_variant_count(), name,
+                      shader.get_pipeline_creation_ms());
+    }
+
+    void PipelineCache::report() const
+    {
+        if (hit_count + miss_count == pipeline_count)
+        {
+            Logger::info("Created {} pipelines in {:.2f} ms: {} pipeline cache hits, {} misses",
+                         pipeline_count, creation_ms, hit_count, miss_count);
+        }
+        else
+        {
+            Logger::info("Created {} pipelines in {:.2f} ms (the driver does not report pipeline cache hits)",
+                         pipeline_count, creation_ms);
+        }
+    }
+
+    bool PipelineCache::save() const
+    {
+        if (!ok) return false;
+
+        auto [result, data] = device->get().get().getPipelineCacheData(*pipeline_cache);
+        if (result != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to get pipeline cache data");
+            return false;
+        }
+
+        if (hash(data) == loaded_hash)
+        {
+            Logger::trace("Pipeline cache {} is up to date", filename);
+            return true;
+        }
+
+        const Header header = make_header(data);
+        std::string  error;
+        if (!write_file_atomically(filename, { std::as_bytes(std::span{ &header, 1 }), std::as_bytes(std::span{ data }) },
+                                   error))
+        {
+            Logger::error("Failed to write pipeline cache: {}", error);
+            return false;
+        }
+
+        Logger::info("Saved {} bytes of pipeline cache to {}", data.size(), filename);
+        return true;
+    }
+
+
+    std::vector<uint8_t> PipelineCache::load() const
+    {
+        std::ifstream file{ filename, std::ios::binary | std::ios::ate };
+        if (!file)
+        {
+            Logger::info("No pipeline cache at {}, compiling every pipeline", filename);
+            return {};
+        }
+
+        const auto file_size = static_cast<size_t>(file.tellg());
+
+        Header header{};
+        file.seekg(0);
+        if (file_size < sizeof(Header) || !file.read(reinterpret_cast<char*>(&header), sizeof(Header)))
+        {
+            Logger::warn("Pipeline cache {} is truncated, starting empty", filename);
+            return {};
+        }
+
+        if (header.magic != magic || header.version != version)
+        {
+            Logger::warn("{} is not a pipeline cache of this version, starting empty", filename);
+            return {};
+        }
+
+        // Driver updates may change the blob format without changing the cache UUID
+        const Header expected = make_header({});
+        if (header.vendor_id != expected.vendor_id || header.device_id != expected.device_id ||
+            header.driver_version != expected.driver_version ||
+            !std::ranges::equal(header.uuid, expected.uuid))
+        {
+            Logger::info("Pipeline cache {} was written by another device or driver, starting empty", filename);
+            return {};
+        }
+
+        std::vector<uint8_t> data(file_size - sizeof(Header));
+        if (header.data_size != data.size() ||
+            !file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size())) ||
+            hash(data) != header.data_hash)
+        {
+            Logger::warn("Pipeline cache {} is damaged, starting empty", filename);
+            return {};
+        }
+
+        return data;
+    }
+
+    PipelineCache::Header PipelineCache::make_header(const std::span<const uint8_t> data) const
+    {
+        const vk::PhysicalDeviceProperties properties = device->get().get_physical_device().getProperties();
+
+        Header header{ magic, version, data.size(), hash(data),
+                       properties.vendorID, properties.deviceID, properties.driverVersion, 0, {} };
+        std::ranges::copy(properties.pipelineCacheUUID, header.uuid);
+        return header;
+    }
+
+    uint64_t PipelineCache::hash(const std::span<const uint8_t> data)
+    {
+        // FNV-1a, enough to catch a damaged file
+        uint64_t value = 0xcbf2'9ce4'8422'2325;
+        for (const uint8_t byte : data)
+            value = (value ^ byte) * 0x0000'0100'0000'01b3;
+
+        return value;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "pch.hpp"
+#include "ComputeShader.hpp"
+#include "Device.hpp"
+
+namespace boza
+{
+    // vk::PipelineCache kept on disk between runs. The driver's blob is stored behind a header
+    // naming the device and driver that wrote it, and a blob from any other one, or a damaged
+    // file, is dropped in favour of an empty cache.
+    class PipelineCache final
+    {
+    public:
+        PipelineCache(nullptr_t) {}
+        PipelineCache(const Device& device, const std::string& filename);
+
+        PipelineCache(const PipelineCache&)            = delete;
+        PipelineCache& operator=(const PipelineCache&) = delete;
+
+        PipelineCache(PipelineCache&& other) noexcept;
+        PipelineCache& operator=(PipelineCache&& other) noexcept;
+
+        operator bool () const { return ok; }
+
+        [[nodiscard]] const vk::PipelineCache& get() const { return *pipeline_cache; }
+
+        // Counts the pipeline variants of a shader towards report(), once per shader
+        void record(const std::string_view& name, const ComputeShader& shader);
+
+        // Logs how long the recorded pipelines took and how many were cache hits
+        void report() const;
+
+        // Writes the cache next to the old file and renames it over, so a crash or a concurrent
+        // run never leaves a torn file behind. Skipped when nothing was added
+        bool save() const;
+
+    private:
+        struct Header final
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t data_size;
+            uint64_t data_hash;
+            uint32_t vendor_id;
+            uint32_t device_id;
+            uint32_t driver_version;
+            uint32_t reserved;
+            uint8_t  uuid[VK_UUID_SIZE];
+        };
+
+        static_assert(sizeof(Header) == 56);
+
+        static constexpr uint32_t magic{ 0x4350'5A42 }; // "BZPC"
+        static constexpr uint32_t version{ 1 };
+
+        [[nodiscard]] std::vector<uint8_t> load() const;
+        [[nodiscard]] Header make_header(std::span<const uint8_t> data) const;
+
+        [[nodiscard]] static uint64_t hash(std::span<const uint8_t> data);
+
+        vk::UniquePipelineCache pipeline_cache{ nullptr };
+        std::string             filename;
+        uint64_t                loaded_hash{ 0 };
+
+        uint32_t pipeline_count{ 0 };
+        uint32_t hit_count{ 0 };
+        uint32_t miss_count{ 0 };
+        double   creation_ms{ 0.0 };
+
+        std::optional<std::reference_wrapper<const Device>> device{ std::nullopt };
+
+        bool ok = false;
+    };
+}
@@ -0,0 +1,222 @@
+#include "PngWriter.hpp"
+#include "CpuProfiler.hpp"
+#include "Logger.hpp"
+
+#include <zlib.h>
+
+namespace boza
+{
+    bool PngWriter::write_rgba8(const std::string& filename, const uint32_t width, const uint32_t height,
+                                const std::span<const uint8_t> pixels, const PngCompression compression)
+    {
+        PROFILE_ZONE("PNG encode");
+
+        const size_t row_size = static_cast<size_t>(width) * 4;
+        if (width == 0 || height == 0 || pixels.size() != row_size * height)
+        {
+            Logger::error("Invalid {}x{} image for {}", width, height, filename);
+            return false;
+        }
+
+        const uint32_t band_count = std::clamp(std::thread::hardware_concurrency(), 1u,
+                                               std::max(height / min_band_rows, 1u));
+
+        std::vector<Band> bands(band_count);
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(band_count);
+            for (uint32_t i = 0; i < band_count; ++i)
+            {
+                const auto first = static_cast<uint32_t>(static_cast<uint64_t>(height) * i / band_count);
+                const auto last  = static_cast<uint32_t>(static_cast<uint64_t>(height) * (i + 1) / band_count);
+                workers.emplace_back(compress_band, pixels, row_size, first, last, i + 1 == band_count,
+                                     compression, std::ref(bands[i]));
+            }
+        }
+
+        uLong adler = adler32(0, nullptr, 0);
+        for (const Band& band : bands)
+        {
+            if (!band.ok)
+            {
+                Logger::error("Failed to compress {}", filename);
+                return false;
+            }
+
+            adler = adler32_combine(adler, band.adler, static_cast<z_off_t>(band.length));
+        }
+
+        std::ofstream file{ filename, std::ios::binary };
+        if (!file)
+        {
+            Logger::error("Failed to open {} for writing", filename);
+            return false;
+        }
+
+        constexpr std::array<uint8_t, 8> signature{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        file.write(reinterpret_cast<const char*>(signature.data()), signature.size());
+
+        const std::array<uint8_t, 13> header{
+            static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16),
+            static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+            static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16),
+            static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+            8, // bits per channel
+            6, // RGBA
+            0, 0, 0 // deflate, adaptive filtering, no interlacing
+        };
+        write_chunk(file, "IHDR", header, chunk_crc("IHDR", header));
+
+        // The zlib header, with a 32K window and the compression level as a hint; the check bits make
+        // both a multiple of 31
+        const std::array<uint8_t, 2> stream_header{
+            0x78, static_cast<uint8_t>(compression == PngCompression::Store ? 0x01 : 0x9C)
+        };
+        write_chunk(file, "IDAT", stream_header, chunk_crc("IDAT", stream_header));
+
+        for (const Band& band : bands)
+        {
+            for (size_t i = 0; i < band.crcs.size(); ++i)
+            {
+                const size_t offset = i * max_chunk_size;
+                write_chunk(file, "IDAT",
+                            std::span{ band.data }.subspan(offset, std::min(max_chunk_size, band.data.size() - offset)),
+                            band.crcs[i]);
+            }
+        }
+
+        const std::array<uint8_t, 4> stream_trailer{
+            static_cast<uint8_t>(adler >> 24), static_cast<uint8_t>(adler >> 16),
+            static_cast<uint8_t>(adler >> 8), static_cast<uint8_t>(adler)
+        };
+        write_chunk(file, "IDAT", stream_trailer, chunk_crc("IDAT", stream_trailer));
+        write_chunk(file, "IEND", {}, chunk_crc("IEND", {}));
+
+        if (!file.flush())
+        {
+            Logger::error("Failed to write {}", filename);
+            return false;
+        }
+
+        return true;
+    }
+
+
+    void PngWriter::compress_band(const std::span<const uint8_t> pixels, const size_t row_size,
+                                  const uint32_t first_row, const uint32_t last_row, const bool last,
+                                  const PngCompression compression, Band& band)
+    {
+        PROFILE_ZONE("PNG band");
+
+        const bool store = compression == PngCompression::Store;
+
+        z_stream stream{};
+        if (deflateInit2(&stream, store ? Z_NO_COMPRESSION : Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return;
+
+        band.length = static_cast<uint64_t>(last_row - first_row) * (row_size + 1);
+
+        // Sync flushes add an empty stored block, so a little room is left over the bound
+        constexpr size_t output_step{ 64 << 10 };
+        band.data.resize(deflateBound(&stream, static_cast<uLong>(band.length)) + output_step);
+
+        size_t written = 0;
+
+        // Deflates the pending input; a flush is done once it returns with output space left over,
+        // a finish once the stream has ended
+        const auto run = [&](const uint8_t* data, const size_t size, const int flush)
+        {
+            stream.next_in  = const_cast<Bytef*>(data);
+            stream.avail_in = static_cast<uInt>(size);
+
+            while (true)
+            {
+                if (band.data.size() - written < output_step)
+                    band.data.resize(band.data.size() + std::max(band.data.size() / 2, output_step));
+
+                const size_t available = std::min<size_t>(band.data.size() - written,
+                                                          std::numeric_limits<uInt>::max());
+                stream.next_out  = band.data.data() + written;
+                stream.avail_out = static_cast<uInt>(available);
+
+                const int result = deflate(&stream, flush);
+                written += available - stream.avail_out;
+
+                if (result == Z_STREAM_ERROR) return false;
+                if (flush == Z_FINISH ? result == Z_STREAM_END : stream.avail_out != 0) return true;
+            }
+        };
+
+        // Up filtering: every byte minus the one above it, which turns the repeated rows of a
+        // voxel slice into runs of zeros
+        std::vector<uint8_t> filtered(store ? 0 : row_size + 1);
+        if (!store) filtered[0] = 2;
+
+        bool ok = true;
+        for (uint32_t y = first_row; y < last_row && ok; ++y)
+        {
+            const uint8_t* row = pixels.data() + y * row_size;
+
+            if (store)
+            {
+                constexpr uint8_t no_filter = 0;
+                band.adler = static_cast<uint32_t>(adler32(band.adler, &no_filter, 1));
+                band.adler = static_cast<uint32_t>(adler32(band.adler, row, static_cast<uInt>(row_size)));
+                ok         = run(&no_filter, 1, Z_NO_FLUSH) && run(row, row_size, Z_NO_FLUSH);
+                continue;
+            }
+
+            if (y == 0) std::copy_n(row, row_size, filtered.data() + 1);
+            else
+            {
+                const uint8_t* above = row - row_size;
+                for (size_t i = 0; i < row_size; ++i)
+                    filtered[i + 1] = static_cast<uint8_t>(row[i] - above[i]);
+            }
+
+            band.adler = static_cast<uint32_t>(adler32(band.adler, filtered.data(), static_cast<uInt>(filtered.size())));
+            ok         = run(filtered.data(), filtered.size(), Z_NO_FLUSH);
+        }
+
+        ok = ok && run(nullptr, 0, last ? Z_FINISH : Z_SYNC_FLUSH);
+        deflateEnd(&stream);
+        if (!ok) return;
+
+        band.data.resize(written);
+        PROFILE_BYTES(band.length);
+
+        for (size_t offset = 0; offset < band.data.size(); offset += max_chunk_size)
+            band.crcs.push_back(chunk_crc("IDAT", std::span{ band.data }.subspan(
+                                              offset, std::min(max_chunk_size, band.data.size() - offset))));
+
+        band.ok = true;
+    }
+
+
+    void PngWriter::write_chunk(std::ofstream& file, const char* type, const std::span<const uint8_t> data,
+                                const uint32_t crc)
+    {
+        const auto write_u32 = [&file](const uint32_t value)
+        {
+            const std::array<char, 4> bytes{
+                static_cast<char>(value >> 24), static_cast<char>(value >> 16),
+                static_cast<char>(value >> 8), static_cast<char>(value)
+            };
+            file.write(bytes.data(), bytes.size());
+        };
+
+        write_u32(static_cast<uint32_t>(data.size()));
+        file.write(type, 4);
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        write_u32(crc);
+    }
+
+    uint32_t PngWriter::chunk_crc(const char* type, const std::span<const uint8_t> data)
+    {
+        // crc32 of a null buffer starts over instead of leaving the checksum alone
+        uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+        if (!data.empty()) crc = crc32(crc, data.data(), static_cast<uInt>(data.size()));
+        return static_cast<uint32_t>(crc);
+    }
+}
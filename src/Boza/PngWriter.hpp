@@ -0,0 +1,47 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    enum class PngCompression
+    {
+        Deflate, // rows filtered against the row above and deflated at the default level
+        Store    // unfiltered rows in stored deflate blocks, bound by the disk rather than the CPU
+    };
+
+    // Writes 8-bit RGBA PNG files on every core. The rows are split into one band per thread, and
+    // each band is filtered and deflated on its own; all but the last end with a sync flush, which
+    // leaves them byte-aligned and open, so the bands follow each other in the IDAT stream as one
+    // zlib stream. Its checksum is combined from the bands' and every IDAT chunk holds one band.
+    class PngWriter final
+    {
+    public:
+        PngWriter() = delete;
+
+        // Pixels are width * 4 bytes per row, top row first
+        [[nodiscard]] static bool write_rgba8(const std::string& filename, uint32_t width, uint32_t height,
+                                              std::span<const uint8_t> pixels, PngCompression compression);
+
+    private:
+        struct Band final
+        {
+            std::vector<uint8_t>  data; // raw deflate output
+            std::vector<uint32_t> crcs; // of the IDAT chunks data is split into
+            uint32_t              adler{ 1 };
+            uint64_t              length{ 0 }; // bytes before compression, filter bytes included
+            bool                  ok{ false };
+        };
+
+        // Below this, a band does not pay for its thread and the bytes lost at its start
+        static constexpr uint32_t min_band_rows{ 64 };
+
+        // Chunk lengths are limited to 2^31 - 1
+        static constexpr size_t max_chunk_size{ 1u << 30 };
+
+        static void compress_band(std::span<const uint8_t> pixels, size_t row_size, uint32_t first_row,
+                                  uint32_t last_row, bool last, PngCompression compression, Band& band);
+
+        static void write_chunk(std::ofstream& file, const char* type, std::span<const uint8_t> data, uint32_t crc);
+        [[nodiscard]] static uint32_t chunk_crc(const char* type, std::span<const uint8_t> data);
+    };
+}
@@ -0,0 +1,141 @@
+#include "QueueScheduler.hpp"
+
+#include "Logger.hpp"
+
+namespace boza
+{
+    QueueScheduler::QueueScheduler(
+        const vk::Device&           device,
+        const std::vector<Queue>&   compute_queues,
+        const std::optional<Queue>& transfer_queue)
+        : device{ device }, ok{ true }
+    {
+        for (const Queue& queue : compute_queues)
+            if (!add_timeline(queue)) return;
+
+        compute_queue_count = static_cast<uint32_t>(compute_queues.size());
+        if (transfer_queue && !add_timeline(*transfer_queue)) return;
+
+        Logger::trace("Scheduling over {} compute queue{}{}", compute_queue_count, compute_queue_count > 1 ? "s" : "",
+                      transfer_queue ? " and a transfer queue" : "");
+    }
+
+    QueueScheduler::~QueueScheduler()
+    {
+        // The semaphores must outlive every submission that signals them
+        if (ok && !wait_idle()) Logger::error("Failed to wait for pending submissions");
+    }
+
+
+    QueueTicket QueueScheduler::get_last_ticket(const uint32_t queue) const
+    {
+        const Timeline& timeline = *timelines[queue];
+
+        std::lock_guard lock{ timeline.mutex };
+        return { queue, timeline.last_submitted };
+    }
+
+    bool QueueScheduler::submit(
+        const uint32_t                           queue,
+        const std::span<const vk::CommandBuffer> command_buffers,
+        const std::span<const Wait>              waits,
+        QueueTicket&                             ticket)
+    {
+        Timeline& timeline = *timelines[queue];
+
+        std::vector<vk::Semaphore>          wait_semaphores;
+        std::vector<uint64_t>               wait_values;
+        std::vector<vk::PipelineStageFlags> wait_stages;
+        for (const Wait& wait : waits)
+        {
+            // Earlier work on the same queue is ordered by the barriers recorded with it
+            if (wait.ticket.value == 0 || wait.ticket.queue == queue) continue;
+
+            wait_semaphores.push_back(*timelines[wait.ticket.queue]->semaphore);
+            wait_values.push_back(wait.ticket.value);
+            wait_stages.push_back(wait.stage);
+        }
+
+        std::lock_guard lock{ timeline.mutex };
+        const uint64_t  signal_value = timeline.last_submitted + 1;
+
+        vk::TimelineSemaphoreSubmitInfo timeline_info;
+        timeline_info.waitSemaphoreValueCount   = static_cast<uint32_t>(wait_values.size());
+        timeline_info.pWaitSemaphoreValues      = wait_values.data();
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues    = &signal_value;
+
+        vk::SubmitInfo submit_info;
+        submit_info.pNext                = &timeline_info;
+        submit_info.waitSemaphoreCount   = static_cast<uint32_t>(wait_semaphores.size());
+        submit_info.pWaitSemaphores      = wait_semaphores.data();
+        submit_info.pWaitDstStageMask    = wait_stages.data();
+        submit_info.commandBufferCount   = static_cast<uint32_t>(command_buffers.size());
+        submit_info.pCommandBuffers      = command_buffers.data();
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores    = &*timeline.semaphore;
+
+        if (timeline.queue.queue.submit(submit_info, {}) != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to submit to queue {}", queue);
+            return false;
+        }
+
+        timeline.last_submitted = signal_value;
+        ticket                  = { queue, signal_value };
+        return true;
+    }
+
+    bool QueueScheduler::wait(const QueueTicket& ticket) const
+    {
+        if (ticket.value == 0) return true;
+
+        const vk::SemaphoreWaitInfo wait_info{ {}, 1, &*timelines[ticket.queue]->semaphore, &ticket.value };
+        return device.waitSemaphores(wait_info, UINT64_MAX) == vk::Result::eSuccess;
+    }
+
+    bool QueueScheduler::wait_idle() const
+    {
+        std::vector<vk::Semaphore> semaphores;
+        std::vector<uint64_t>      values;
+        for (uint32_t queue = 0; queue < timelines.size(); ++queue)
+        {
+            const QueueTicket last = get_last_ticket(queue);
+            if (last.value == 0) continue;
+
+            semaphores.push_back(*timelines[queue]->semaphore);
+            values.push_back(last.value);
+        }
+
+        if (semaphores.empty()) return true;
+
+        const vk::SemaphoreWaitInfo wait_info
+        {
+            {},
+            static_cast<uint32_t>(semaphores.size()), semaphores.data(),
+            values.data()
+        };
+        return device.waitSemaphores(wait_info, UINT64_MAX) == vk::Result::eSuccess;
+    }
+
+
+    bool QueueScheduler::add_timeline(const Queue& queue)
+    {
+        vk::SemaphoreTypeCreateInfo   type_info{ vk::SemaphoreType::eTimeline, 0 };
+        const vk::SemaphoreCreateInfo create_info{ {}, &type_info };
+
+        auto [result, semaphore] = device.createSemaphoreUnique(create_info);
+        if (result != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to create timeline semaphore");
+            ok = false;
+            return false;
+        }
+
+        auto timeline       = std::make_unique<Timeline>();
+        timeline->queue     = queue;
+        timeline->semaphore = std::move(semaphore);
+        timelines.push_back(std::move(timeline));
+        return true;
+    }
+}
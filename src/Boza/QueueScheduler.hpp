@@ -0,0 +1,85 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    // The submission that signaled `value` on the timeline of queue `queue`, and everything
+    // submitted to that queue before it
+    struct QueueTicket final
+    {
+        uint32_t queue{ 0 };
+        uint64_t value{ 0 }; // 0 for no submission, which is always complete
+    };
+
+    // Submits to every queue of the device and tracks them with one timeline semaphore each, so
+    // a submission waits on another queue for exactly the work it depends on, and the host waits
+    // for one submission instead of idling a queue.
+    //
+    // Compute queues are numbered from 0; the dedicated transfer queue, when the device has one,
+    // comes after them. Submitting is safe from any thread.
+    class QueueScheduler final
+    {
+    public:
+        struct Queue final
+        {
+            vk::Queue queue;
+            uint32_t  family_index;
+        };
+
+        // The commands of a submission in `stage` start once `ticket` has completed
+        struct Wait final
+        {
+            QueueTicket            ticket;
+            vk::PipelineStageFlags stage;
+        };
+
+        QueueScheduler(const vk::Device& device, const std::vector<Queue>& compute_queues,
+                       const std::optional<Queue>& transfer_queue);
+        ~QueueScheduler();
+
+        QueueScheduler(const QueueScheduler&)            = delete;
+        QueueScheduler& operator=(const QueueScheduler&) = delete;
+        QueueScheduler(QueueScheduler&&)                 = delete;
+        QueueScheduler& operator=(QueueScheduler&&)      = delete;
+
+        operator bool () const { return ok; }
+
+        [[nodiscard]] uint32_t get_compute_queue_count() const { return compute_queue_count; }
+        [[nodiscard]] bool     has_transfer_queue() const { return timelines.size() > compute_queue_count; }
+
+        // The transfer queue, or compute queue 0 without one
+        [[nodiscard]] uint32_t get_transfer_queue() const { return has_transfer_queue() ? compute_queue_count : 0; }
+
+        // The ticket of the last submission to `queue`
+        [[nodiscard]] QueueTicket get_last_ticket(uint32_t queue) const;
+
+        [[nodiscard]] bool submit(uint32_t queue, std::span<const vk::CommandBuffer> command_buffers,
+                                  std::span<const Wait> waits, QueueTicket& ticket);
+
+        // Blocks until `ticket` has completed
+        [[nodiscard]] bool wait(const QueueTicket& ticket) const;
+
+        // Blocks until everything submitted so far has completed
+        [[nodiscard]] bool wait_idle() const;
+
+    private:
+        struct Timeline final
+        {
+            Queue               queue;
+            vk::UniqueSemaphore semaphore;
+            uint64_t            last_submitted{ 0 };
+
+            // Queue submissions have to be externally synchronized
+            mutable std::mutex mutex;
+        };
+
+        [[nodiscard]] bool add_timeline(const Queue& queue);
+
+        vk::Device device;
+
+        std::vector<std::unique_ptr<Timeline>> timelines;
+        uint32_t                               compute_queue_count{ 0 };
+
+        bool ok = false;
+    };
+}
@@ -0,0 +1,414 @@
+#include "ReadbackRing.hpp"
+
+#include "Logger.hpp"
+
+namespace boza
+{
+    ReadbackRing::ReadbackRing(
+        const Device&        device,
+        CommandPool&         command_pool,
+        CommandPool&         transfer_command_pool,
+        const vk::DeviceSize slot_size,
+        const uint32_t       slot_count)
+        : slot_size{ slot_size }, device{ std::cref(device) }, ok{ true }
+    {
+        if (!create_slots(command_pool, transfer_command_pool, slot_count)) return;
+        if (!create_query_pool(slot_count)) return;
+
+        Logger::trace("Created readback ring of {} slots of {} bytes, copied on the {} queue", slot_count, slot_size,
+                      transfer_command_pool ? "transfer" : "compute");
+    }
+
+    ReadbackRing::~ReadbackRing()
+    {
+        wait_pending();
+    }
+
+
+    ReadbackRing::ReadbackRing(ReadbackRing&& other) noexcept
+    {
+        slots               = std::move(other.slots);
+        slot_size           = std::exchange(other.slot_size, 0);
+        query_pool          = std::move(other.query_pool);
+        timestamp_period    = std::exchange(other.timestamp_period, 0.0f);
+        transfer_timestamps = std::exchange(other.transfer_timestamps, false);
+        recording           = std::exchange(other.recording, nullptr);
+        copying             = std::exchange(other.copying, nullptr);
+        recording_sequence  = std::exchange(other.recording_sequence, 0);
+        first_begin         = std::exchange(other.first_begin, {});
+        last_release        = std::exchange(other.last_release, {});
+        host_work_start     = std::exchange(other.host_work_start, {});
+        gpu_ms              = std::exchange(other.gpu_ms, 0.0);
+        host_wait_ms        = std::exchange(other.host_wait_ms, 0.0);
+        host_work_ms        = std::exchange(other.host_work_ms, 0.0);
+        ok                  = std::exchange(other.ok, false);
+
+        if (other.device) device = std::cref(other.device->get());
+        other.device = std::nullopt;
+    }
+
+    ReadbackRing& ReadbackRing::operator=(ReadbackRing&& other) noexcept
+    {
+        if (this != &other)
+        {
+            wait_pending();
+
+            slots               = std::move(other.slots);
+            slot_size           = std::exchange(other.slot_size, 0);
+            query_pool          = std::move(other.query_pool);
+            timestamp_period    = std::exchange(other.timestamp_period, 0.0f);
+            transfer_timestamps = std::exchange(other.transfer_timestamps, false);
+            recording           = std::exchange(other.recording, nullptr);
+            copying             = std::exchange(other.copying, nullptr);
+            recording_sequence  = std::exchange(other.recording_sequence, 0);
+            first_begin         = std::exchange(other.first_begin, {});
+            last_release        = std::exchange(other.last_release, {});
+            host_work_start     = std::exchange(other.host_work_start, {});
+            gpu_ms              = std::exchange(other.gpu_ms, 0.0);
+            host_wait_ms        = std::exchange(other.host_wait_ms, 0.0);
+            host_work_ms        = std::exchange(other.host_work_ms, 0.0);
+            ok                  = std::exchange(other.ok, false);
+
+            if (other.device) device = std::cref(other.device->get());
+            other.device = std::nullopt;
+        }
+
+        return *this;
+    }
+
+
+    bool ReadbackRing::begin(const uint64_t sequence, vk::CommandBuffer& command_buffer)
+    {
+        Slot& slot = slot_of(sequence);
+        if (!acquire(sequence)) return false;
+
+        // Kept for resubmit, so not one-time; a slot is never submitted again before it finished
+        slot.recorded = false;
+        if (slot.command_buffer->begin({}) != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to begin readback command buffer");
+            return false;
+        }
+
+        if (slot.transfer_command_buffer && slot.transfer_command_buffer->begin({}) != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to begin readback transfer command buffer");
+            if (slot.command_buffer->end() != vk::Result::eSuccess) Logger::warn("Failed to end a cancelled readback command buffer");
+            return false;
+        }
+
+        recording          = *slot.command_buffer;
+        copying            = slot.transfer_command_buffer ? *slot.transfer_command_buffer : recording;
+        recording_sequence = sequence;
+        slot.busy          = true;
+        slot.copied        = 0;
+
+        if (query_pool)
+        {
+            const uint32_t first_query = static_cast<uint32_t>(sequence % slots.size()) * 2;
+            recording.resetQueryPool(*query_pool, first_query, 2);
+            recording.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *query_pool, first_query);
+        }
+
+        command_buffer = recording;
+        return true;
+    }
+
+    bool ReadbackRing::copy_image(const vk::Image&      image,
+                                  const vk::Extent3D&   extent,
+                                  const uint32_t        depth,
+                                  const vk::DeviceSize  texel_size)
+    {
+        Slot&                slot = slot_of(recording_sequence);
+        const vk::DeviceSize size = static_cast<vk::DeviceSize>(extent.width) * extent.height * depth * texel_size;
+        if (slot.copied + size > slot_size)
+        {
+            Logger::error("Readback of {} bytes does not fit a slot of {} bytes", slot.copied + size, slot_size);
+            return false;
+        }
+
+        const vk::BufferImageCopy region
+        {
+            slot.copied,
+            0, 0,
+            { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+            { 0, 0, 0 },
+            { extent.width, extent.height, depth }
+        };
+
+        copying.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, slot.staging.get_buffer(), { region });
+        slot.copied += size;
+        return true;
+    }
+
+    bool ReadbackRing::submit(const uint64_t sequence, const uint32_t queue, const std::span<const QueueScheduler::Wait> waits)
+    {
+        // Makes the copies available to the host once the semaphore signals
+        const vk::MemoryBarrier host_barrier
+        {
+            vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eHostRead
+        };
+
+        copying.pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eHost,
+            {},
+            1, &host_barrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        // Without timestamps on the transfer queue, the GPU time ends with the compute commands
+        if (query_pool)
+            (transfer_timestamps ? copying : recording)
+                .writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool,
+                                static_cast<uint32_t>(sequence % slots.size()) * 2 + 1);
+
+        if (recording.end() != vk::Result::eSuccess || (copying != recording && copying.end() != vk::Result::eSuccess))
+        {
+            Logger::error("Failed to end readback command buffer");
+            return false;
+        }
+
+        recording = nullptr;
+        copying   = nullptr;
+
+        Slot& slot    = slot_of(sequence);
+        slot.recorded = true;
+        return submit_slot(slot, queue, waits);
+    }
+
+    bool ReadbackRing::resubmit(const uint64_t sequence, const uint32_t queue, const std::span<const QueueScheduler::Wait> waits)
+    {
+        Slot& slot = slot_of(sequence);
+        if (!slot.recorded)
+        {
+            Logger::error("Readback slot {} has nothing recorded to submit again", sequence % slots.size());
+            return false;
+        }
+
+        if (!acquire(sequence)) return false;
+
+        slot.busy = true;
+        return submit_slot(slot, queue, waits);
+    }
+
+    void ReadbackRing::cancel(const uint64_t sequence)
+    {
+        // Begun again with an implicit reset, the pool allows it. The slot has nothing to resubmit
+        // until then, begin() already dropped its previous recording
+        if (recording.end() != vk::Result::eSuccess || (copying != recording && copying.end() != vk::Result::eSuccess))
+            Logger::warn("Failed to end a cancelled readback command buffer");
+
+        recording              = nullptr;
+        copying                = nullptr;
+        slot_of(sequence).busy = false;
+    }
+
+    void ReadbackRing::abandon()
+    {
+        if (recording) cancel(recording_sequence);
+
+        wait_pending();
+        for (Slot& slot : slots)
+        {
+            slot.busy     = false;
+            slot.recorded = false;
+        }
+    }
+
+    std::span<const uint8_t> ReadbackRing::wait(const uint64_t sequence)
+    {
+        const Slot& slot = slot_of(sequence);
+
+        const auto wait_start = Clock::now();
+        if (!device->get().get_scheduler().wait(slot.ticket))
+        {
+            Logger::error("Failed to wait for readback {}", sequence);
+            return {};
+        }
+
+        host_work_start = Clock::now();
+        host_wait_ms += std::chrono::duration<double, std::milli>(host_work_start - wait_start).count();
+
+        // Host-cached memory is not necessarily coherent
+        if (!slot.staging.invalidate())
+        {
+            Logger::error("Failed to invalidate readback slot");
+            return {};
+        }
+
+        if (query_pool)
+        {
+            std::array<uint64_t, 2> ticks{};
+            if (device->get().get().getQueryPoolResults(*query_pool,
+                                                        static_cast<uint32_t>(sequence % slots.size()) * 2, 2,
+                                                        sizeof(ticks), ticks.data(), sizeof(uint64_t),
+                                                        vk::QueryResultFlagBits::e64) == vk::Result::eSuccess)
+                gpu_ms += static_cast<double>(ticks[1] - ticks[0]) * timestamp_period / 1e6;
+        }
+
+        return { slot.mapped, slot.copied };
+    }
+
+    void ReadbackRing::release(const uint64_t sequence)
+    {
+        last_release = Clock::now();
+        host_work_ms += std::chrono::duration<double, std::milli>(last_release - host_work_start).count();
+        slot_of(sequence).busy = false;
+    }
+
+    void ReadbackRing::report(const uint64_t submissions) const
+    {
+        const double wall_ms = std::chrono::duration<double, std::milli>(last_release - first_begin).count();
+        if (timestamp_period == 0.0f)
+        {
+            Logger::info("Readback: {} chunks in {:.2f} ms, host busy {:.2f} ms and waiting {:.2f} ms",
+                         submissions, wall_ms, host_work_ms, host_wait_ms);
+            return;
+        }
+
+        // Run back to back, the stages would take gpu + host; whatever the wall clock saves
+        // on that was spent with both busy at once
+        const double shorter = std::min(gpu_ms, host_work_ms);
+        const double overlap = shorter > 0.0 ? std::clamp((gpu_ms + host_work_ms - wall_ms) / shorter, 0.0, 1.0) : 0.0;
+
+        Logger::info("Readback: {} chunks in {:.2f} ms, GPU busy {:.2f} ms, host busy {:.2f} ms and waiting {:.2f} ms, "
+                     "{:.0f}% of the shorter stage overlapped",
+                     submissions, wall_ms, gpu_ms, host_work_ms, host_wait_ms, overlap * 100.0);
+    }
+
+
+    bool ReadbackRing::acquire(const uint64_t sequence)
+    {
+        if (slot_of(sequence).busy)
+        {
+            Logger::error("Readback slot {} is still in use", sequence % slots.size());
+            return false;
+        }
+
+        if (sequence == 0)
+        {
+            first_begin   = Clock::now();
+            gpu_ms        = 0.0;
+            host_wait_ms  = 0.0;
+            host_work_ms  = 0.0;
+        }
+
+        return true;
+    }
+
+    void ReadbackRing::wait_pending() const
+    {
+        // The staging buffers must outlive every copy into them
+        if (!ok) return;
+
+        for (const Slot& slot : slots)
+            if (!device->get().get_scheduler().wait(slot.ticket)) Logger::error("Failed to wait for pending readbacks");
+    }
+
+    bool ReadbackRing::submit_slot(Slot& slot, const uint32_t queue, const std::span<const QueueScheduler::Wait> waits)
+    {
+        QueueScheduler& scheduler = device->get().get_scheduler();
+        if (!scheduler.submit(queue, { &slot.command_buffer.get(), 1 }, waits, slot.ticket))
+        {
+            Logger::error("Failed to submit readback command buffer");
+            return false;
+        }
+
+        slot.computed = slot.ticket;
+
+        if (slot.transfer_command_buffer)
+        {
+            const QueueScheduler::Wait computed{ slot.ticket, vk::PipelineStageFlagBits::eTransfer };
+            if (!scheduler.submit(scheduler.get_transfer_queue(), { &slot.transfer_command_buffer.get(), 1 }, { &computed, 1 },
+                                  slot.ticket))
+            {
+                Logger::error("Failed to submit readback copies");
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    bool ReadbackRing::create_slots(CommandPool& command_pool, CommandPool& transfer_command_pool, const uint32_t slot_count)
+    {
+        // Cached memory makes the host reads fast, coherent memory is the fallback
+        const vk::MemoryPropertyFlags cached = vk::MemoryPropertyFlagBits::eHostVisible |
+                                               vk::MemoryPropertyFlagBits::eHostCached;
+
+        const bool has_cached = device->get().get_allocator().find_memory_type(UINT32_MAX, cached) != UINT32_MAX;
+
+        const vk::MemoryPropertyFlags properties = has_cached
+                                                       ? cached
+                                                       : vk::MemoryPropertyFlagBits::eHostVisible |
+                                                         vk::MemoryPropertyFlagBits::eHostCoherent;
+
+        std::vector<vk::UniqueCommandBuffer> command_buffers = command_pool.allocate_command_buffers(device->get(), slot_count);
+        if (command_buffers.size() != slot_count)
+        {
+            ok = false;
+            return false;
+        }
+
+        std::vector<vk::UniqueCommandBuffer> transfer_command_buffers;
+        if (transfer_command_pool)
+        {
+            transfer_command_buffers = transfer_command_pool.allocate_command_buffers(device->get(), slot_count);
+            if (transfer_command_buffers.size() != slot_count)
+            {
+                ok = false;
+                return false;
+            }
+        }
+
+        slots.resize(slot_count);
+        for (uint32_t i = 0; i < slot_count; ++i)
+        {
+            Slot& slot = slots[i];
+            slot.staging = Buffer{ device->get(), slot_size, vk::BufferUsageFlagBits::eTransferDst, properties };
+            if (!slot.staging || !slot.staging.bind())
+            {
+                Logger::error("Failed to create readback staging buffer");
+                ok = false;
+                return false;
+            }
+
+            // Stays mapped for the lifetime of the ring
+            slot.mapped         = slot.staging.get_mapped();
+            slot.command_buffer = std::move(command_buffers[i]);
+            if (transfer_command_pool) slot.transfer_command_buffer = std::move(transfer_command_buffers[i]);
+        }
+
+        return true;
+    }
+
+    bool ReadbackRing::create_query_pool(const uint32_t slot_count)
+    {
+        const auto families = device->get().get_physical_device().getQueueFamilyProperties();
+        if (families[device->get().get_compute_queue_family_index()].timestampValidBits == 0)
+        {
+            Logger::trace("The compute queue has no timestamps, readback overlap is reported from host times only");
+            return true;
+        }
+
+        const vk::QueryPoolCreateInfo create_info{ {}, vk::QueryType::eTimestamp, slot_count * 2 };
+
+        auto [result, pool] = device->get().get().createQueryPoolUnique(create_info);
+        if (result != vk::Result::eSuccess)
+        {
+            Logger::error("Failed to create timestamp query pool");
+            ok = false;
+            return false;
+        }
+
+        query_pool          = std::move(pool);
+        timestamp_period    = device->get().get_physical_device().getProperties().limits.timestampPeriod;
+        transfer_timestamps = !slots.empty() && slots.front().transfer_command_buffer &&
+                              families[device->get().get_transfer_queue_family_index()].timestampValidBits > 0;
+        return true;
+    }
+}
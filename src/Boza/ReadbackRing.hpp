@@ -0,0 +1,129 @@
+#pragma once
+#include "pch.hpp"
+#include "Buffer.hpp"
+#include "CommandPool.hpp"
+#include "Device.hpp"
+
+namespace boza
+{
+    // Persistent, mapped staging buffers for reading results back while the GPU moves on.
+    // Submission n records into slot n % slot_count and is tracked by a ticket of the device's
+    // QueueScheduler, so the host waits for exactly the chunk it needs instead of a whole queue.
+    // A slot is reused only after release(), which keeps at most slot_count chunks in flight.
+    //
+    // With a transfer command pool, the copies go to the device's transfer queue in a command
+    // buffer of their own that waits for the commands before them, so one chunk is copied out
+    // while the compute queues work on the next.
+    //
+    // The command buffers of a slot are kept once submitted, and resubmit() runs them again as
+    // they are for a later submission to the same slot whose commands would come out the same.
+    class ReadbackRing final
+    {
+    public:
+        ReadbackRing(nullptr_t) {}
+        ReadbackRing(const Device& device, CommandPool& command_pool, CommandPool& transfer_command_pool,
+                     vk::DeviceSize slot_size, uint32_t slot_count);
+        ~ReadbackRing();
+
+        ReadbackRing(const ReadbackRing&)            = delete;
+        ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+        ReadbackRing(ReadbackRing&& other) noexcept;
+        ReadbackRing& operator=(ReadbackRing&& other) noexcept;
+
+        operator bool () const { return ok; }
+
+        // Begins the command buffer of submission `sequence`, whose slot must have been released.
+        // Whatever the slot recorded before is discarded
+        [[nodiscard]] bool begin(uint64_t sequence, vk::CommandBuffer& command_buffer);
+
+        // Copies the first `depth` layers of an image in TransferSrcOptimal layout into the slot
+        [[nodiscard]] bool copy_image(const vk::Image& image, const vk::Extent3D& extent, uint32_t depth, vk::DeviceSize texel_size);
+
+        // Submits the commands to compute queue `queue` after `waits`, and the copies after them
+        [[nodiscard]] bool submit(uint64_t sequence, uint32_t queue, std::span<const QueueScheduler::Wait> waits = {});
+
+        // Submits what the slot of `sequence` recorded for an earlier submission again, without
+        // recording anything. The slot must have been released and submitted before
+        [[nodiscard]] bool resubmit(uint64_t sequence, uint32_t queue, std::span<const QueueScheduler::Wait> waits = {});
+
+        // Completion of the copies of `sequence`, for other submissions to wait on
+        [[nodiscard]] QueueTicket get_ticket(const uint64_t sequence) const { return slots[sequence % slots.size()].ticket; }
+
+        // Completion of the compute commands of `sequence`, before the transfer queue copies them out.
+        // The same as get_ticket() without a transfer queue
+        [[nodiscard]] QueueTicket get_compute_ticket(const uint64_t sequence) const
+        {
+            return slots[sequence % slots.size()].computed;
+        }
+
+        // Drops submission `sequence` after a failed recording, freeing its slot again
+        void cancel(uint64_t sequence);
+
+        // Waits for everything in flight and frees every slot, dropping what they recorded. For
+        // giving up on a run half way, so the next one starts with an idle ring
+        void abandon();
+
+        // Blocks until submission `sequence` has finished and returns the bytes it copied
+        [[nodiscard]] std::span<const uint8_t> wait(uint64_t sequence);
+
+        // Hands the slot of `sequence` back once the host is done with the data from wait()
+        void release(uint64_t sequence);
+
+        // Logs how much of the GPU work and the host processing ran concurrently
+        void report(uint64_t submissions) const;
+
+        [[nodiscard]] uint32_t get_slot_count() const { return static_cast<uint32_t>(slots.size()); }
+
+    private:
+        struct Slot final
+        {
+            Buffer                  staging{ nullptr };
+            const uint8_t*          mapped{ nullptr };
+            vk::DeviceSize          copied{ 0 };
+            vk::UniqueCommandBuffer command_buffer{ nullptr };
+            vk::UniqueCommandBuffer transfer_command_buffer{ nullptr }; // only with a transfer queue
+            QueueTicket             ticket;
+            QueueTicket             computed; // of the compute commands alone
+            bool                    busy{ false };
+            bool                    recorded{ false }; // the command buffers hold a submitted recording
+        };
+
+        using Clock = std::chrono::steady_clock;
+
+        [[nodiscard]] bool create_slots(CommandPool& command_pool, CommandPool& transfer_command_pool, uint32_t slot_count);
+        [[nodiscard]] bool create_query_pool(uint32_t slot_count);
+
+        // Claims the released slot of `sequence`, starting the overlap accounting with the first one
+        [[nodiscard]] bool acquire(uint64_t sequence);
+
+        // Blocks until every submission of every slot has finished
+        void wait_pending() const;
+
+        // Submits the command buffers of the slot, and its copies on the transfer queue after them
+        [[nodiscard]] bool submit_slot(Slot& slot, uint32_t queue, std::span<const QueueScheduler::Wait> waits);
+
+        [[nodiscard]] Slot& slot_of(const uint64_t sequence) { return slots[sequence % slots.size()]; }
+
+        std::vector<Slot>     slots;
+        vk::DeviceSize        slot_size{ 0 };
+        vk::UniqueQueryPool   query_pool{ nullptr };
+        float                 timestamp_period{ 0.0f }; // nanoseconds per tick, 0 without timestamps
+        bool                  transfer_timestamps{ false }; // whether the copies can write the last one
+        vk::CommandBuffer     recording{ nullptr };
+        vk::CommandBuffer     copying{ nullptr }; // recording itself without a transfer queue
+        uint64_t              recording_sequence{ 0 };
+
+        // Overlap accounting
+        Clock::time_point first_begin{};
+        Clock::time_point last_release{};
+        Clock::time_point host_work_start{};
+        double            gpu_ms{ 0.0 };
+        double            host_wait_ms{ 0.0 };
+        double            host_work_ms{ 0.0 };
+
+        std::optional<std::reference_wrapper<const Device>> device{ std::nullopt };
+
+        bool ok = false;
+    };
+}
@@ -0,0 +1,42 @@
+#include "ThreadPool.hpp"
+
+namespace boza
+{
+    namespace
+    {
+        // The pool the calling thread works for, if any
+        thread_local const ThreadPool* current_pool{ nullptr };
+    }
+
+    ThreadPool::ThreadPool(const uint32_t thread_count)
+    {
+        threads.reserve(std::max(thread_count, 1u));
+        for (uint32_t i = 0; i < std::max(thread_count, 1u); ++i)
+            threads.emplace_back([this](const std::stop_token& stop) { work(stop); });
+    }
+
+    void ThreadPool::work(const std::stop_token& stop)
+    {
+        current_pool = this;
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock{ mutex };
+                if (!condition.wait(lock, stop, [this] { return !tasks.empty(); })) return;
+
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+
+            task();
+        }
+    }
+
+    uint32_t parallel_thread_count()
+    {
+        const uint32_t hardware_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        if (!current_pool) return hardware_threads;
+        return std::max(hardware_threads / current_pool->get_thread_count(), 1u);
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    // Fixed set of workers running tasks in submission order. Tasks still queued when the
+    // pool is destroyed are dropped, and their futures report a broken promise.
+    class ThreadPool final
+    {
+    public:
+        explicit ThreadPool(uint32_t thread_count);
+
+        ThreadPool(const ThreadPool&)            = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ThreadPool(ThreadPool&&)                 = delete;
+        ThreadPool& operator=(ThreadPool&&)      = delete;
+
+        template<typename Task>
+        std::future<std::invoke_result_t<Task>> submit(Task&& task)
+        {
+            using Result = std::invoke_result_t<Task>;
+
+            // std::function needs a copyable target, the packaged task is not
+            auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+            std::future<Result> future = packaged->get_future();
+            {
+                std::lock_guard lock{ mutex };
+                tasks.emplace([packaged] { (*packaged)(); });
+            }
+
+            condition.notify_one();
+            return future;
+        }
+
+        [[nodiscard]] uint32_t get_thread_count() const { return static_cast<uint32_t>(threads.size()); }
+
+    private:
+        void work(const std::stop_token& stop);
+
+        std::mutex                        mutex;
+        std::condition_variable_any       condition;
+        std::queue<std::function<void()>> tasks;
+
+        // Last, so the workers are stopped and joined before the queue goes away
+        std::vector<std::jthread> threads;
+    };
+
+    // Threads for a parallel loop on the calling thread: every hardware thread, or an equal share
+    // of them on a pool worker, whose siblings may be running loops of their own
+    [[nodiscard]] uint32_t parallel_thread_count();
+
+    // Runs fn(i) for every i below count on up to thread_count threads, the calling one included,
+    // each taking the next index as it finishes the last
+    template <typename Fn>
+    void parallel_for(const uint32_t count, const uint32_t thread_count, const Fn& fn)
+    {
+        std::atomic<uint32_t> next{ 0 };
+        const auto            run = [&]
+        {
+            for (uint32_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+                fn(i);
+        };
+
+        std::vector<std::jthread> workers;
+        const uint32_t            worker_count = std::min(thread_count, count);
+        if (worker_count > 1) workers.reserve(worker_count - 1);
+        for (uint32_t t = 1; t < worker_count; ++t)
+            workers.emplace_back(run);
+
+        run();
+    }
+}
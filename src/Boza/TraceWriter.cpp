@@ -0,0 +1,129 @@
+#include "TraceWriter.hpp"
+#include "Logger.hpp"
+
+namespace boza
+{
+    bool TraceWriter::write_chrome_trace(const std::string& filename, const std::span<const TraceEvent> events)
+    {
+        int64_t origin = std::numeric_limits<int64_t>::max();
+        for (const TraceEvent& event : events) origin = std::min(origin, event.begin_ns);
+
+        // Thread ids in order of first appearance, named by metadata events
+        std::vector<std::string_view> tracks;
+        const auto track_id = [&tracks](const std::string_view track)
+        {
+            const auto found = std::ranges::find(tracks, track);
+            if (found != tracks.end()) return static_cast<size_t>(found - tracks.begin()) + 1;
+
+            tracks.push_back(track);
+            return tracks.size();
+        };
+
+        std::string contents = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (const TraceEvent& event : events)
+        {
+            const std::string args = event.bytes == 0 && event.allocations == 0
+                                         ? std::string{}
+                                         : std::format(",\"args\":{{\"bytes\":{},\"allocations\":{}}}",
+                                                       event.bytes, event.allocations);
+
+            contents += std::format("{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},"
+                                    "\"ts\":{:.3f},\"dur\":{:.3f}{}}},\n",
+                                    escape(event.name), escape(event.track), track_id(event.track),
+                                    static_cast<double>(event.begin_ns - origin) / 1e3,
+                                    static_cast<double>(event.duration_ns) / 1e3, args);
+        }
+
+        for (size_t i = 0; i < tracks.size(); ++i)
+        {
+            contents += std::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},"
+                                    "\"args\":{{\"name\":\"{}\"}}}},\n",
+                                    i + 1, escape(tracks[i]));
+        }
+
+        contents += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Vulkan-OBJ-Voxelizer\"}}\n]}\n";
+        return write_file(filename, contents);
+    }
+
+    bool TraceWriter::write_summary(const std::string& filename, const std::string_view input,
+                                    const std::span<const TraceEvent> events)
+    {
+        struct Phase final
+        {
+            std::string_view track;
+            std::string_view name;
+            uint64_t         count{ 0 };
+            int64_t          total_ns{ 0 };
+            int64_t          min_ns{ std::numeric_limits<int64_t>::max() };
+            int64_t          max_ns{ 0 };
+            uint64_t         bytes{ 0 };
+            uint64_t         allocations{ 0 };
+        };
+
+        // In order of first appearance, which is the order the phases run in
+        std::vector<Phase> phases;
+        for (const TraceEvent& event : events)
+        {
+            auto phase = std::ranges::find_if(phases, [&](const Phase& p)
+            {
+                return p.track == event.track && p.name == event.name;
+            });
+            if (phase == phases.end()) phase = phases.insert(phases.end(), Phase{ event.track, event.name });
+
+            ++phase->count;
+            phase->total_ns += event.duration_ns;
+            phase->min_ns = std::min(phase->min_ns, event.duration_ns);
+            phase->max_ns = std::max(phase->max_ns, event.duration_ns);
+            phase->bytes += event.bytes;
+            phase->allocations += event.allocations;
+        }
+
+        std::string contents = std::format("{{\n  \"input\": \"{}\",\n  \"phases\": [", escape(input));
+        for (size_t i = 0; i < phases.size(); ++i)
+        {
+            const Phase& phase = phases[i];
+            contents += std::format("{}\n    {{ \"track\": \"{}\", \"name\": \"{}\", \"count\": {}, \"total_ms\": {:.3f}, "
+                                    "\"min_ms\": {:.3f}, \"max_ms\": {:.3f}, \"bytes\": {}, \"allocations\": {} }}",
+                                    i == 0 ? "" : ",", escape(phase.track), escape(phase.name), phase.count,
+                                    static_cast<double>(phase.total_ns) / 1e6,
+                                    static_cast<double>(phase.min_ns) / 1e6,
+                                    static_cast<double>(phase.max_ns) / 1e6,
+                                    phase.bytes, phase.allocations);
+        }
+
+        contents += "\n  ]\n}\n";
+        return write_file(filename, contents);
+    }
+
+
+    std::string TraceWriter::escape(const std::string_view text)
+    {
+        std::string escaped;
+        escaped.reserve(text.size());
+
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) escaped += std::format("\\u{:04x}", static_cast<int>(c));
+            else escaped += c;
+        }
+
+        return escaped;
+    }
+
+    bool TraceWriter::write_file(const std::string& filename, const std::string& contents)
+    {
+        std::ofstream file{ filename, std::ios::binary };
+        if (!file || !file.write(contents.data(), static_cast<std::streamsize>(contents.size())))
+        {
+            Logger::error("Failed to write {}", filename);
+            return false;
+        }
+
+        return true;
+    }
+}
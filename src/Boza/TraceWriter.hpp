@@ -0,0 +1,38 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    // A span of work on one timeline, in nanoseconds of std::chrono::steady_clock, so GPU times
+    // converted to the host clock line up with the CPU work around them
+    struct TraceEvent final
+    {
+        std::string name;
+        std::string track; // a thread or a queue, one row of the trace
+        int64_t     begin_ns{ 0 };
+        int64_t     duration_ns{ 0 };
+
+        // Counted by the CPU zones, PROFILE_BYTES and PROFILE_ALLOCATION in macros.hpp
+        uint64_t bytes{ 0 };
+        uint64_t allocations{ 0 };
+    };
+
+    class TraceWriter final
+    {
+    public:
+        TraceWriter() = delete;
+
+        // Complete events in the Chrome trace event format, opened by about:tracing or Perfetto.
+        // Every track becomes a thread of its own, and times start at the earliest event
+        [[nodiscard]] static bool write_chrome_trace(const std::string& filename, std::span<const TraceEvent> events);
+
+        // Count, total, shortest and longest duration of every name on every track, and the bytes
+        // and allocations it counted, as JSON
+        [[nodiscard]] static bool write_summary(const std::string& filename, std::string_view input,
+                                                std::span<const TraceEvent> events);
+
+    private:
+        [[nodiscard]] static std::string escape(std::string_view text);
+        [[nodiscard]] static bool        write_file(const std::string& filename, const std::string& contents);
+    };
+}
@@ -0,0 +1,72 @@
+#include "TriangleBinner.hpp"
+#include "Logger.hpp"
+
+namespace boza
+{
+    TriangleBins TriangleBinner::bin_triangles(const MeshData& mesh_data, const VoxelGrid& grid)
+    {
+        TriangleBins bins;
+        bins.brick_count = (grid.extent + brick_size - 1u) / brick_size;
+
+        const size_t brick_total    = static_cast<size_t>(bins.brick_count.x) * bins.brick_count.y * bins.brick_count.z;
+        const size_t triangle_count = mesh_data.indices.size() / 3;
+
+        // Brick range of every triangle, widened by one voxel on each side so that
+        // rounding can never drop a candidate the overlap test would accept.
+        struct BrickRange final
+        {
+            glm::ivec3 first;
+            glm::ivec3 last;
+        };
+
+        const glm::ivec3 last_brick = glm::ivec3(bins.brick_count) - 1;
+
+        std::vector<BrickRange> ranges(triangle_count);
+        for (size_t t = 0; t < triangle_count; ++t)
+        {
+            const glm::vec3 v0 = grid.to_voxel_space(glm::vec3{ mesh_data.vertices[mesh_data.indices[t * 3 + 0]] });
+            const glm::vec3 v1 = grid.to_voxel_space(glm::vec3{ mesh_data.vertices[mesh_data.indices[t * 3 + 1]] });
+            const glm::vec3 v2 = grid.to_voxel_space(glm::vec3{ mesh_data.vertices[mesh_data.indices[t * 3 + 2]] });
+
+            const glm::ivec3 first_voxel = glm::ivec3(glm::floor(glm::min(v0, glm::min(v1, v2)))) - 1;
+            const glm::ivec3 last_voxel  = glm::ivec3(glm::floor(glm::max(v0, glm::max(v1, v2)))) + 1;
+
+            ranges[t] = {
+                glm::max(glm::ivec3(glm::floor(glm::vec3(first_voxel) / static_cast<float>(brick_size))), glm::ivec3(0)),
+                glm::min(glm::ivec3(glm::floor(glm::vec3(last_voxel) / static_cast<float>(brick_size))), last_brick)
+            };
+        }
+
+        const auto for_each_brick = [&](const BrickRange& range, auto&& fn)
+        {
+            for (int z = range.first.z; z <= range.last.z; ++z)
+                for (int y = range.first.y; y <= range.last.y; ++y)
+                    for (int x = range.first.x; x <= range.last.x; ++x)
+                        fn((static_cast<size_t>(z) * bins.brick_count.y + static_cast<size_t>(y)) * bins.brick_count.x
+                           + static_cast<size_t>(x));
+        };
+
+        // Count, exclusive prefix sum, scatter
+        std::vector<uint32_t> counts(brick_total, 0);
+        for (const auto& range : ranges)
+            for_each_brick(range, [&](const size_t brick) { ++counts[brick]; });
+
+        bins.offsets.resize(brick_total + 1);
+        bins.offsets[0] = 0;
+        for (size_t b = 0; b < brick_total; ++b)
+            bins.offsets[b + 1] = bins.offsets[b] + counts[b];
+
+        bins.triangles.resize(bins.offsets[brick_total]);
+
+        std::vector<uint32_t> cursors(bins.offsets.begin(), bins.offsets.end() - 1);
+        for (size_t t = 0; t < triangle_count; ++t)
+            for_each_brick(ranges[t], [&](const size_t brick) { bins.triangles[cursors[brick]++] = static_cast<uint32_t>(t); });
+
+        const uint32_t max_per_brick = counts.empty() ? 0 : *std::ranges::max_element(counts);
+        Logger::trace("Binned {} triangles into {} bricks: {} references, {} per brick on average, {} at most",
+                      triangle_count, brick_total, bins.triangles.size(),
+                      static_cast<double>(bins.triangles.size()) / static_cast<double>(brick_total), max_per_brick);
+
+        return bins;
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "pch.hpp"
+#include "TriangleLoader.hpp"
+#include "VoxelGrid.hpp"
+
+namespace boza
+{
+    // Compact per-brick triangle lists: the triangles of brick b are
+    // triangles[offsets[b]] .. triangles[offsets[b + 1] - 1].
+    struct TriangleBins final
+    {
+        glm::uvec3            brick_count{};
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+
+        operator bool () const { return !offsets.empty(); }
+    };
+
+    class TriangleBinner final
+    {
+    public:
+        // Edge length of a brick in voxels, equal to the workgroup size of voxelize_voxels.comp
+        static constexpr uint32_t brick_size = 8;
+
+        TriangleBinner() = delete;
+        static TriangleBins bin_triangles(const MeshData& mesh_data, const VoxelGrid& grid);
+    };
+}
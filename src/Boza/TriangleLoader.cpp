@@ -1,45 +1,481 @@
 #include "TriangleLoader.hpp"
-#include "Logger.hpp"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
+#include "CpuProfiler.hpp"
+#include "Logger.hpp"
+#include "ThreadPool.hpp"
 
 namespace boza
 {
-    MeshData TriangleLoader::load_from_obj(const std::string& filename)
+    MeshData::MeshData(std::vector<glm::vec4>&& vertices,
+                       std::vector<uint32_t>&&  indices,
+                       const glm::vec3&         bounds_min,
+                       const glm::vec3&         bounds_max)
+        : vertices{ vertices }, indices{ indices }, bounds_min{ bounds_min }, bounds_max{ bounds_max },
+          vertex_storage{ std::move(vertices) }, index_storage{ std::move(indices) } {}
+
+    MeshData::MeshData(MappedFile&&                     mapping,
+                       const std::span<const glm::vec4> vertices,
+                       const std::span<const uint32_t>  indices,
+                       const glm::vec3&                 bounds_min,
+                       const glm::vec3&                 bounds_max)
+        : vertices{ vertices }, indices{ indices }, bounds_min{ bounds_min }, bounds_max{ bounds_max },
+          mapping{ std::move(mapping) } {}
+
+    MeshData::MeshData(MeshStorage&& storage, const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+        : vertices{ storage.vertices }, indices{ storage.indices }, bounds_min{ bounds_min }, bounds_max{ bounds_max },
+          owner{ std::move(storage.owner) } {}
+
+    bool MeshData::is_watertight() const
+    {
+        std::unordered_map<uint64_t, uint32_t> edge_counts;
+        edge_counts.reserve(indices.size());
+
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const uint32_t a = indices[i + k];
+                const uint32_t b = indices[i + (k + 1) % 3];
+                ++edge_counts[static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b)];
+            }
+        }
+
+        return std::ranges::all_of(edge_counts, [](const auto& edge) { return edge.second == 2; });
+    }
+
+    MeshData TriangleLoader::load(const std::string& filename, const bool use_cache, const MeshSink& sink)
+    {
+        if (!use_cache) return load_from_obj(filename, sink);
+
+        // Mapping is lazy, the source pages are only read when parsing or hashing
+        const MappedFile source{ filename };
+        if (!source) return {};
+
+        std::error_code error;
+        const auto      modified = std::filesystem::last_write_time(filename, error);
+        const int64_t   mtime    = error ? 0 : static_cast<int64_t>(modified.time_since_epoch().count());
+
+        const std::string cache_filename = filename + ".bzmesh";
+        if (MeshData mesh_data = load_cache(cache_filename, source.get_data(), mtime, sink)) return mesh_data;
+
+        MeshData mesh_data = parse_obj(source.get_data(), filename, sink);
+        if (mesh_data) write_cache(cache_filename, mesh_data, source.get_data(), mtime);
+        return mesh_data;
+    }
+
+    MeshData TriangleLoader::load_from_obj(const std::string& filename, const MeshSink& sink)
+    {
+        const MappedFile file{ filename };
+        if (!file) return {};
+
+        return parse_obj(file.get_data(), filename, sink);
+    }
+
+    MeshData TriangleLoader::parse_obj(const std::string_view text, const std::string& filename, const MeshSink& sink)
+    {
+        PROFILE_ZONE("OBJ parse");
+        const auto start = std::chrono::steady_clock::now();
+
+        // One chunk per thread, but small files are not worth the threads
+        const size_t   max_chunks  = std::max<size_t>(text.size() / min_chunk_size, 1);
+        const uint32_t chunk_count = static_cast<uint32_t>(
+            std::clamp<size_t>(parallel_thread_count(), 1, max_chunks));
+
+        // Chunks end right after a newline, so no line is ever split between two of them
+        std::vector<size_t> bounds(chunk_count + 1, text.size());
+        bounds[0] = 0;
+        for (uint32_t i = 1; i < chunk_count; ++i)
+        {
+            const size_t newline = text.find('\n', std::max(text.size() / chunk_count * i, bounds[i - 1]));
+            bounds[i] = newline == std::string_view::npos ? text.size() : newline + 1;
+        }
+
+        std::vector<ObjChunk> chunks(chunk_count);
+        parallel_for(chunk_count, chunk_count, [&](const uint32_t i)
+        {
+            PROFILE_ZONE("OBJ parse chunk");
+            parse_chunk(text.substr(bounds[i], bounds[i + 1] - bounds[i]), chunks[i]);
+        });
+
+        for (uint32_t i = 0; i < chunk_count; ++i)
+        {
+            if (chunks[i].error_offset == std::string_view::npos) continue;
+
+            const size_t offset = bounds[i] + chunks[i].error_offset;
+            const auto   line   = std::count(text.begin(), text.begin() + static_cast<ptrdiff_t>(offset), '\n') + 1;
+            Logger::error("{}:{}: {}", filename, line, chunks[i].error);
+            return {};
+        }
+
+        // Where each chunk's vertices and indices start in the whole mesh
+        std::vector<size_t> vertex_offsets(chunk_count + 1, 0);
+        std::vector<size_t> index_offsets(chunk_count + 1, 0);
+        for (uint32_t i = 0; i < chunk_count; ++i)
+        {
+            vertex_offsets[i + 1] = vertex_offsets[i] + chunks[i].vertices.size();
+            index_offsets[i + 1]  = index_offsets[i] + chunks[i].indices.size();
+        }
+
+        const size_t vertex_count = vertex_offsets.back();
+        if (vertex_count > std::numeric_limits<uint32_t>::max())
+        {
+            Logger::error("{} has {} vertices, more than 32-bit indices can address", filename, vertex_count);
+            return {};
+        }
+
+        // Without a sink, the mesh keeps arrays of its own
+        std::vector<glm::vec4> vertex_storage;
+        std::vector<uint32_t>  index_storage;
+        MeshStorage            storage;
+        if (sink)
+        {
+            storage = sink(vertex_count, index_offsets.back());
+        }
+        else
+        {
+            vertex_storage.resize(vertex_count);
+            index_storage.resize(index_offsets.back());
+            storage.vertices = vertex_storage;
+            storage.indices  = index_storage;
+        }
+
+        if (storage.vertices.size() != vertex_count || storage.indices.size() != index_offsets.back())
+        {
+            Logger::error("No storage for the {} vertices and {} indices of {}", vertex_count, index_offsets.back(),
+                          filename);
+            return {};
+        }
+
+        const std::span<glm::vec4> vertices = storage.vertices;
+        const std::span<uint32_t>  indices  = storage.indices;
+        glm::vec3                  bounds_min{ std::numeric_limits<float>::max() };
+        glm::vec3                  bounds_max{ std::numeric_limits<float>::lowest() };
+        for (const ObjChunk& chunk : chunks)
+        {
+            bounds_min = glm::min(bounds_min, chunk.bounds_min);
+            bounds_max = glm::max(bounds_max, chunk.bounds_max);
+        }
+
+        std::atomic invalid_index{ false };
+        parallel_for(chunk_count, chunk_count, [&](const uint32_t i)
+        {
+            PROFILE_ZONE("mesh merge");
+            PROFILE_BYTES(chunks[i].vertices.size() * sizeof(glm::vec4) + chunks[i].indices.size() * sizeof(uint32_t));
+
+            ObjChunk& chunk = chunks[i];
+            std::ranges::copy(chunk.vertices, vertices.begin() + static_cast<ptrdiff_t>(vertex_offsets[i]));
+            std::ranges::copy(chunk.indices, indices.begin() + static_cast<ptrdiff_t>(index_offsets[i]));
+
+            for (const auto& [position, local] : chunk.relative)
+            {
+                const int64_t index = static_cast<int64_t>(vertex_offsets[i]) + local;
+                if (index < 0) invalid_index = true;
+                indices[index_offsets[i] + position] = static_cast<uint32_t>(index);
+            }
+
+            if (std::ranges::any_of(chunk.indices, [&](const uint32_t index) { return index >= vertex_count; }))
+                invalid_index = true;
+
+            chunk = {};
+        });
+
+        if (invalid_index)
+        {
+            Logger::error("{} has faces referring to vertices it does not define", filename);
+            return {};
+        }
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        Logger::info("Loaded {} vertices and {} triangles from {} in {:.2f} ms ({} threads)", vertex_count,
+                     indices.size() / 3, filename, elapsed.count(), chunk_count);
+
+        if (sink) return { std::move(storage), bounds_min, bounds_max };
+        return { std::move(vertex_storage), std::move(index_storage), bounds_min, bounds_max };
+    }
+
+    MeshData TriangleLoader::load_cache(const std::string& cache_filename, const std::string_view source,
+                                        const int64_t source_mtime, const MeshSink& sink)
     {
-        tinyobj::attrib_t                attrib;
-        std::vector<tinyobj::shape_t>    shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string                      warn, err;
+        if (!std::filesystem::exists(cache_filename)) return {};
 
-        if (!LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str()))
+        PROFILE_ZONE("mesh cache read");
+        const auto start = std::chrono::steady_clock::now();
+
+        MappedFile cache{ cache_filename };
+        if (!cache) return {};
+
+        const std::string_view data = cache.get_data();
+        if (data.size() < sizeof(CacheHeader))
+        {
+            Logger::warn("Mesh cache {} is truncated, parsing the OBJ file again", cache_filename);
+            return {};
+        }
+
+        CacheHeader header{};
+        std::memcpy(&header, data.data(), sizeof(CacheHeader));
+
+        // The counts are bounded by the file size first, so the expected size cannot overflow
+        const bool counts_fit = header.vertex_count <= data.size() / sizeof(glm::vec4) &&
+                                header.index_count <= data.size() / sizeof(uint32_t);
+
+        const uint64_t expected_size = counts_fit ? sizeof(CacheHeader) + header.vertex_count * sizeof(glm::vec4) +
+                                                    header.index_count * sizeof(uint32_t)
+                                                  : 0;
+        if (header.magic != cache_magic || header.version != cache_version || header.index_count % 3 != 0 ||
+            header.vertex_count > std::numeric_limits<uint32_t>::max() || !counts_fit || data.size() != expected_size)
+        {
+            Logger::warn("{} is not a mesh cache of this version, parsing the OBJ file again", cache_filename);
+            return {};
+        }
+
+        // A copy or checkout changes the modification time but not the contents
+        if (header.source_size != source.size() ||
+            (header.source_mtime != source_mtime && header.source_hash != hash_source(source)))
+        {
+            Logger::info("Mesh cache {} is out of date", cache_filename);
+            return {};
+        }
+
+        // Used in place: the vertices start 16-byte aligned, right after the header
+        const auto* vertices = reinterpret_cast<const glm::vec4*>(data.data() + sizeof(CacheHeader));
+        const auto* indices  = reinterpret_cast<const uint32_t*>(vertices + header.vertex_count);
+
+        // The shaders index the vertex buffer with these unchecked
+        const std::span<const uint32_t> index_span{ indices, static_cast<size_t>(header.index_count) };
+        if (std::ranges::any_of(index_span, [&](const uint32_t index) { return index >= header.vertex_count; }))
         {
-            Logger::error("Failed to load OBJ file: {}", err);
+            Logger::warn("Mesh cache {} has indices past its {} vertices, parsing the OBJ file again", cache_filename,
+                         header.vertex_count);
             return {};
         }
 
-        if (!warn.empty()) Logger::warn(warn);
+        const glm::vec3 bounds_min{ header.bounds_min };
+        const glm::vec3 bounds_max{ header.bounds_max };
+
+        if (sink)
+        {
+            const auto vertex_count = static_cast<size_t>(header.vertex_count);
+            const auto index_count  = static_cast<size_t>(header.index_count);
+
+            MeshStorage storage = sink(vertex_count, index_count);
+            if (storage.vertices.size() != vertex_count || storage.indices.size() != index_count)
+            {
+                Logger::error("No storage for the {} vertices and {} indices of {}", vertex_count, index_count,
+                              cache_filename);
+                return {};
+            }
+
+            PROFILE_BYTES(storage.vertices.size_bytes() + storage.indices.size_bytes());
+            std::memcpy(storage.vertices.data(), vertices, storage.vertices.size_bytes());
+            std::memcpy(storage.indices.data(), indices, storage.indices.size_bytes());
+
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            Logger::info("Read {} vertices and {} triangles from {} in {:.2f} ms", vertex_count, index_count / 3,
+                         cache_filename, elapsed.count());
+
+            return { std::move(storage), bounds_min, bounds_max };
+        }
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        Logger::info("Mapped {} vertices and {} triangles from {} in {:.2f} ms", header.vertex_count,
+                     header.index_count / 3, cache_filename, elapsed.count());
+
+        return {
+            std::move(cache),
+            { vertices, static_cast<size_t>(header.vertex_count) },
+            { indices, static_cast<size_t>(header.index_count) },
+            bounds_min,
+            bounds_max
+        };
+    }
+
+    void TriangleLoader::write_cache(const std::string& cache_filename, const MeshData& mesh_data,
+                                     const std::string_view source, const int64_t source_mtime)
+    {
+        PROFILE_ZONE("mesh cache write");
+        PROFILE_BYTES(mesh_data.vertices.size_bytes() + mesh_data.indices.size_bytes());
+
+        const CacheHeader header
+        {
+            cache_magic,
+            cache_version,
+            mesh_data.vertices.size(),
+            mesh_data.indices.size(),
+            source.size(),
+            source_mtime,
+            hash_source(source),
+            glm::vec4{ mesh_data.bounds_min, 0.0f },
+            glm::vec4{ mesh_data.bounds_max, 0.0f }
+        };
+
+        // A concurrent run never maps a torn cache
+        std::string error;
+        if (!write_file_atomically(cache_filename,
+                                   {
+                                       std::as_bytes(std::span{ &header, 1 }),
+                                       std::as_bytes(mesh_data.vertices),
+                                       std::as_bytes(mesh_data.indices)
+                                   },
+                                   error))
+        {
+            // Read-only input directories are fine, the mesh is just parsed every time
+            Logger::warn("Failed to write mesh cache: {}", error);
+            return;
+        }
+
+        Logger::trace("Wrote mesh cache {}", cache_filename);
+    }
 
-        MeshData out_mesh_data;
+    uint64_t TriangleLoader::hash_source(const std::string_view source)
+    {
+        // Fixed chunks hashed in parallel, 8 bytes at a time, then combined in order
+        const size_t          chunk_count = std::max<size_t>((source.size() + hash_chunk_size - 1) / hash_chunk_size, 1);
+        std::vector<uint64_t> chunk_hashes(chunk_count);
+
+        const uint32_t thread_count = static_cast<uint32_t>(
+            std::clamp<size_t>(parallel_thread_count(), 1, chunk_count));
+        parallel_for(thread_count, thread_count, [&](const uint32_t thread)
+        {
+            for (size_t chunk = thread; chunk < chunk_count; chunk += thread_count)
+            {
+                const std::string_view bytes = source.substr(chunk * hash_chunk_size, hash_chunk_size);
 
-        out_mesh_data.vertices.reserve(attrib.vertices.size() / 3);
+                uint64_t value = 0xcbf2'9ce4'8422'2325;
+                size_t   i     = 0;
+                for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t))
+                {
+                    uint64_t word;
+                    std::memcpy(&word, bytes.data() + i, sizeof(uint64_t));
+                    value = std::rotl((value ^ word) * 0x0000'0100'0000'01b3, 29);
+                }
+                for (; i < bytes.size(); ++i)
+                    value = (value ^ static_cast<uint8_t>(bytes[i])) * 0x0000'0100'0000'01b3;
+
+                chunk_hashes[chunk] = value;
+            }
+        });
+
+        uint64_t value = 0xcbf2'9ce4'8422'2325;
+        for (const uint64_t chunk_hash : chunk_hashes)
+            value = (value ^ chunk_hash) * 0x0000'0100'0000'01b3;
+
+        return value;
+    }
 
-        for (size_t i = 0; i < attrib.vertices.size(); i += 3)
+    void TriangleLoader::parse_chunk(const std::string_view text, ObjChunk& chunk)
+    {
+        const char* const begin = text.data();
+        const char* const end   = begin + text.size();
+
+        // Rough guesses at a typical line length, to spare most of the reallocations
+        chunk.vertices.reserve(text.size() / 64);
+        chunk.indices.reserve(text.size() / 16);
+
+        for (const char* line = begin; line < end;)
         {
-            out_mesh_data.vertices.emplace_back(
-                attrib.vertices[i],
-                attrib.vertices[i + 1],
-                attrib.vertices[i + 2]
-            );
+            const char* line_end = static_cast<const char*>(std::memchr(line, '\n', static_cast<size_t>(end - line)));
+            if (line_end == nullptr) line_end = end;
+
+            const char* p = skip_spaces(line, line_end);
+            const bool  keyword_end = p + 1 < line_end && (p[1] == ' ' || p[1] == '\t');
+
+            if (keyword_end && p[0] == 'v')
+            {
+                // x y z, followed by an optional w or a vertex color that are ignored
+                glm::vec4 vertex{ 0.0f };
+                ++p;
+                if (!parse_float(p, line_end, vertex.x) || !parse_float(p, line_end, vertex.y) ||
+                    !parse_float(p, line_end, vertex.z))
+                {
+                    chunk.error_offset = static_cast<size_t>(line - begin);
+                    chunk.error        = "expected a vertex position";
+                    return;
+                }
+
+                chunk.vertices.push_back(vertex);
+                chunk.bounds_min = glm::min(chunk.bounds_min, glm::vec3{ vertex });
+                chunk.bounds_max = glm::max(chunk.bounds_max, glm::vec3{ vertex });
+            }
+            else if (keyword_end && p[0] == 'f')
+            {
+                // Fan around the first corner, which is exact for the convex polygons OBJ allows
+                int64_t  first = 0, previous = 0, index = 0;
+                uint32_t corner_count = 0;
+                for (++p; (p = skip_spaces(p, line_end)) < line_end && !is_line_end(*p); ++corner_count)
+                {
+                    if (!parse_index(p, line_end, index))
+                    {
+                        chunk.error_offset = static_cast<size_t>(line - begin);
+                        chunk.error        = "expected a vertex index";
+                        return;
+                    }
+
+                    if (corner_count == 0) first = index;
+                    else if (corner_count >= 2)
+                    {
+                        push_index(chunk, first);
+                        push_index(chunk, previous);
+                        push_index(chunk, index);
+                    }
+
+                    previous = index;
+                }
+
+                if (corner_count < 3)
+                {
+                    chunk.error_offset = static_cast<size_t>(line - begin);
+                    chunk.error        = "a face needs at least three corners";
+                    return;
+                }
+            }
+
+            // Normals, texture coordinates, groups, materials and comments are not needed
+            line = line_end + 1;
         }
+    }
 
-        for (const auto& shape : shapes)
+    void TriangleLoader::push_index(ObjChunk& chunk, const int64_t index)
+    {
+        if (index > 0)
         {
-            for (const auto& index : shape.mesh.indices)
-                out_mesh_data.indices.push_back(static_cast<uint32_t>(index.vertex_index));
+            chunk.indices.push_back(static_cast<uint32_t>(index - 1));
+            return;
         }
 
-        return out_mesh_data;
+        // Counts back from the last vertex so far, which may lie in an earlier chunk
+        chunk.relative.emplace_back(chunk.indices.size(), static_cast<int64_t>(chunk.vertices.size()) + index);
+        chunk.indices.push_back(0);
+    }
+
+    bool TriangleLoader::parse_float(const char*& p, const char* end, float& value)
+    {
+        p = skip_spaces(p, end);
+        if (p < end && *p == '+') ++p;
+
+        // Eisel-Lemire in current standard libraries, several times faster than strtof
+        const auto [next, error] = std::from_chars(p, end, value);
+        if (error != std::errc{}) return false;
+
+        p = next;
+        return p == end || is_separator(*p);
+    }
+
+    bool TriangleLoader::parse_index(const char*& p, const char* end, int64_t& index)
+    {
+        const auto [next, error] = std::from_chars(p, end, index);
+        if (error != std::errc{} || index == 0 || index > std::numeric_limits<uint32_t>::max()) return false;
+
+        // Texture coordinate and normal indices, as in v/vt/vn or v//vn, are skipped
+        p = next;
+        if (p < end && *p == '/')
+            while (p < end && !is_separator(*p)) ++p;
+
+        return p == end || is_separator(*p);
+    }
+
+    const char* TriangleLoader::skip_spaces(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        return p;
     }
 }
@@ -1,20 +1,144 @@
 #pragma once
 #include "pch.hpp"
+#include "MappedFile.hpp"
 
 namespace boza
 {
-    struct MeshData final
+    // Memory for a mesh whose size is known, handed out by a MeshSink. The owner keeps it alive
+    // for as long as the mesh refers to it
+    struct MeshStorage final
     {
-        std::vector<glm::vec3> vertices;
-        std::vector<uint32_t> indices;
+        std::span<glm::vec4> vertices;
+        std::span<uint32_t>  indices;
+        std::any             owner;
+    };
+
+    // Lets the caller decide where a mesh ends up, such as a mapped staging buffer, so it is written
+    // once and never copied. Called on the loading thread once the counts are known; storage of
+    // the wrong size fails the load
+    using MeshSink = std::function<MeshStorage(size_t vertex_count, size_t index_count)>;
+
+    // Positions padded to vec4 with w = 0, the layout of the vertex buffer, and three indices per
+    // triangle. The spans point either into arrays owned by the mesh or into a mapped mesh cache,
+    // so a mesh is moved around but never copied.
+    class MeshData final
+    {
+    public:
+        MeshData() = default;
+        MeshData(std::vector<glm::vec4>&& vertices, std::vector<uint32_t>&& indices,
+                 const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+        MeshData(MappedFile&& mapping, std::span<const glm::vec4> vertices, std::span<const uint32_t> indices,
+                 const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+        MeshData(MeshStorage&& storage, const glm::vec3& bounds_min, const glm::vec3& bounds_max);
+
+        MeshData(const MeshData&)            = delete;
+        MeshData& operator=(const MeshData&) = delete;
+
+        // Moving a vector keeps its buffer, so the spans stay valid
+        MeshData(MeshData&&) noexcept            = default;
+        MeshData& operator=(MeshData&&) noexcept = default;
 
         operator bool () const { return !vertices.empty() && !indices.empty(); }
+
+        // Every edge shared by exactly two triangles, as required for a meaningful solid fill
+        [[nodiscard]] bool is_watertight() const;
+
+        // Whatever a MeshSink made the mesh's memory with, empty otherwise
+        [[nodiscard]] const std::any& get_owner() const { return owner; }
+
+        std::span<const glm::vec4> vertices;
+        std::span<const uint32_t>  indices;
+
+        // Object-space bounds of all vertices
+        glm::vec3 bounds_min{ 0.0f };
+        glm::vec3 bounds_max{ 0.0f };
+
+    private:
+        std::vector<glm::vec4> vertex_storage;
+        std::vector<uint32_t>  index_storage;
+        MappedFile             mapping{ nullptr };
+        std::any               owner;
     };
 
+    // Reads the positions and faces of an OBJ file, everything else is skipped. The file is mapped
+    // and split into chunks on line boundaries that are parsed in parallel, then merged in order.
+    // Polygons are fanned into triangles and negative indices count back from the last vertex.
+    //
+    // load() keeps the parsed mesh in a binary cache next to the OBJ file, FILE.obj.bzmesh. Later
+    // runs map the cache and use its pages as they are, as long as the OBJ file has the size and
+    // modification time it had, or, after a copy or checkout, the same contents.
+    //
+    // Given a sink, the chunks are merged, or the cache copied, straight into the sink's storage.
     class TriangleLoader final
     {
     public:
         TriangleLoader() = delete;
-        static MeshData load_from_obj(const std::string& filename);
+
+        // From the mesh cache when it is current, else parsed and cached
+        static MeshData load(const std::string& filename, bool use_cache, const MeshSink& sink = nullptr);
+
+        static MeshData load_from_obj(const std::string& filename, const MeshSink& sink = nullptr);
+
+    private:
+        struct CacheHeader final
+        {
+            uint32_t  magic;
+            uint32_t  version;
+            uint64_t  vertex_count;
+            uint64_t  index_count;
+            uint64_t  source_size;
+            int64_t   source_mtime;
+            uint64_t  source_hash;
+            glm::vec4 bounds_min;
+            glm::vec4 bounds_max;
+        };
+
+        // Keeps the vertices that follow 16-byte aligned, as mapped pages are
+        static_assert(sizeof(CacheHeader) == 80);
+
+        static constexpr uint32_t cache_magic{ 0x534D'5A42 }; // "BZMS"
+        static constexpr uint32_t cache_version{ 1 };
+
+        [[nodiscard]] static MeshData parse_obj(std::string_view text, const std::string& filename,
+                                                const MeshSink& sink);
+
+        [[nodiscard]] static MeshData load_cache(const std::string& cache_filename, std::string_view source,
+                                                 int64_t source_mtime, const MeshSink& sink);
+        static void write_cache(const std::string& cache_filename, const MeshData& mesh_data,
+                                std::string_view source, int64_t source_mtime);
+
+        // Identifies the contents of the OBJ file; the same on every machine, whatever its threads
+        [[nodiscard]] static uint64_t hash_source(std::string_view source);
+
+        // Everything one chunk of lines contributes to the mesh
+        struct ObjChunk final
+        {
+            std::vector<glm::vec4> vertices;
+            std::vector<uint32_t>  indices;
+
+            // Positions in indices of negative indices, with the vertex they refer to counted from the
+            // chunk's first one. Resolved once the vertices of the earlier chunks are known
+            std::vector<std::pair<size_t, int64_t>> relative;
+
+            glm::vec3 bounds_min{ std::numeric_limits<float>::max() };
+            glm::vec3 bounds_max{ std::numeric_limits<float>::lowest() };
+
+            size_t      error_offset{ std::string_view::npos };
+            const char* error{ nullptr };
+        };
+
+        // Below this, a chunk does not pay for its thread
+        static constexpr size_t min_chunk_size{ 1 << 20 };
+        static constexpr size_t hash_chunk_size{ 16 << 20 };
+
+        static void parse_chunk(std::string_view text, ObjChunk& chunk);
+        static void push_index(ObjChunk& chunk, int64_t index);
+
+        [[nodiscard]] static bool parse_float(const char*& p, const char* end, float& value);
+        [[nodiscard]] static bool parse_index(const char*& p, const char* end, int64_t& index);
+
+        [[nodiscard]] static const char* skip_spaces(const char* p, const char* end);
+        [[nodiscard]] static bool is_line_end(const char c) { return c == '\r' || c == '\n' || c == '#'; }
+        [[nodiscard]] static bool is_separator(const char c) { return c == ' ' || c == '\t' || is_line_end(c); }
     };
 }
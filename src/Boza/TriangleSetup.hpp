@@ -0,0 +1,21 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    // Mirror of struct TriangleSetup in shaders/src/voxel_common.glsl (std430)
+    struct TriangleSetup final
+    {
+        glm::vec4                bounds_min; // w = plane offset d1
+        glm::vec4                bounds_max; // w = plane offset d2
+        glm::vec4                normal;
+        std::array<glm::vec4, 3> edges_xy;   // xy = edge normal, z = edge offset
+        std::array<glm::vec4, 3> edges_yz;
+        std::array<glm::vec4, 3> edges_zx;
+        glm::vec4                v0;
+        glm::vec4                v1;
+        glm::vec4                v2;
+    };
+
+    static_assert(sizeof(TriangleSetup) == 15 * 16);
+}
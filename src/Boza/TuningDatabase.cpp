@@ -0,0 +1,128 @@
+#include "TuningDatabase.hpp"
+
+#include "Logger.hpp"
+#include "MappedFile.hpp"
+
+namespace boza
+{
+    bool DispatchTuning::fits(const vk::PhysicalDeviceLimits& limits) const
+    {
+        const auto fits_workgroup = [&](const glm::uvec3& size)
+        {
+            return size.x > 0 && size.y > 0 && size.z > 0 &&
+                   size.x <= limits.maxComputeWorkGroupSize[0] &&
+                   size.y <= limits.maxComputeWorkGroupSize[1] &&
+                   size.z <= limits.maxComputeWorkGroupSize[2] &&
+                   size.x * size.y * size.z <= limits.maxComputeWorkGroupInvocations;
+        };
+
+        return triangles_per_invocation > 0 &&
+               fits_workgroup({ triangle_workgroup_size, 1, 1 }) &&
+               fits_workgroup(voxel_workgroup_size);
+    }
+
+
+    bool TuningDatabase::load(const std::string& filename, const vk::PhysicalDeviceProperties& properties,
+                              DispatchTuning& tuning)
+    {
+        for (const Entry& entry : read(filename))
+        {
+            if (entry.vendor_id == properties.vendorID && entry.device_id == properties.deviceID &&
+                entry.driver_version == properties.driverVersion)
+            {
+                tuning = entry.tuning;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool TuningDatabase::store(const std::string& filename, const vk::PhysicalDeviceProperties& properties,
+                               const DispatchTuning& tuning)
+    {
+        std::vector<Entry> entries = read(filename);
+        std::erase_if(entries, [&](const Entry& entry)
+        {
+            return entry.vendor_id == properties.vendorID && entry.device_id == properties.deviceID &&
+                   entry.driver_version == properties.driverVersion;
+        });
+        entries.push_back({ properties.vendorID, properties.deviceID, properties.driverVersion, tuning,
+                            properties.deviceName.data() });
+
+        std::string text = "# vendor device driver triangle_workgroup triangles_per_invocation voxel_workgroup # name\n";
+        for (const Entry& entry : entries)
+        {
+            const DispatchTuning& t = entry.tuning;
+            std::format_to(std::back_inserter(text), "{:#06x} {:#06x} {:#010x} {} {} {}x{}x{} # {}\n",
+                           entry.vendor_id, entry.device_id, entry.driver_version,
+                           t.triangle_workgroup_size, t.triangles_per_invocation,
+                           t.voxel_workgroup_size.x, t.voxel_workgroup_size.y, t.voxel_workgroup_size.z,
+                           entry.device_name);
+        }
+
+        std::string error;
+        if (!write_file_atomically(filename, { std::as_bytes(std::span{ text }) }, error))
+        {
+            Logger::error("Failed to write tuning database: {}", error);
+            return false;
+        }
+
+        return true;
+    }
+
+
+    std::vector<TuningDatabase::Entry> TuningDatabase::read(const std::string& filename)
+    {
+        std::vector<Entry> entries;
+
+        std::ifstream file{ filename };
+        if (!file) return entries;
+
+        std::string line;
+        for (uint32_t line_number = 1; std::getline(file, line); ++line_number)
+        {
+            if (line.empty() || line.starts_with('#')) continue;
+
+            Entry entry{};
+            if (parse_entry(line, entry)) entries.push_back(std::move(entry));
+            else Logger::warn("{}:{}: skipping malformed tuning entry", filename, line_number);
+        }
+
+        return entries;
+    }
+
+    bool TuningDatabase::parse_entry(const std::string& line, Entry& entry)
+    {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            const size_t name_start = line.find_first_not_of(' ', comment + 1);
+            if (name_start != std::string::npos) entry.device_name = line.substr(name_start);
+        }
+
+        std::istringstream fields{ line.substr(0, comment) };
+        std::string        vendor, device, driver, workgroup, extra;
+        DispatchTuning&    tuning = entry.tuning;
+        fields >> vendor >> device >> driver >> tuning.triangle_workgroup_size >> tuning.triangles_per_invocation
+               >> workgroup;
+        if (!fields || (fields >> extra)) return false;
+
+        const auto parse_hex = [](const std::string_view& text, uint32_t& value)
+        {
+            if (!text.starts_with("0x")) return false;
+            const auto [end, error] = std::from_chars(text.data() + 2, text.data() + text.size(), value, 16);
+            return error == std::errc{} && end == text.data() + text.size();
+        };
+
+        if (!parse_hex(vendor, entry.vendor_id) || !parse_hex(device, entry.device_id) ||
+            !parse_hex(driver, entry.driver_version))
+            return false;
+
+        char first_x = 0, second_x = 0;
+        std::istringstream shape{ workgroup };
+        shape >> tuning.voxel_workgroup_size.x >> first_x >> tuning.voxel_workgroup_size.y >> second_x
+              >> tuning.voxel_workgroup_size.z;
+        return shape && first_x == 'x' && second_x == 'x' && shape.peek() == std::char_traits<char>::eof();
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    // Dispatch shapes of the voxelization kernels that different drivers disagree on
+    struct DispatchTuning final
+    {
+        uint32_t   triangle_workgroup_size{ 64 };  // voxelize_triangles.comp
+        uint32_t   triangles_per_invocation{ 1 };
+        glm::uvec3 voxel_workgroup_size{ 8 };      // voxelize_voxels.comp, except with binned candidates
+
+        // Within the workgroup limits of the device
+        [[nodiscard]] bool fits(const vk::PhysicalDeviceLimits& limits) const;
+    };
+
+    // Text file with one DispatchTuning per GPU, keyed by vendor, device and driver version, so a
+    // driver update gets tuned again. Written by --autotune and read at startup.
+    class TuningDatabase final
+    {
+    public:
+        TuningDatabase() = delete;
+
+        // False when the file has no entry for this GPU and driver
+        [[nodiscard]] static bool load(const std::string& filename, const vk::PhysicalDeviceProperties& properties,
+                                       DispatchTuning& tuning);
+
+        // Adds or replaces the entry for this GPU, keeping the others
+        [[nodiscard]] static bool store(const std::string& filename, const vk::PhysicalDeviceProperties& properties,
+                                        const DispatchTuning& tuning);
+
+    private:
+        struct Entry final
+        {
+            uint32_t       vendor_id;
+            uint32_t       device_id;
+            uint32_t       driver_version;
+            DispatchTuning tuning;
+            std::string    device_name;
+        };
+
+        [[nodiscard]] static std::vector<Entry> read(const std::string& filename);
+        [[nodiscard]] static bool parse_entry(const std::string& line, Entry& entry);
+    };
+}
@@ -0,0 +1,199 @@
+#include "VolumeWriter.hpp"
+#include "CpuProfiler.hpp"
+#include "Logger.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace boza
+{
+    VolumeStreamWriter::VolumeStreamWriter(const std::string_view& filename, const glm::uvec3& extent,
+                                           const VolumeFormat format)
+        : filename{ filename },
+          header{
+              .format   = format,
+              .width    = extent.x,
+              .height   = extent.y,
+              .depth    = extent.z,
+              .row_size = format == VolumeFormat::Occupancy
+                              ? (extent.x + 31) / 32 * static_cast<uint32_t>(sizeof(uint32_t))
+                              : extent.x * 4
+          }
+    {
+        const uint64_t file_size = sizeof(VolumeHeader) +
+                                   static_cast<uint64_t>(header.row_size) * header.height * header.depth;
+
+#ifdef _WIN32
+        const HANDLE handle = CreateFileA(this->filename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                          FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            Logger::error("Failed to open {} for writing", filename);
+            return;
+        }
+
+        file = handle;
+
+        // Reserves the space at once instead of growing the file with every tile
+        FILE_ALLOCATION_INFO allocation{};
+        allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(file_size);
+        SetFileInformationByHandle(handle, FileAllocationInfo, &allocation, sizeof(allocation));
+#else
+        file = open(this->filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (file < 0)
+        {
+            Logger::error("Failed to open {} for writing", filename);
+            return;
+        }
+
+#ifdef __linux__
+        // Reserves the space at once instead of growing the file with every tile; filesystems
+        // without support just grow it
+        posix_fallocate(file, 0, static_cast<off_t>(file_size));
+#endif
+#endif
+
+        ok = write_at(reinterpret_cast<const uint8_t*>(&header), sizeof(header), 0);
+    }
+
+    VolumeStreamWriter::~VolumeStreamWriter()
+    {
+        close();
+    }
+
+    VolumeStreamWriter::VolumeStreamWriter(VolumeStreamWriter&& other) noexcept
+        : file{ std::exchange(other.file, invalid_file) },
+          filename{ std::move(other.filename) },
+          header{ other.header },
+          layers_written{ std::exchange(other.layers_written, 0) },
+          ok{ std::exchange(other.ok, false) } {}
+
+    VolumeStreamWriter& VolumeStreamWriter::operator=(VolumeStreamWriter&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+
+            file           = std::exchange(other.file, invalid_file);
+            filename       = std::move(other.filename);
+            header         = other.header;
+            layers_written = std::exchange(other.layers_written, 0);
+            ok             = std::exchange(other.ok, false);
+        }
+
+        return *this;
+    }
+
+    bool VolumeStreamWriter::write_layers(const std::span<const uint8_t> data)
+    {
+        PROFILE_ZONE("volume write");
+        PROFILE_BYTES(data.size());
+
+        const size_t layer_size = static_cast<size_t>(header.row_size) * header.height;
+        if (data.size() % layer_size != 0 || layers_written + data.size() / layer_size > header.depth)
+        {
+            Logger::error("Volume data of {} bytes does not fit the remaining {} layers of {} bytes in {}",
+                          data.size(), header.depth - layers_written, layer_size, filename);
+            return false;
+        }
+
+        const uint64_t offset = sizeof(VolumeHeader) + static_cast<uint64_t>(layers_written) * layer_size;
+        if (!write_at(data.data(), data.size(), offset))
+        {
+            ok = false;
+            return false;
+        }
+
+        layers_written += static_cast<uint32_t>(data.size() / layer_size);
+        return true;
+    }
+
+    bool VolumeStreamWriter::finish()
+    {
+        if (layers_written != header.depth)
+        {
+            Logger::error("Only {} of {} layers were written to {}", layers_written, header.depth, filename);
+            return false;
+        }
+
+        close();
+        return ok;
+    }
+
+#ifdef _WIN32
+    bool VolumeStreamWriter::write_at(const uint8_t* data, size_t size, uint64_t offset)
+    {
+        // WriteFile takes 32-bit sizes
+        constexpr size_t max_write = 1u << 30;
+
+        while (size > 0)
+        {
+            OVERLAPPED position{};
+            position.Offset     = static_cast<DWORD>(offset);
+            position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            DWORD written = 0;
+            if (!WriteFile(file, data, static_cast<DWORD>(std::min(size, max_write)), &written, &position) ||
+                written == 0)
+            {
+                Logger::error("Failed to write {}", filename);
+                return false;
+            }
+
+            data += written;
+            size -= written;
+            offset += written;
+        }
+
+        return true;
+    }
+
+    void VolumeStreamWriter::close()
+    {
+        if (file != invalid_file && !CloseHandle(file))
+        {
+            Logger::error("Failed to close {}", filename);
+            ok = false;
+        }
+
+        file = invalid_file;
+    }
+#else
+    bool VolumeStreamWriter::write_at(const uint8_t* data, size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            const ssize_t written = pwrite(file, data, size, static_cast<off_t>(offset));
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0)
+            {
+                Logger::error("Failed to write {}: {}", filename, std::strerror(errno));
+                return false;
+            }
+
+            data += written;
+            size -= static_cast<size_t>(written);
+            offset += static_cast<uint64_t>(written);
+        }
+
+        return true;
+    }
+
+    void VolumeStreamWriter::close()
+    {
+        if (file != invalid_file && ::close(file) != 0)
+        {
+            Logger::error("Failed to close {}: {}", filename, std::strerror(errno));
+            ok = false;
+        }
+
+        file = invalid_file;
+    }
+#endif
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    enum class VolumeFormat : uint32_t
+    {
+        Rgba8     = 0, // 4 bytes per voxel
+        Occupancy = 1  // 1 bit per voxel, bit (x & 31) of word (x / 32) in every row
+    };
+
+    // Fixed-size little-endian header at the start of every .vox file, followed by the
+    // voxel data with x varying fastest, then y, then z
+    struct VolumeHeader final
+    {
+        std::array<char, 8> magic{ 'B', 'O', 'Z', 'A', 'V', 'O', 'X', '\0' };
+        uint32_t            version{ 1 };
+        VolumeFormat        format{ VolumeFormat::Occupancy };
+        uint32_t            width{};
+        uint32_t            height{};
+        uint32_t            depth{};
+        uint32_t            row_size{}; // bytes per row of voxel data
+    };
+
+    static_assert(sizeof(VolumeHeader) == 32);
+
+    // Writes a .vox a few z layers at a time, in order, so the whole grid never has to be held in
+    // memory. Layers go from the caller's memory, typically a mapped readback slot, to the file
+    // with positional writes and no copy in between, and the file is sized up front
+    class VolumeStreamWriter final
+    {
+    public:
+        VolumeStreamWriter(nullptr_t) {}
+        VolumeStreamWriter(const std::string_view& filename, const glm::uvec3& extent, VolumeFormat format);
+        ~VolumeStreamWriter();
+
+        VolumeStreamWriter(const VolumeStreamWriter&)            = delete;
+        VolumeStreamWriter& operator=(const VolumeStreamWriter&) = delete;
+
+        VolumeStreamWriter(VolumeStreamWriter&& other) noexcept;
+        VolumeStreamWriter& operator=(VolumeStreamWriter&& other) noexcept;
+
+        operator bool () const { return ok; }
+
+        // Appends whole z layers, row_size * height bytes each
+        [[nodiscard]] bool write_layers(std::span<const uint8_t> data);
+
+        // Checks that every layer has been written and closes the file
+        [[nodiscard]] bool finish();
+
+    private:
+        [[nodiscard]] bool write_at(const uint8_t* data, size_t size, uint64_t offset);
+        void close();
+
+#ifdef _WIN32
+        static constexpr void* invalid_file{ nullptr };
+        void*                  file{ invalid_file };
+#else
+        static constexpr int invalid_file{ -1 };
+        int                  file{ invalid_file };
+#endif
+
+        std::string  filename;
+        VolumeHeader header{};
+        uint32_t     layers_written{ 0 };
+
+        bool ok = false;
+    };
+}
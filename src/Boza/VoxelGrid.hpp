@@ -0,0 +1,30 @@
+#pragma once
+#include "pch.hpp"
+
+namespace boza
+{
+    // Maps object space to voxel units, where voxel (x, y, z) covers [x, x + 1) and so on.
+    // voxel_scale and voxel_offset are computed here once and handed to the shaders through
+    // App::Params, so CPU and GPU apply the very same transform.
+    struct VoxelGrid final
+    {
+        glm::uvec3 extent;
+        float      scale;
+
+        [[nodiscard]] float voxel_scale() const { return 0.5f * scale * static_cast<float>(extent.y); }
+        [[nodiscard]] float voxel_offset() const { return 0.5f * static_cast<float>(extent.y); }
+
+        [[nodiscard]] glm::vec3 to_voxel_space(const glm::vec3& vertex) const
+        {
+            return vertex * voxel_scale() + voxel_offset();
+        }
+    };
+
+    // Layers first .. first + depth - 1 of a VoxelGrid, voxelized and written out on their own
+    // so that memory use follows the tile and not the whole grid. Rows along x never span tiles.
+    struct VoxelTile final
+    {
+        uint32_t first;
+        uint32_t depth;
+    };
+}
@@ -5,3 +5,20 @@
 #else
 #define DEBUG_ONLY(X) X
 #endif
+
+// CPU profiling, see CpuProfiler.hpp, which has to be included where these are used. Built with
+// BOZA_PROFILE only, they compile to nothing otherwise
+#define PROFILE_CONCAT_IMPL(A, B) A##B
+#define PROFILE_CONCAT(A, B)      PROFILE_CONCAT_IMPL(A, B)
+
+#ifdef BOZA_PROFILE
+#define PROFILE_ZONE(NAME)   const ::boza::CpuProfiler::Zone PROFILE_CONCAT(profile_zone_, __LINE__){ NAME }
+#define PROFILE_BYTES(N)     ::boza::CpuProfiler::add_bytes(static_cast<uint64_t>(N))
+#define PROFILE_ALLOCATION() ::boza::CpuProfiler::add_allocation()
+#define PROFILE_FLUSH(NAME)  ::boza::CpuProfiler::flush(NAME)
+#else
+#define PROFILE_ZONE(NAME)   (void)0
+#define PROFILE_BYTES(N)     (void)0
+#define PROFILE_ALLOCATION() (void)0
+#define PROFILE_FLUSH(NAME)  (void)0
+#endif
@@ -18,18 +18,33 @@
 #include <iostream>
 #include <format>
 
+#include <any>
 #include <span>
 #include <string>
 #include <string_view>
+#include <charconv>
 #include <sstream>
 #include <fstream>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <queue>
 #include <filesystem>
 
 #include <unordered_set>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <numeric>
+#include <bit>
+#include <random>
 
 #include <cassert>
+#include <cstring>
 #include <ctime>
+#include <chrono>
 
 #include "macros.hpp"
\ No newline at end of file
@@ -1,10 +1,138 @@
 #include "Boza/App.hpp"
 #include "Boza/Logger.hpp"
 
-int main()
+namespace
 {
-    boza::App app{ "Test App" };
-    if (!app) boza::Logger::error("Failed to initialize App");
+    bool parse_uint(const std::string_view& text, uint32_t& value)
+    {
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc{} && end == text.data() + text.size();
+    }
 
-    app.run();
+    // WIDTHxHEIGHTxDEPTH, e.g. 2048x2048x2048
+    bool parse_extent(const std::string_view& text, glm::uvec3& extent)
+    {
+        const size_t first  = text.find('x');
+        const size_t second = text.find('x', first + 1);
+        if (first == std::string_view::npos || second == std::string_view::npos) return false;
+
+        return parse_uint(text.substr(0, first), extent.x) &&
+               parse_uint(text.substr(first + 1, second - first - 1), extent.y) &&
+               parse_uint(text.substr(second + 1), extent.z);
+    }
+
+    // Positive only, as used for the model scale
+    bool parse_float(const std::string_view& text, float& value)
+    {
+        float parsed = 0.0f;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), parsed);
+        if (error != std::errc{} || end != text.data() + text.size() || !(parsed > 0.0f)) return false;
+
+        value = parsed;
+        return true;
+    }
+
+    // One job per line: INPUT.obj OUTPUT [WIDTHxHEIGHTxDEPTH] [SCALE]. Blank lines and lines
+    // starting with # are skipped, and a job without a size or scale takes the command line's
+    bool parse_manifest(const std::string& filename, const boza::App::Settings& settings,
+                        std::vector<boza::App::Job>& jobs)
+    {
+        std::ifstream file{ filename };
+        if (!file)
+        {
+            boza::Logger::error("Failed to open manifest {}", filename);
+            return false;
+        }
+
+        std::string line;
+        for (uint32_t line_number = 1; std::getline(file, line); ++line_number)
+        {
+            std::istringstream fields{ line };
+            boza::App::Job     job{ {}, {}, settings.extent, settings.scale };
+            if (!(fields >> job.input) || job.input.starts_with('#')) continue;
+
+            std::string extent, scale, extra;
+            fields >> job.output >> extent >> scale >> extra;
+
+            if (job.output.empty() || !extra.empty() ||
+                (!extent.empty() && !parse_extent(extent, job.extent)) ||
+                (!scale.empty() && !parse_float(scale, job.scale)))
+            {
+                boza::Logger::error("{}:{}: expected INPUT OUTPUT [WIDTHxHEIGHTxDEPTH] [SCALE]", filename, line_number);
+                return false;
+            }
+
+            jobs.push_back(std::move(job));
+        }
+
+        if (jobs.empty()) boza::Logger::warn("Manifest {} lists no jobs", filename);
+        return true;
+    }
+}
+
+int main(const int argc, char** argv)
+{
+    // Critical lines bypass the log thread, so this one is out before the process aborts
+    std::set_terminate([]
+    {
+        boza::Logger::critical("Terminated by an unhandled exception");
+        std::abort();
+    });
+
+    using Mode    = boza::App::VoxelizationMode;
+    using Format  = boza::App::OutputFormat;
+    using Backend = boza::App::Backend;
+
+    Mode                mode = Mode::PerTriangle;
+    boza::App::Settings settings{ Format::Rgba8, false, Backend::Auto, false, { 128, 64, 128 }, 0, 0.3f, true, false, false };
+    std::string         manifest;
+    bool                autotune = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--per-voxel") mode = Mode::PerVoxel;
+        else if (arg == "--per-triangle") mode = Mode::PerTriangle;
+        else if (arg == "--binned") mode = Mode::Binned;
+        else if (arg == "--bvh") mode = Mode::Bvh;
+        else if (arg == "--occupancy") settings.output_format = Format::Occupancy;
+        else if (arg == "--raw") settings.output_format = Format::RawRgba8;
+        else if (arg == "--solid") settings.solid = true;
+        else if (arg == "--cpu") settings.backend = Backend::Cpu;
+        else if (arg == "--vulkan") settings.backend = Backend::Vulkan;
+        else if (arg == "--verify") settings.verify = true;
+        else if (arg == "--size" && i + 1 < argc)
+        {
+            if (!parse_extent(argv[++i], settings.extent)) boza::Logger::warn("Invalid grid size {}", argv[i]);
+        }
+        else if (arg == "--tile-depth" && i + 1 < argc)
+        {
+            if (!parse_uint(argv[++i], settings.tile_depth)) boza::Logger::warn("Invalid tile depth {}", argv[i]);
+        }
+        else if (arg == "--scale" && i + 1 < argc)
+        {
+            if (!parse_float(argv[++i], settings.scale)) boza::Logger::warn("Invalid scale {}", argv[i]);
+        }
+        else if (arg == "--batch" && i + 1 < argc) manifest = argv[++i];
+        else if (arg == "--autotune") autotune = true;
+        else if (arg == "--no-mesh-cache") settings.mesh_cache = false;
+        else if (arg == "--png-store") settings.png_store = true;
+        else if (arg == "--profile") settings.profile = true;
+        else boza::Logger::warn("Unknown argument {}", arg);
+    }
+
+    // Read before the device is set up, so a bad manifest fails fast
+    std::vector<boza::App::Job> jobs;
+    if (!manifest.empty() && !parse_manifest(manifest, settings, jobs)) return 1;
+
+    boza::App app{ "Test App", settings };
+    if (!app)
+    {
+        boza::Logger::error("Failed to initialize App");
+        return 1;
+    }
+
+    if (autotune) return app.autotune() ? 0 : 1;
+    if (manifest.empty()) return app.run(mode) ? 0 : 1;
+    return app.run_batch(jobs, mode) ? 0 : 1;
 }